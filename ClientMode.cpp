@@ -9,16 +9,39 @@ ClientMode::ClientMode(std::string const &host,
                        uint32_t level_num_,
                        uint32_t player_num_) : PlayerMode(level_num_, player_num_) {
 
-  client.reset(new Client(host, port));
-  connect = &client->connection;
+  if (transport.datagrams) {
+    datagram_client.reset(new DatagramClient(host, port));
+    datagram_client->conditions = transport.conditions;
+    connect = &datagram_client->connection;
+  } else {
+    client.reset(new Client(host, port));
+    connect = &client->connection;
+  }
+  start_recording();
+  record_connection(connect);
+  peer_hello = false;
+  Protocol::send_hello(connect);
+  send_join();
+
+}
 
+void ClientMode::level_loaded() {
+  send_join();
+}
+
+void ClientMode::send_join() {
+  if (!connect) return;
+  Protocol::Message join('J');
+  join.u8(uint8_t(level_num));
+  join.u8(uint8_t(player_num));
+  join.send(connect);
 }
 
 void ClientMode::handle_reset() {
   if (connect) {
     we_want_reset = true;
     reset_countdown = 0.01f;
-    connect->send('R');
+    Protocol::Message('R').send(connect);
     std::cout << "Requested reset" << std::endl;
     // TODO just call resume at the end
     pause = false;
@@ -31,13 +54,15 @@ void ClientMode::update_network() {
 
   if (!connect) return;
   update_send();
-  client->poll([this](Connection *connection, Connection::Event evt) {
+  auto on_event = [this](Connection *connection, Connection::Event evt) {
     //Read server state
     if (evt == Connection::OnRecv) {
-      update_recv(connection->recv_buffer);
+      update_recv(connection);
     } else if (evt == Connection::OnClose) {
       connect = nullptr;
     }
-  }, 0.0);
+  };
+  if (datagram_client) datagram_client->poll(on_event, 0.0);
+  else client->poll(on_event, 0.0);
 
 }
@@ -2,6 +2,7 @@
 
 #include "PlayerMode.hpp"
 #include "Connection.hpp"
+#include "Datagram.hpp"
 
 struct ClientMode : PlayerMode {
 
@@ -9,8 +10,15 @@ struct ClientMode : PlayerMode {
 
   void handle_reset() override;
 
+  //tells the server which level we are now on:
+  void level_loaded() override;
+
   void update_network() override;
 
   std::unique_ptr< Client > client = nullptr;
+  std::unique_ptr< DatagramClient > datagram_client = nullptr; //(instead of 'client' if transport.datagrams)
+
+  //announce level and player number (lets a dedicated server seat us in a matching room):
+  void send_join();
 
 };
@@ -0,0 +1,95 @@
+#include "CollisionBVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+//helper: build the subtree over items[begin,end) at the end of 'nodes' (depth-first):
+static void build_node(
+	std::vector< CollisionBVH::Node > &nodes, std::vector< uint32_t > &items,
+	std::vector< glm::vec3 > const &mins, std::vector< glm::vec3 > const &maxs,
+	std::vector< glm::vec3 > const &centers,
+	uint32_t begin, uint32_t end, uint32_t leaf_size) {
+
+	uint32_t index = uint32_t(nodes.size());
+	nodes.emplace_back();
+
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	glm::vec3 center_min = min;
+	glm::vec3 center_max = max;
+	for (uint32_t i = begin; i < end; ++i) {
+		min = glm::min(min, mins[items[i]]);
+		max = glm::max(max, maxs[items[i]]);
+		center_min = glm::min(center_min, centers[items[i]]);
+		center_max = glm::max(center_max, centers[items[i]]);
+	}
+	nodes[index].min = min;
+	nodes[index].max = max;
+
+	if (end - begin <= leaf_size) {
+		nodes[index].first = begin;
+		nodes[index].count = end - begin;
+		return;
+	}
+
+	//split at the median center along the longest axis:
+	// (median splits keep the tree balanced, so depth stays ~log2(items / leaf_size))
+	glm::vec3 extent = center_max - center_min;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	uint32_t mid = (begin + end) / 2;
+	std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+		[&centers, axis](uint32_t a, uint32_t b) {
+			return centers[a][axis] < centers[b][axis];
+		});
+
+	build_node(nodes, items, mins, maxs, centers, begin, mid, leaf_size); //left child is nodes[index+1]
+	nodes[index].first = uint32_t(nodes.size());
+	nodes[index].count = 0;
+	build_node(nodes, items, mins, maxs, centers, mid, end, leaf_size);
+}
+
+void CollisionBVH::build(std::vector< glm::vec3 > const &mins, std::vector< glm::vec3 > const &maxs, uint32_t leaf_size) {
+	assert(mins.size() == maxs.size());
+	assert(leaf_size > 0);
+
+	nodes.clear();
+	items.resize(mins.size());
+	for (uint32_t i = 0; i < items.size(); ++i) {
+		items[i] = i;
+	}
+	if (items.empty()) return;
+
+	std::vector< glm::vec3 > centers(mins.size());
+	for (uint32_t i = 0; i < centers.size(); ++i) {
+		centers[i] = 0.5f * (mins[i] + maxs[i]);
+	}
+
+	nodes.reserve(2 * (items.size() / leaf_size) + 1);
+	build_node(nodes, items, mins, maxs, centers, 0, uint32_t(items.size()), leaf_size);
+}
+
+void CollisionBVH::refit(std::vector< glm::vec3 > const &mins, std::vector< glm::vec3 > const &maxs) {
+	assert(mins.size() == items.size() && maxs.size() == items.size());
+
+	//children always come after their parents, so walking backward visits children first:
+	for (uint32_t n = uint32_t(nodes.size()); n > 0; --n) {
+		Node &node = nodes[n-1];
+		if (node.count > 0) {
+			node.min = glm::vec3( std::numeric_limits< float >::infinity());
+			node.max = glm::vec3(-std::numeric_limits< float >::infinity());
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				node.min = glm::min(node.min, mins[items[i]]);
+				node.max = glm::max(node.max, maxs[items[i]]);
+			}
+		} else {
+			Node const &left = nodes[n];
+			Node const &right = nodes[node.first];
+			node.min = glm::min(left.min, right.min);
+			node.max = glm::max(left.max, right.max);
+		}
+	}
+}
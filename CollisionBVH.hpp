@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+ * A CollisionBVH is a bounding volume hierarchy over a set of axis-aligned boxes
+ *  ("items", identified by index).
+ * GameLevel keeps two of these for collision:
+ *  - one over the world-space triangles of static colliders, built once at load
+ *  - one over movable colliders, refit (not rebuilt) when they move
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct CollisionBVH {
+	struct Node {
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		//leaf (count > 0): holds items[first, first+count)
+		//interior (count == 0): children are this node + 1 and nodes[first]
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+	//nodes are stored depth-first (parents before children); nodes[0] is the root:
+	std::vector< Node > nodes;
+	//item indices, grouped by leaf:
+	std::vector< uint32_t > items;
+
+	//(re-)build over items with bounds [mins[i], maxs[i]]:
+	void build(std::vector< glm::vec3 > const &mins, std::vector< glm::vec3 > const &maxs, uint32_t leaf_size = 4);
+
+	//update node bounds after item bounds change (same items as build(); tree shape is kept):
+	void refit(std::vector< glm::vec3 > const &mins, std::vector< glm::vec3 > const &maxs);
+
+	//call 'fn(first, count)' for each leaf whose bounds overlap [min,max]:
+	// (the leaf holds items[first, first+count))
+	template< typename F >
+	void query_leaves(glm::vec3 const &min, glm::vec3 const &max, F const &fn) const {
+		if (nodes.empty()) return;
+		uint32_t stack[64];
+		uint32_t top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			Node const &node = nodes[stack[--top]];
+			if (max.x < node.min.x || max.y < node.min.y || max.z < node.min.z
+			 || node.max.x < min.x || node.max.y < min.y || node.max.z < min.z) continue;
+			if (node.count > 0) {
+				fn(node.first, node.count);
+			} else {
+				stack[top++] = node.first;
+				stack[top++] = uint32_t(&node - &nodes[0]) + 1;
+			}
+		}
+	}
+
+	//call 'fn(item)' for each item in a leaf whose bounds overlap [min,max]:
+	template< typename F >
+	void query(glm::vec3 const &min, glm::vec3 const &max, F const &fn) const {
+		query_leaves(min, max, [this, &fn](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; ++i) {
+				fn(items[i]);
+			}
+		});
+	}
+};
+
+//Result of a swept sphere query (see GameLevel::sweep_sphere):
+struct SweptSphereHit {
+	float t = 1.0f; //first time (fraction of from -> to) the sphere touches anything
+	glm::vec3 at = glm::vec3(0.0f); //point of contact
+	glm::vec3 out = glm::vec3(0.0f); //direction out of the contact (normalized)
+	bool surface = false; //contact was with a triangle face (not an edge or vertex)
+	int movable_index = -1; //the movable the earliest contact is with (index in movable_data), or -1 if that's static geometry
+};
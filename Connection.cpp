@@ -5,6 +5,16 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <system_error>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#ifdef CONNECTION_EPOLL
+#include <sys/epoll.h>
+#include <fcntl.h>
+#endif
 
 //NOTE: much of the sockets code herein is based on http-tweak's single-header http server
 // see: https://github.com/ixchow/http-tweak
@@ -13,7 +23,208 @@
 
 
 //---------------------------------
-//Polling helper used by both server and client:
+//Helpers used by both polling backends:
+
+//Room to make in recv_buffer before each read (it grows further if a burst fills it):
+const size_t RecvChunk = 4096;
+
+//Read straight into the free space of c.recv_buffer:
+static ssize_t recv_spans(Connection &c) {
+	RingBuffer::Span spans[2];
+	uint32_t count = c.recv_buffer.writable_spans(spans, RecvChunk);
+	#ifdef _WIN32
+	(void)count;
+	return recv(c.socket, spans[0].data, int(spans[0].size), MSG_DONTWAIT);
+	#else
+	struct iovec iov[2];
+	for (uint32_t i = 0; i < count; ++i) {
+		iov[i].iov_base = spans[i].data;
+		iov[i].iov_len = spans[i].size;
+	}
+	//(recvmsg is readv with flags; sockets aren't necessarily in non-blocking mode)
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	return recvmsg(c.socket, &msg, MSG_DONTWAIT);
+	#endif
+}
+
+//Write straight out of c.send_buffer:
+static ssize_t send_spans(Connection &c) {
+	RingBuffer::Span spans[2];
+	uint32_t count = c.send_buffer.readable_spans(spans);
+	#ifdef _WIN32
+	(void)count;
+	return send(c.socket, spans[0].data, int(spans[0].size), MSG_DONTWAIT);
+	#else
+	struct iovec iov[2];
+	for (uint32_t i = 0; i < count; ++i) {
+		iov[i].iov_base = spans[i].data;
+		iov[i].iov_len = spans[i].size;
+	}
+	//(sendmsg is writev with flags; MSG_NOSIGNAL keeps a closed peer from raising SIGPIPE, where supported)
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	#ifdef MSG_NOSIGNAL
+	return sendmsg(c.socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	#else
+	return sendmsg(c.socket, &msg, MSG_DONTWAIT);
+	#endif
+	#endif
+}
+
+//Read what is available on a connection (all of it, if 'drain' -- edge-triggered epoll needs that):
+static void recv_connection(char const *where, Connection &c, std::function< void(Connection *, Connection::Event event) > const &on_event, bool drain) {
+	bool got_data = false;
+	do {
+		ssize_t ret = recv_spans(c);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//~no problem~ but no (more) data
+			break;
+		} else if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0) {
+			//~problem~ so remove connection
+			if (ret == 0) {
+				std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
+			} else {
+				std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
+			}
+			//(deliver whatever arrived before the close)
+			if (got_data && on_event) on_event(&c, Connection::OnRecv);
+			c.close();
+			if (on_event) on_event(&c, Connection::OnClose);
+			return;
+		} else { //ret > 0
+			c.recv_buffer.commit(size_t(ret));
+			got_data = true;
+		}
+	} while (drain);
+
+	if (got_data && on_event) on_event(&c, Connection::OnRecv);
+}
+
+//Send as much of a connection's send_buffer as the socket will take:
+static void send_connection(char const *where, Connection &c, std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	while (!c.send_buffer.empty()) {
+		ssize_t ret = send_spans(c);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//~no problem~, but don't keep trying
+			c.writable = false;
+			break;
+		} else if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
+			if (ret < 0) {
+				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
+			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
+				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+			}
+			c.close();
+			if (on_event) on_event(&c, Connection::OnClose);
+			break;
+		} else { //ret seems reasonable
+			c.send_buffer.pop(size_t(ret));
+		}
+	}
+}
+
+#ifdef CONNECTION_EPOLL
+//---------------------------------
+//epoll backend (linux):
+
+static int make_epoll() {
+	int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) {
+		throw std::system_error(errno, std::system_category(), "failed to create epoll instance");
+	}
+	return epoll_fd;
+}
+
+//Watch a socket (edge-triggered); 'connection' is null for the listen socket:
+static void epoll_watch(int epoll_fd, SOCKET socket, Connection *connection) {
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLET;
+	if (connection) event.events |= EPOLLOUT | EPOLLRDHUP;
+	event.data.ptr = connection;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket, &event) != 0) {
+		throw std::system_error(errno, std::system_category(), "failed to add socket to epoll instance");
+	}
+}
+
+void poll_connections(
+	char const *where,
+	int epoll_fd,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	SOCKET listen_socket = INVALID_SOCKET
+) {
+
+	//send anything queued since the last poll (so waiting below doesn't delay it):
+	for (auto &c : connections) {
+		if (c.socket != INVALID_SOCKET && c.writable && !c.send_buffer.empty()) send_connection(where, c, on_event);
+	}
+
+	const int MaxEvents = 256; //(any further ready sockets are reported by the next call)
+	struct epoll_event events[MaxEvents];
+	int timeout_ms = (timeout < 0.0 ? -1 : int(std::ceil(timeout * 1000.0)));
+	int count = epoll_wait(epoll_fd, events, MaxEvents, timeout_ms);
+	if (count < 0) {
+		if (errno != EINTR) {
+			std::cerr << "[" << where << "] epoll_wait() returned error " << errno << "(" << strerror(errno) << ")." << std::endl;
+		}
+		return;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		Connection *c = reinterpret_cast< Connection * >(events[i].data.ptr);
+
+		if (!c) {
+			//listen socket is readable; accept everything waiting (edge-triggered):
+			while (true) {
+				SOCKET got = accept4(listen_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (got == INVALID_SOCKET) {
+					if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+						std::cerr << "[" << where << "] accept() returned error " << errno << "(" << strerror(errno) << ")." << std::endl;
+					}
+					if (errno != EINTR) break;
+					continue;
+				}
+				connections.emplace_back();
+				connections.back().socket = got;
+				epoll_watch(epoll_fd, got, &connections.back());
+				std::cerr << "[" << where << "] client connected on " << connections.back().socket << "." << std::endl; //INFO
+				if (on_event) on_event(&connections.back(), Connection::OnOpen);
+			}
+			continue;
+		}
+
+		//(closed or released by an earlier callback during this poll)
+		if (c->socket == INVALID_SOCKET) continue;
+
+		if (events[i].events & EPOLLOUT) {
+			c->writable = true;
+		}
+		if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+			recv_connection(where, *c, on_event, true);
+		}
+	}
+
+	//send responses:
+	for (auto &c : connections) {
+		if (c.socket != INVALID_SOCKET && c.writable && !c.send_buffer.empty()) send_connection(where, c, on_event);
+	}
+}
+
+#else
+//---------------------------------
+//select backend:
+
 void poll_connections(
 	char const *where,
 	std::list< Connection > &connections,
@@ -35,7 +246,7 @@ void poll_connections(
 	}
 
 	//add each connection's socket to read (and possibly write) sets:
-	for (auto c : connections) {
+	for (auto const &c : connections) {
 		if (c.socket != INVALID_SOCKET) {
 			max = std::max(max, int(c.socket));
 			FD_SET(c.socket, &read_fds);
@@ -50,7 +261,7 @@ void poll_connections(
 		tv.tv_sec = std::lround(std::floor(timeout));
 		tv.tv_usec = std::lround((timeout - std::floor(timeout)) * 1e6);
 		//NOTE: on windows nfds is ignored -- https://msdn.microsoft.com/en-us/library/windows/desktop/ms740141(v=vs.85).aspx
-		int ret = select(max + 1, &read_fds, &write_fds, NULL, &tv);
+		int ret = select(max + 1, &read_fds, &write_fds, NULL, (timeout < 0.0 ? NULL : &tv));
 
 		if (ret < 0) {
 			std::cerr << "[" << where << "] Select returned an error; will attempt to read/write anyway." << std::endl;
@@ -80,62 +291,23 @@ void poll_connections(
 		}
 	}
 
-	const uint32_t BufferSize = 20000;
-	static thread_local char *buffer = new char[BufferSize];
-
 	//process requests:
 	for (auto &c : connections) {
 		//only read from valid sockets marked readable:
 		if (c.socket == INVALID_SOCKET || !FD_ISSET(c.socket, &read_fds)) continue;
-
-		ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			//~no problem~ but no data
-		} else if (ret <= 0 || ret > (ssize_t)BufferSize) {
-			//~problem~ so remove connection
-			if (ret == 0) {
-				std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
-			} else if (ret < 0) {
-				std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
-			} else {
-				std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
-			}
-			c.close();
-			if (on_event) on_event(&c, Connection::OnClose);
-		} else { //ret > 0
-			c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
-			if (on_event) on_event(&c, Connection::OnRecv);
-		}
+		recv_connection(where, c, on_event, false);
 	}
 
 	//process responses:
 	for (auto &c : connections) {
 		//don't bother with connections unless they are valid, have something to send, and are marked writable:
 		if (c.socket == INVALID_SOCKET || c.send_buffer.empty() || !FD_ISSET(c.socket, &write_fds)) continue;
-
-		#ifdef _WIN32
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), int(c.send_buffer.size()), MSG_DONTWAIT);
-		#else
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT);
-		#endif
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			//~no problem~, but don't keep trying
-			break;
-		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
-			if (ret < 0) {
-				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
-			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
-				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
-			}
-			c.close();
-			if (on_event) on_event(&c, Connection::OnClose);
-		} else { //ret seems reasonable
-			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
-		}
+		send_connection(where, c, on_event);
 	}
 
 
 }
+#endif
 
 //---------------------------------
 
@@ -222,18 +394,34 @@ Server::Server(std::string const &port) {
 	}
 
 	{ //listen on socket
-		int ret = ::listen(listen_socket, 5);
+		int ret = ::listen(listen_socket, SOMAXCONN);
 		if (ret < 0) {
 			closesocket(listen_socket);
 			throw std::system_error(errno, std::system_category(), "failed to listen on socket");
 		}
 	}
+
+	#ifdef CONNECTION_EPOLL
+	{ //accept() is called until it would block, so the listen socket must not block:
+		int flags = fcntl(listen_socket, F_GETFL, 0);
+		if (flags < 0 || fcntl(listen_socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+			closesocket(listen_socket);
+			throw std::system_error(errno, std::system_category(), "failed to make listen socket non-blocking");
+		}
+		epoll_fd = make_epoll();
+		epoll_watch(epoll_fd, listen_socket, nullptr);
+	}
+	#endif
 }
 
-void Server::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+Server::~Server() {
+	#ifdef CONNECTION_EPOLL
+	if (epoll_fd >= 0) ::close(epoll_fd);
+	#endif
+}
 
-	//reap closed clients:
+//Remove closed connections:
+static void reap_connections(std::list< Connection > &connections) {
 	for (auto connection = connections.begin(); connection != connections.end(); /*later*/) {
 		auto old = connection;
 		++connection;
@@ -243,6 +431,59 @@ void Server::poll(std::function< void(Connection *, Connection::Event event) > c
 	}
 }
 
+void Server::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
+	#ifdef CONNECTION_EPOLL
+	poll_connections("Server::poll", epoll_fd, connections, on_event, timeout, listen_socket);
+	#else
+	poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+	#endif
+
+	//reap closed clients:
+	reap_connections(connections);
+}
+
+Connection Server::release(Connection *connection) {
+	Connection released;
+	released.socket = connection->socket;
+	released.recv_buffer.swap(connection->recv_buffer);
+	released.send_buffer.swap(connection->send_buffer);
+	#ifdef CONNECTION_EPOLL
+	if (connection->socket != INVALID_SOCKET) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->socket, NULL);
+	#endif
+	//(the now-invalid entry is reaped at the end of poll())
+	connection->socket = INVALID_SOCKET;
+	return released;
+}
+
+ConnectionSet::~ConnectionSet() {
+	#ifdef CONNECTION_EPOLL
+	if (epoll_fd >= 0) ::close(epoll_fd);
+	#endif
+}
+
+Connection *ConnectionSet::add(Connection &&connection) {
+	connections.emplace_back(std::move(connection));
+	Connection *added = &connections.back();
+	#ifdef CONNECTION_EPOLL
+	if (epoll_fd < 0) epoll_fd = make_epoll();
+	//(registering reports the socket's current state, so nothing that arrived before this is missed)
+	added->writable = true;
+	if (added->socket != INVALID_SOCKET) epoll_watch(epoll_fd, added->socket, added);
+	#endif
+	return added;
+}
+
+void ConnectionSet::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
+	#ifdef CONNECTION_EPOLL
+	if (epoll_fd < 0) epoll_fd = make_epoll();
+	poll_connections("ConnectionSet::poll", epoll_fd, connections, on_event, timeout, INVALID_SOCKET);
+	#else
+	poll_connections("ConnectionSet::poll", connections, on_event, timeout, INVALID_SOCKET);
+	#endif
+
+	reap_connections(connections);
+}
+
 Client::Client(std::string const &host, std::string const &port) : connections(1), connection(connections.front()) {
 	#ifdef _WIN32
 	{ //init winsock:
@@ -308,8 +549,23 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 			throw std::runtime_error("Failed to connect to any of the addresses tried for server.");
 		}
 	}
+
+	#ifdef CONNECTION_EPOLL
+	epoll_fd = make_epoll();
+	epoll_watch(epoll_fd, connection.socket, &connection);
+	#endif
+}
+
+Client::~Client() {
+	#ifdef CONNECTION_EPOLL
+	if (epoll_fd >= 0) ::close(epoll_fd);
+	#endif
 }
 
 void Client::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
+	#ifdef CONNECTION_EPOLL
+	poll_connections("Client::poll", epoll_fd, connections, on_event, timeout, INVALID_SOCKET);
+	#else
 	poll_connections("Client::poll", connections, on_event, timeout, INVALID_SOCKET);
+	#endif
 }
@@ -35,6 +35,8 @@ constexpr const SOCKET INVALID_SOCKET = -1;
 #endif
 //--------- ---------------------------------- ---------
 
+#include "RingBuffer.hpp"
+
 #include <vector>
 #include <list>
 #include <string>
@@ -53,9 +55,10 @@ int main(int argc, char **argv) {
 	while (true) {
 		server.poll([](Connection *connection, Connection::Event evt){
 			if (evt == Connection::OnRecv) {
-				//extract and erase data from the connection's recv_buffer:
-				std::vector< uint8_t > data = connection->recv_buffer;
-				connection->recv_buffer.clear();
+				//look at (and then consume) data in the connection's recv_buffer:
+				char *data = connection->recv_buffer.data();
+				size_t size = connection->recv_buffer.size();
+				connection->recv_buffer.pop(size);
 				//send to other connections:
 
 			}
@@ -77,8 +80,15 @@ int main(int argc, char **argv) {
 	}
 }
 
+ * On Linux, poll() is backed by epoll (edge-triggered; cost scales with the
+ * number of sockets that have activity, not the number of sockets).
+ * Elsewhere it uses select() (which is limited to FD_SETSIZE sockets).
+ * Either way, a negative timeout waits (without spinning) until something happens.
  */
 
+#ifdef __linux__
+#define CONNECTION_EPOLL 1
+#endif
 
 //Thin wrapper around a (polling-based) TCP socket connection:
 struct Connection {
@@ -89,27 +99,47 @@ struct Connection {
 	}
 	//Helper that will append raw bytes to the send buffer:
 	void send_raw(void const *data, size_t size) {
-		send_buffer.insert(send_buffer.end(), reinterpret_cast< uint8_t const * >(data), reinterpret_cast< uint8_t const * >(data) + size);
+		if (on_send) on_send(data, size, false);
+		send_buffer.push(data, size);
+	}
+
+	//Helper for messages that may be lost (but never arrive out of order) -- on datagram
+	// connections, these skip the reliable stream (see Datagram.hpp); over TCP they are just sent:
+	void send_unreliable(void const *data, size_t size) {
+		if (!datagram) return send_raw(data, size);
+		if (on_send) on_send(data, size, true);
+		unreliable_send_buffer.push(data, size);
 	}
 
 	//Call 'close' to mark a connection for discard:
 	void close() {
 		if (socket != INVALID_SOCKET) {
-			::closesocket(socket);
+			if (!datagram) ::closesocket(socket); //(datagram connections share their transport's socket)
 			socket = INVALID_SOCKET;
 		}
 	}
 
 	//so you can if(connection) ... to check for validity:
-	explicit operator bool() { return socket != INVALID_SOCKET; }
+	explicit operator bool() const { return socket != INVALID_SOCKET; }
 
 	//To send data over a connection, append it to send_buffer:
-	std::vector< char > send_buffer;
+	RingBuffer send_buffer;
 	//When the connection receives data, it is appended to recv_buffer:
-	std::vector< char > recv_buffer;
+	// (parse messages in place with recv_buffer.data(), then pop() them)
+	RingBuffer recv_buffer;
+
+	//Datagram connections only -- whole messages from send_unreliable() waiting to go out,
+	// and the ones that arrived (those that got lost or were overtaken don't show up):
+	RingBuffer unreliable_send_buffer = RingBuffer(0);
+	RingBuffer unreliable_recv_buffer = RingBuffer(0);
+	bool datagram = false;
+
+	//if set, sees everything sent (e.g. to record a session -- see Recording.hpp):
+	std::function< void(void const *data, size_t size, bool unreliable) > on_send;
 
 	//internals:
 	SOCKET socket = INVALID_SOCKET;
+	bool writable = true; //(epoll) socket had room for more data as of the last send/event
 
 	enum Event {
 		OnOpen,
@@ -120,27 +150,61 @@ struct Connection {
 
 struct Server {
 	Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+	~Server();
+	Server(Server const &) = delete;
+	Server &operator=(Server const &) = delete;
 
 	//poll() updates the list of active connections and provides information to your callbacks:
 	void poll(
 		std::function< void(Connection *, Connection::Event event) > const &connection_event = nullptr,
-		double timeout = 0.0 //timeout (seconds)
+		double timeout = 0.0 //timeout (seconds; negative to wait for activity)
 	);
 
+	//take a connection (socket and buffers) away from the server without closing it,
+	// e.g. to hand it to a ConnectionSet on another thread:
+	Connection release(Connection *connection);
+
 	std::list< Connection > connections;
 	SOCKET listen_socket = INVALID_SOCKET;
+	int epoll_fd = -1; //(epoll only)
+};
+
+
+//A set of already-open connections, polled without a listen socket
+// (e.g. connections a Server has handed off to a worker thread):
+struct ConnectionSet {
+	ConnectionSet() = default;
+	~ConnectionSet();
+	ConnectionSet(ConnectionSet const &) = delete;
+	ConnectionSet &operator=(ConnectionSet const &) = delete;
+
+	//start polling an open connection (e.g. one from Server::release()):
+	Connection *add(Connection &&connection);
+
+	//poll() works like Server::poll(), including dropping closed connections afterward:
+	void poll(
+		std::function< void(Connection *, Connection::Event event) > const &connection_event = nullptr,
+		double timeout = 0.0 //timeout (seconds; negative to wait for activity)
+	);
+
+	std::list< Connection > connections;
+	int epoll_fd = -1; //(epoll only)
 };
 
 
 struct Client {
 	Client(std::string const &host, std::string const &port);
+	~Client();
+	Client(Client const &) = delete;
+	Client &operator=(Client const &) = delete;
 
 	//poll() checks the status of the active connection and provides information to your callbacks:
 	void poll(
 		std::function< void(Connection *, Connection::Event event) > const &connection_event = nullptr,
-		double timeout = 0.0 //timeout (seconds)
+		double timeout = 0.0 //timeout (seconds; negative to wait for activity)
 	);
 
 	std::list< Connection > connections; //will only ever contain exactly one connection
 	Connection &connection; //reference to the only connection in the connections list
+	int epoll_fd = -1; //(epoll only)
 };
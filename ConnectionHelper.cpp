@@ -104,7 +104,7 @@
 				server->poll([this](Connection *connection, Connection::Event evt){
 				if (evt == Connection::OnRecv) {
 						//extract and erase data from the connection's recv_buffer:
-						std::vector< char > data = connection->recv_buffer;
+						char *data = connection->recv_buffer.data();
 						char type = data[0];
 						if (type == 'C') {
 							char *start = &data[1];
@@ -143,7 +143,7 @@
 				client->poll([this](Connection *connection, Connection::Event evt){
   				//Read server state
 					if (evt == Connection::OnRecv) {
-						std::vector< char > data = connection->recv_buffer;
+						char *data = connection->recv_buffer.data();
 						char type = data[0];
 						if (type == 'C') {
 							char *start = &data[1];
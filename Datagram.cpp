@@ -0,0 +1,664 @@
+#include "Datagram.hpp"
+#include "Protocol.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+//NOTE: socket setup follows Server/Client in Connection.cpp.
+
+static const uint32_t Magic = 0x50445556; //"VUDP" on the wire
+static const size_t PacketHeader = 4 + 1 + 4; //magic, kind, connection id
+static const size_t DataHeader = PacketHeader + 4 + 2 + 1; //+ ack, sequence, flags
+static const size_t SegmentHeader = 4 + 2; //stream offset, length
+static const uint8_t HasSegment = 1;
+static const uint8_t HasUnreliable = 2;
+static const uint8_t HasGaps = 4;
+
+static void put_u8(std::vector< char > &bytes, uint8_t value) {
+	bytes.emplace_back(char(value));
+}
+static void put_u16(std::vector< char > &bytes, uint16_t value) {
+	bytes.emplace_back(char(value & 0xff));
+	bytes.emplace_back(char(value >> 8));
+}
+static void put_u32(std::vector< char > &bytes, uint32_t value) {
+	for (uint32_t i = 0; i < 4; ++i) bytes.emplace_back(char((value >> (8 * i)) & 0xff));
+}
+static uint16_t get_u16(char const *at) {
+	return uint16_t(uint8_t(at[0])) | uint16_t(uint16_t(uint8_t(at[1])) << 8);
+}
+static uint32_t get_u32(char const *at) {
+	return uint32_t(uint8_t(at[0])) | (uint32_t(uint8_t(at[1])) << 8) | (uint32_t(uint8_t(at[2])) << 16) | (uint32_t(uint8_t(at[3])) << 24);
+}
+
+static void put_header(std::vector< char > &bytes, char kind, uint32_t id) {
+	put_u32(bytes, Magic);
+	put_u8(bytes, uint8_t(kind));
+	put_u32(bytes, id);
+}
+
+static bool same_address(struct sockaddr_storage const &a, socklen_t a_size, struct sockaddr_storage const &b, socklen_t b_size) {
+	return a_size == b_size && memcmp(&a, &b, a_size) == 0;
+}
+
+//size of the Protocol frame starting 'offset' bytes into 'data' (or of the rest of 'data', if the frame looks cut off):
+static size_t frame_size(RingBuffer const &data, size_t offset) {
+	size_t left = data.size() - offset;
+	if (left < Protocol::HeaderSize) return left;
+	size_t length = size_t(uint8_t(data[offset + 1])) | (size_t(uint8_t(data[offset + 2])) << 8);
+	return std::min(left, Protocol::HeaderSize + length);
+}
+
+//---------------------------------
+
+DatagramTransport::~DatagramTransport() {
+	if (socket == INVALID_SOCKET) return;
+	//say goodbye (best effort; held-back packets are dropped):
+	for (auto const &peer : peers) {
+		if (peer.open && peer.connection) {
+			std::vector< char > bytes;
+			put_header(bytes, 'X', peer.id);
+			transmit_now(peer.address, peer.address_size, bytes.data(), bytes.size());
+		}
+	}
+	::closesocket(socket);
+}
+
+double DatagramTransport::now() const {
+	return std::chrono::duration< double >(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void DatagramTransport::open_socket(struct addrinfo const *info, bool bind_to_it) {
+	SOCKET s = ::socket(info->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == INVALID_SOCKET) {
+		throw std::system_error(errno, std::system_category(), "failed to create datagram socket");
+	}
+	if (bind_to_it) {
+		{ //make it okay to reuse port:
+			#ifdef _WIN32
+			BOOL one = TRUE;
+			int ret = setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast< const char * >(&one), sizeof(one));
+			#else
+			int one = 1;
+			int ret = setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			#endif
+			if (ret != 0) {
+				std::cout << "[note: couldn't set SO_REUSEADDR] " << std::endl;
+			}
+		}
+		if (bind(s, info->ai_addr, int(info->ai_addrlen)) < 0) {
+			int error = errno;
+			::closesocket(s);
+			throw std::system_error(error, std::system_category(), "failed to bind datagram socket");
+		}
+	}
+	#ifdef _WIN32
+	unsigned long one = 1;
+	ioctlsocket(s, FIONBIO, &one);
+	#endif
+	socket = s;
+}
+
+void DatagramTransport::transmit(struct sockaddr_storage const &to, socklen_t to_size, std::vector< char > const &bytes) {
+	stats.packets_sent += 1;
+	if (conditions.loss > 0.0f && std::uniform_real_distribution< float >(0.0f, 1.0f)(mt) < conditions.loss) {
+		stats.packets_dropped += 1;
+		return;
+	}
+	if (conditions.latency > 0.0 || conditions.jitter > 0.0) {
+		double at = now() + conditions.latency + std::uniform_real_distribution< double >(0.0, conditions.jitter)(mt);
+		Delayed &d = delayed.emplace(at, Delayed())->second;
+		d.address = to;
+		d.address_size = to_size;
+		d.bytes = bytes;
+		return;
+	}
+	transmit_now(to, to_size, bytes.data(), bytes.size());
+}
+
+void DatagramTransport::transmit_now(struct sockaddr_storage const &to, socklen_t to_size, char const *data, size_t size) {
+	//(a datagram that doesn't go out is just a lost packet)
+	#ifdef MSG_NOSIGNAL
+	sendto(socket, data, size, MSG_DONTWAIT | MSG_NOSIGNAL, reinterpret_cast< struct sockaddr const * >(&to), to_size);
+	#else
+	sendto(socket, data, int(size), MSG_DONTWAIT, reinterpret_cast< struct sockaddr const * >(&to), to_size);
+	#endif
+}
+
+void DatagramTransport::transmit_delayed() {
+	double t = now();
+	while (!delayed.empty() && delayed.begin()->first <= t) {
+		Delayed const &d = delayed.begin()->second;
+		transmit_now(d.address, d.address_size, d.bytes.data(), d.bytes.size());
+		delayed.erase(delayed.begin());
+	}
+}
+
+double DatagramTransport::next_timer() const {
+	double next = -1.0;
+	auto consider = [&next](double at) {
+		if (next < 0.0 || at < next) next = at;
+	};
+	if (!delayed.empty()) consider(delayed.begin()->first);
+	for (auto const &peer : peers) {
+		if (!peer.connection) continue;
+		if (!peer.open) {
+			consider(peer.sent_at + ConnectInterval);
+			continue;
+		}
+		if (peer.sent > 0) consider(peer.resend_at);
+		consider(peer.sent_at + KeepAlive);
+		consider(peer.heard_at + Timeout);
+	}
+	return next;
+}
+
+void DatagramTransport::send_control(DatagramPeer const &peer, char kind) {
+	std::vector< char > bytes;
+	put_header(bytes, kind, peer.id);
+	transmit(peer.address, peer.address_size, bytes);
+}
+
+void DatagramTransport::send_peer(DatagramPeer &peer) {
+	double t = now();
+	Connection &c = peer.connection;
+
+	//nothing acked for a while? send the oldest bytes again:
+	if (peer.sent > 0 && t >= peer.resend_at) {
+		//(just the first packet's worth; if more was lost, the peer's gap reports will say)
+		peer.resend.assign(1, std::make_pair(peer.acked, peer.acked + uint32_t(std::min(peer.sent, MaxPacket - DataHeader - SegmentHeader))));
+		peer.timeout = std::min(peer.timeout * 2.0, 2.0);
+		peer.resend_at = t + peer.timeout;
+	}
+
+	//the ranges we have past a gap (so the peer can resend just what is missing):
+	std::vector< char > gaps;
+	if (!peer.early.empty()) {
+		std::vector< std::pair< uint32_t, uint32_t > > ranges; //(relative to 'received')
+		for (auto const &e : peer.early) {
+			uint32_t begin = e.first - peer.received;
+			ranges.emplace_back(begin, begin + uint32_t(e.second.size()));
+		}
+		std::sort(ranges.begin(), ranges.end());
+		std::vector< std::pair< uint32_t, uint32_t > > merged;
+		for (auto const &r : ranges) {
+			if (!merged.empty() && r.first <= merged.back().second) merged.back().second = std::max(merged.back().second, r.second);
+			else merged.emplace_back(r);
+		}
+		if (merged.size() > MaxGaps) merged.resize(MaxGaps);
+		put_u8(gaps, uint8_t(merged.size()));
+		for (auto const &r : merged) {
+			put_u32(gaps, peer.received + r.first);
+			put_u32(gaps, peer.received + r.second);
+		}
+	}
+	size_t header = DataHeader + gaps.size();
+
+	bool sent_any = false;
+	while (true) {
+		//some reliable bytes -- ones to send again first, then ones not sent yet:
+		while (!peer.resend.empty()) {
+			//(skip whatever has been acked since)
+			auto &r = peer.resend.front();
+			if (int32_t(r.first - peer.acked) < 0) r.first = peer.acked;
+			if (int32_t(r.second - (peer.acked + uint32_t(peer.sent))) > 0) r.second = peer.acked + uint32_t(peer.sent);
+			if (int32_t(r.second - r.first) > 0) break;
+			peer.resend.erase(peer.resend.begin());
+		}
+		bool resending = !peer.resend.empty();
+		size_t segment_at = 0;
+		size_t segment = 0;
+		if (resending) {
+			segment_at = peer.resend.front().first - peer.acked;
+			segment = std::min(size_t(peer.resend.front().second - peer.resend.front().first), MaxPacket - header - SegmentHeader);
+		} else if (peer.sent < c.send_buffer.size() && peer.sent < Window) {
+			segment_at = peer.sent;
+			segment = std::min(c.send_buffer.size() - peer.sent, Window - peer.sent);
+			segment = std::min(segment, MaxPacket - header - SegmentHeader);
+		}
+
+		//...and whichever unreliable messages fit alongside them:
+		size_t room = MaxPacket - header - (segment ? SegmentHeader + segment : 0);
+		size_t messages = 0;
+		while (messages < c.unreliable_send_buffer.size()) {
+			size_t size = frame_size(c.unreliable_send_buffer, messages);
+			if (messages + size > room) break;
+			messages += size;
+		}
+		if (messages == 0 && !c.unreliable_send_buffer.empty()
+		 && frame_size(c.unreliable_send_buffer, 0) > MaxPacket - header) {
+			//too big for any packet; send it reliably instead:
+			size_t size = frame_size(c.unreliable_send_buffer, 0);
+			std::vector< char > message(size);
+			c.unreliable_send_buffer.peek(0, message.data(), size);
+			c.unreliable_send_buffer.pop(size);
+			c.send_buffer.push(message.data(), size);
+			continue;
+		}
+
+		if (segment == 0 && messages == 0) {
+			//nothing to send; still, the peer may be waiting on an ack, or want to know we're here:
+			if (sent_any || !(peer.ack_due || t - peer.sent_at >= KeepAlive)) break;
+		}
+
+		std::vector< char > bytes;
+		bytes.reserve(header + (segment ? SegmentHeader + segment : 0) + messages);
+		put_header(bytes, 'D', peer.id);
+		put_u32(bytes, peer.received);
+		peer.sequence += 1;
+		put_u16(bytes, peer.sequence);
+		put_u8(bytes, (segment ? HasSegment : 0) | (messages ? HasUnreliable : 0) | (gaps.empty() ? 0 : HasGaps));
+		bytes.insert(bytes.end(), gaps.begin(), gaps.end());
+		if (segment) {
+			put_u32(bytes, peer.acked + uint32_t(segment_at));
+			put_u16(bytes, uint16_t(segment));
+			size_t at = bytes.size();
+			bytes.resize(at + segment);
+			c.send_buffer.peek(segment_at, bytes.data() + at, segment);
+		}
+		if (messages) {
+			size_t at = bytes.size();
+			bytes.resize(at + messages);
+			c.unreliable_send_buffer.peek(0, bytes.data() + at, messages);
+			c.unreliable_send_buffer.pop(messages);
+		}
+		transmit(peer.address, peer.address_size, bytes);
+		sent_any = true;
+		peer.ack_due = false;
+		peer.sent_at = t;
+
+		if (segment && resending) {
+			uint32_t begin = peer.acked + uint32_t(segment_at);
+			uint32_t end = begin + uint32_t(segment);
+			peer.resend.front().first = end;
+			if (peer.probe_sent >= 0.0 && int32_t(end - peer.probe_begin) > 0 && int32_t(peer.probe_end - begin) > 0) {
+				peer.probe_sent = -1.0; //(the ack won't tell which copy arrived)
+			}
+			stats.bytes_resent += segment;
+		} else if (segment) {
+			if (peer.probe_sent < 0.0) {
+				//time how long this segment takes to be acked:
+				peer.probe_begin = peer.acked + uint32_t(peer.sent);
+				peer.probe_end = peer.probe_begin + uint32_t(segment);
+				peer.probe_sent = t;
+			}
+			if (peer.sent == 0) peer.resend_at = t + peer.timeout;
+			peer.sent += segment;
+		}
+		if (segment == 0 && messages == 0) break;
+	}
+}
+
+void DatagramTransport::handle_packet(char const *where, char const *data, size_t size, struct sockaddr_storage const &from, socklen_t from_size,
+	std::function< void(Connection *, Connection::Event event) > const &on_event, bool accept_connects,
+	std::vector< DatagramPeer * > *got_data) {
+
+	if (size < PacketHeader || get_u32(data) != Magic) return; //(not ours)
+	char kind = data[4];
+	uint32_t id = get_u32(data + 5);
+	double t = now();
+
+	//servers know peers by address; a client only has the one:
+	DatagramPeer *peer = nullptr;
+	for (auto &p : peers) {
+		if (p.connection && (accept_connects ? same_address(p.address, p.address_size, from, from_size) : p.id == id)) {
+			peer = &p;
+			break;
+		}
+	}
+
+	if (kind == 'C') {
+		if (!accept_connects) return;
+		if (peer && peer->id == id) {
+			send_control(*peer, 'A'); //(our accept was lost)
+			return;
+		}
+		if (peer) {
+			//same address, new id -- the client started over:
+			std::cerr << "[" << where << "] client reconnected, dropping its old connection." << std::endl;
+			peer->open = false;
+			peer->connection.close();
+			if (on_event) on_event(&peer->connection, Connection::OnClose);
+		}
+		peers.emplace_back();
+		DatagramPeer &p = peers.back();
+		p.address = from;
+		p.address_size = from_size;
+		p.id = id;
+		p.open = true;
+		p.connection.datagram = true;
+		p.connection.socket = socket;
+		p.heard_at = p.sent_at = t;
+		send_control(p, 'A');
+		std::cerr << "[" << where << "] client connected (datagram id " << id << ")." << std::endl; //INFO
+		if (on_event) on_event(&p.connection, Connection::OnOpen);
+		return;
+	}
+
+	if (!peer || peer->id != id) return;
+
+	if (kind == 'A') {
+		if (peer->open) return;
+		peer->open = true;
+		peer->heard_at = t;
+		if (on_event) on_event(&peer->connection, Connection::OnOpen);
+		return;
+	}
+
+	if (!peer->open) return;
+
+	if (kind == 'X') {
+		std::cerr << "[" << where << "] peer disconnected." << std::endl;
+		peer->open = false;
+		peer->connection.close();
+		if (on_event) on_event(&peer->connection, Connection::OnClose);
+		return;
+	}
+
+	if (kind != 'D' || size < DataHeader) return;
+	peer->heard_at = t;
+	Connection &c = peer->connection;
+
+	uint32_t ack = get_u32(data + PacketHeader);
+	uint16_t sequence = get_u16(data + PacketHeader + 4);
+	uint8_t flags = uint8_t(data[PacketHeader + 6]);
+	char const *at = data + DataHeader;
+	char const *end = data + size;
+
+	{ //the peer has everything before 'ack':
+		int32_t advance = int32_t(ack - peer->acked);
+		if (advance > 0 && size_t(advance) <= peer->sent) {
+			c.send_buffer.pop(size_t(advance));
+			peer->acked = ack;
+			peer->sent -= size_t(advance);
+			if (peer->probe_sent >= 0.0 && int32_t(ack - peer->probe_end) >= 0) {
+				//(the timeout only comes back down with a fresh measurement -- acks of resent bytes can't be timed)
+				peer->rtt = 0.875 * peer->rtt + 0.125 * (t - peer->probe_sent);
+				peer->timeout = std::min(std::max(2.0 * peer->rtt + 0.01, 0.02), 2.0);
+				peer->probe_sent = -1.0;
+			}
+			peer->resend_at = t + peer->timeout;
+		}
+	}
+
+	if (flags & HasGaps) {
+		//...and these ranges past it; resend what's between (once per round trip, unless the ack moved):
+		if (end - at < 1) return;
+		uint32_t count = uint8_t(*at);
+		at += 1;
+		if (size_t(end - at) < count * 8) return;
+		//(a hole counts as lost once a few packets' worth past it arrived -- until then it may just be reordering)
+		std::vector< std::pair< uint32_t, uint32_t > > holes;
+		std::vector< size_t > past; //bytes received past each hole
+		uint32_t hole = ack;
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t begin = get_u32(at);
+			uint32_t range_end = get_u32(at + 4);
+			at += 8;
+			if (int32_t(range_end - begin) <= 0) continue;
+			if (peer->probe_sent >= 0.0 && int32_t(peer->probe_begin - begin) >= 0 && int32_t(range_end - peer->probe_end) >= 0) {
+				//(the timed segment got there, even if earlier ones didn't)
+				peer->rtt = 0.875 * peer->rtt + 0.125 * (t - peer->probe_sent);
+				peer->timeout = std::min(std::max(2.0 * peer->rtt + 0.01, 0.02), 2.0);
+				peer->probe_sent = -1.0;
+			}
+			if (int32_t(begin - hole) > 0) {
+				holes.emplace_back(hole, begin);
+				past.emplace_back(0);
+			}
+			for (auto &p : past) p += range_end - begin;
+			if (int32_t(range_end - hole) > 0) hole = range_end;
+		}
+		std::vector< std::pair< uint32_t, uint32_t > > lost;
+		for (size_t i = 0; i < holes.size(); ++i) {
+			if (past[i] >= 3 * (MaxPacket - DataHeader)) lost.emplace_back(holes[i]);
+		}
+		if (!lost.empty() && ack == peer->acked && peer->sent > 0
+		 && (ack != peer->gaps_resent_ack || t - peer->gaps_resent_at > 1.5 * peer->rtt)) {
+			peer->resend = lost;
+			peer->gaps_resent_ack = ack;
+			peer->gaps_resent_at = t;
+		}
+	}
+
+	if (flags & HasSegment) {
+		if (end - at < ptrdiff_t(SegmentHeader)) return;
+		uint32_t offset = get_u32(at);
+		size_t length = get_u16(at + 4);
+		at += SegmentHeader;
+		if (size_t(end - at) < length) return;
+
+		int32_t gap = int32_t(offset - peer->received);
+		if (gap > 0) {
+			//arrived ahead of something lost; hold on to it (if there's room) until the gap is filled:
+			if (size_t(gap) < Window && peer->early_bytes + length <= Window && !peer->early.count(offset)) {
+				peer->early[offset].assign(at, at + length);
+				peer->early_bytes += length;
+			}
+		} else if (size_t(-int64_t(gap)) < length) {
+			//append whatever part of it is new, then anything it connects up with:
+			size_t skip = size_t(-int64_t(gap));
+			c.recv_buffer.push(at + skip, length - skip);
+			peer->received += uint32_t(length - skip);
+			for (bool more = true; more; ) {
+				more = false;
+				for (auto e = peer->early.begin(); e != peer->early.end(); ++e) {
+					int32_t e_gap = int32_t(e->first - peer->received);
+					if (e_gap > 0) continue;
+					size_t e_skip = size_t(-int64_t(e_gap));
+					if (e_skip < e->second.size()) {
+						c.recv_buffer.push(e->second.data() + e_skip, e->second.size() - e_skip);
+						peer->received += uint32_t(e->second.size() - e_skip);
+					}
+					peer->early_bytes -= e->second.size();
+					peer->early.erase(e);
+					more = true;
+					break;
+				}
+			}
+			got_data->emplace_back(peer);
+		}
+		peer->ack_due = true; //(also re-acks repeats, in case our ack was lost)
+		at += length;
+	}
+
+	if (flags & HasUnreliable) {
+		if (!peer->have_newest || int16_t(uint16_t(sequence - peer->newest)) > 0) {
+			peer->have_newest = true;
+			peer->newest = sequence;
+			c.unreliable_recv_buffer.push(at, size_t(end - at));
+			got_data->emplace_back(peer);
+		} else {
+			stats.unreliable_skipped += 1;
+		}
+	}
+}
+
+void DatagramTransport::poll_peers(
+	char const *where,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	bool accept_connects
+) {
+
+	//send anything queued since the last poll (so waiting below doesn't delay it):
+	transmit_delayed();
+	for (auto &peer : peers) {
+		if (peer.open && peer.connection) send_peer(peer);
+	}
+
+	{ //wait (until timeout, or until a timer is due) for packets:
+		double wait = timeout;
+		double next = next_timer();
+		if (next >= 0.0) {
+			double until = std::max(next - now(), 0.0);
+			if (wait < 0.0 || until < wait) wait = until;
+		}
+		fd_set read_fds;
+		FD_ZERO(&read_fds);
+		FD_SET(socket, &read_fds);
+		struct timeval tv;
+		tv.tv_sec = std::lround(std::floor(wait));
+		tv.tv_usec = std::lround((wait - std::floor(wait)) * 1e6);
+		select(int(socket) + 1, &read_fds, NULL, NULL, (wait < 0.0 ? NULL : &tv));
+	}
+
+	{ //read every packet waiting:
+		std::vector< DatagramPeer * > got_data;
+		static thread_local std::vector< char > buffer(64 * 1024);
+		while (true) {
+			struct sockaddr_storage from;
+			socklen_t from_size = sizeof(from);
+			#ifdef _WIN32
+			int ret = recvfrom(socket, buffer.data(), int(buffer.size()), 0, reinterpret_cast< struct sockaddr * >(&from), &from_size);
+			#else
+			ssize_t ret = recvfrom(socket, buffer.data(), buffer.size(), MSG_DONTWAIT, reinterpret_cast< struct sockaddr * >(&from), &from_size);
+			#endif
+			if (ret < 0) {
+				//(ECONNREFUSED reports an earlier send that went nowhere -- just a lost packet)
+				if (errno == EINTR || errno == ECONNREFUSED) continue;
+				break; //(EAGAIN: nothing more)
+			}
+			stats.packets_received += 1;
+			handle_packet(where, buffer.data(), size_t(ret), from, from_size, on_event, accept_connects, &got_data);
+		}
+		std::sort(got_data.begin(), got_data.end());
+		got_data.erase(std::unique(got_data.begin(), got_data.end()), got_data.end());
+		for (DatagramPeer *peer : got_data) {
+			if (peer->connection && on_event) on_event(&peer->connection, Connection::OnRecv);
+		}
+	}
+
+	{ //handshakes, timeouts, and closes:
+		double t = now();
+		for (auto &peer : peers) {
+			if (!peer.connection) {
+				if (peer.open) {
+					//closed on our side:
+					peer.open = false;
+					send_control(peer, 'X');
+				}
+			} else if (peer.open ? t - peer.heard_at > Timeout : t - peer.heard_at > Timeout && !accept_connects) {
+				std::cerr << "[" << where << "] " << (peer.open ? "peer went quiet" : "no answer to connect") << ", disconnecting." << std::endl;
+				peer.open = false;
+				peer.connection.close();
+				if (on_event) on_event(&peer.connection, Connection::OnClose);
+			} else if (!peer.open && t - peer.sent_at >= ConnectInterval) {
+				send_control(peer, 'C');
+				peer.sent_at = t;
+			}
+		}
+	}
+
+	//send responses (and acks):
+	for (auto &peer : peers) {
+		if (peer.open && peer.connection) send_peer(peer);
+	}
+	transmit_delayed();
+}
+
+//---------------------------------
+
+DatagramServer::DatagramServer(std::string const &port) {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	hints.ai_flags = AI_PASSIVE;
+
+	struct addrinfo *res = nullptr;
+	int ret = getaddrinfo(NULL, port.c_str(), &hints, &res);
+	if (ret != 0) {
+		throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
+	}
+
+	std::cout << "[DatagramServer::DatagramServer] binding to " << port << ":" << std::endl;
+	for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
+		try {
+			open_socket(info, true);
+			break;
+		} catch (std::system_error &e) {
+			std::cout << "\t(" << e.what() << ")" << std::endl;
+		}
+	}
+	freeaddrinfo(res);
+
+	if (socket == INVALID_SOCKET) {
+		throw std::runtime_error("Failed to bind to port " + port);
+	}
+}
+
+void DatagramServer::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
+	poll_peers("DatagramServer::poll", on_event, timeout, true);
+
+	//drop closed connections:
+	for (auto p = peers.begin(); p != peers.end(); /* later */) {
+		auto old = p;
+		++p;
+		if (!old->connection && !old->open) peers.erase(old);
+	}
+}
+
+DatagramClient::DatagramClient(std::string const &host, std::string const &port) : connection((peers.emplace_back(), peers.back().connection)) {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+
+	struct addrinfo *res = nullptr;
+	int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+	if (ret != 0) {
+		throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
+	}
+	if (!res) {
+		throw std::runtime_error("No addresses found for " + host + ":" + port);
+	}
+
+	std::cout << "[DatagramClient::DatagramClient] connecting to " << host << ":" << port << std::endl;
+	DatagramPeer &peer = peers.back();
+	try {
+		open_socket(res, false);
+	} catch (...) {
+		freeaddrinfo(res);
+		throw;
+	}
+	memcpy(&peer.address, res->ai_addr, res->ai_addrlen);
+	peer.address_size = socklen_t(res->ai_addrlen);
+	freeaddrinfo(res);
+
+	peer.id = std::random_device()();
+	peer.connection.datagram = true;
+	peer.connection.socket = socket;
+	peer.heard_at = now(); //(the connect attempt times out 'Timeout' from here)
+	peer.sent_at = peer.heard_at - ConnectInterval; //(so the first poll sends a connect right away)
+}
+
+void DatagramClient::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
+	poll_peers("DatagramClient::poll", on_event, timeout, false);
+}
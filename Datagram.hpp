@@ -0,0 +1,165 @@
+#pragma once
+
+/*
+ * Datagram (UDP) transport, as an alternative to Server/Client's TCP.
+ *
+ * DatagramServer and DatagramClient poll() just like Server and Client, with the
+ * same callbacks and the same Connection objects, but each connection carries
+ * two channels:
+ *  - reliable-ordered: bytes appended to send_buffer show up in the peer's
+ *    recv_buffer in order, exactly as over TCP (they are resent until acked);
+ *  - unreliable-sequenced: whole messages from Connection::send_unreliable()
+ *    show up in the peer's unreliable_recv_buffer -- or not at all, if lost or
+ *    overtaken by a newer packet -- so a lost pose update never holds up the
+ *    ones after it (TCP's head-of-line blocking).
+ *
+ * The unreliable channel expects Protocol frames (it splits packets between them).
+ *
+ * Packets (all little-endian):
+ *   [u32 magic][u8 kind][u32 connection id]
+ *   'C' connect     client -> server, repeated until answered (the client picks the id)
+ *   'A' accept      server -> client
+ *   'D' data        u32 reliable bytes received in order so far (the ack), u16 packet sequence,
+ *                   u8 flags (1 = reliable segment, 2 = unreliable messages, 4 = gaps),
+ *                   [u8 count, count x (u32 begin, u32 end) -- stream ranges received past the ack],
+ *                   [u32 stream offset, u16 length, bytes], [unreliable messages to the end]
+ *   'X' disconnect  (best effort; peers that go quiet for 'Timeout' are dropped anyway)
+ * Idle connections send empty 'D' packets now and then (and whenever an ack is due).
+ * Reliable bytes that aren't acked in time, or that fall in the gaps between what
+ * the peer reports having, are sent again.
+ *
+ * For testing (e.g. over loopback), 'conditions' drops and delays outgoing packets.
+ */
+
+#include "Connection.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+//Simulated network trouble, applied to outgoing packets:
+struct DatagramConditions {
+	float loss = 0.0f; //fraction of packets dropped
+	double latency = 0.0; //seconds each packet is held back
+	double jitter = 0.0; //up to this many more seconds (so packets may also arrive out of order)
+};
+
+//One connection over a datagram socket:
+struct DatagramPeer {
+	Connection connection; //(connection.datagram is set; its socket is the transport's)
+
+	//internals:
+	struct sockaddr_storage address;
+	socklen_t address_size = 0;
+	uint32_t id = 0;
+	bool open = false; //handshake done
+
+	//reliable channel, sending -- send_buffer holds the bytes not yet acked:
+	uint32_t acked = 0; //stream offset of send_buffer's first byte
+	size_t sent = 0; //bytes at the front of send_buffer sent at least once
+	double resend_at = 0.0; //when to resend the oldest unacked bytes, if nothing has been acked by then
+	std::vector< std::pair< uint32_t, uint32_t > > resend; //stream ranges [begin, end) to send again, first chance
+	double gaps_resent_at = -1.0; //last resend of the gaps the peer reported (at most once per round trip)...
+	uint32_t gaps_resent_ack = 0; //...and the ack they came with
+	uint32_t probe_begin = 0, probe_end = 0; //(round trip measurement) stream range whose ack is awaited...
+	double probe_sent = -1.0; //...and when it was sent (negative if none)
+	double rtt = 0.1; //smoothed round trip time (seconds)
+	double timeout = 0.25; //current resend timeout (seconds)
+
+	//reliable channel, receiving:
+	uint32_t received = 0; //stream bytes appended to recv_buffer
+	std::map< uint32_t, std::vector< char > > early; //segments that arrived past a gap, by stream offset
+	size_t early_bytes = 0;
+	bool ack_due = false;
+
+	//unreliable channel:
+	uint16_t sequence = 0; //of the last 'D' packet sent
+	bool have_newest = false;
+	uint16_t newest = 0; //newest sequence whose unreliable messages were delivered
+
+	double heard_at = 0.0; //last time a packet arrived
+	double sent_at = 0.0; //last time a packet went out
+};
+
+//Socket, timers, and packet handling shared by DatagramServer and DatagramClient:
+struct DatagramTransport {
+	DatagramTransport() = default;
+	~DatagramTransport();
+	DatagramTransport(DatagramTransport const &) = delete;
+	DatagramTransport &operator=(DatagramTransport const &) = delete;
+
+	DatagramConditions conditions;
+
+	//packet counts, for checking how a link behaves:
+	struct {
+		uint64_t packets_sent = 0;
+		uint64_t packets_received = 0;
+		uint64_t packets_dropped = 0; //by 'conditions'
+		uint64_t bytes_resent = 0; //reliable bytes sent more than once
+		uint64_t unreliable_skipped = 0; //packets whose unreliable messages arrived too late
+	} stats;
+
+	static constexpr size_t MaxPacket = 1200; //bytes per datagram (stays under typical MTUs)
+	static constexpr size_t Window = 64 * 1024; //reliable bytes in flight (and held past a gap)
+	static constexpr double KeepAlive = 0.5; //seconds of silence before sending an empty packet
+	static constexpr double Timeout = 5.0; //seconds of hearing nothing before a peer is dropped
+	static constexpr double ConnectInterval = 0.1; //seconds between connect attempts
+	static constexpr uint32_t MaxGaps = 8; //received ranges reported per packet
+
+	//internals:
+	SOCKET socket = INVALID_SOCKET;
+	std::list< DatagramPeer > peers;
+	std::mt19937 mt = std::mt19937(0x56554450);
+	struct Delayed {
+		struct sockaddr_storage address;
+		socklen_t address_size = 0;
+		std::vector< char > bytes;
+	};
+	std::multimap< double, Delayed > delayed; //(by send time) packets held back by 'conditions'
+
+	void open_socket(struct addrinfo const *info, bool bind_to_it);
+	//one poll: send what is waiting, wait up to 'timeout' for packets, handle them, send replies:
+	void poll_peers(
+		char const *where,
+		std::function< void(Connection *, Connection::Event event) > const &on_event,
+		double timeout,
+		bool accept_connects
+	);
+	void handle_packet(char const *where, char const *data, size_t size, struct sockaddr_storage const &from, socklen_t from_size,
+		std::function< void(Connection *, Connection::Event event) > const &on_event, bool accept_connects,
+		std::vector< DatagramPeer * > *got_data);
+	void send_peer(DatagramPeer &peer);
+	void send_control(DatagramPeer const &peer, char kind);
+	void transmit(struct sockaddr_storage const &to, socklen_t to_size, std::vector< char > const &bytes);
+	void transmit_now(struct sockaddr_storage const &to, socklen_t to_size, char const *data, size_t size);
+	void transmit_delayed(); //send held-back packets that are due
+	double next_timer() const; //time of the next resend/keep-alive/held-back packet (negative if none)
+	double now() const;
+};
+
+struct DatagramServer : DatagramTransport {
+	DatagramServer(std::string const &port); //pass the port number to listen on, as a string
+
+	//poll() updates the list of active connections and provides information to your callbacks:
+	void poll(
+		std::function< void(Connection *, Connection::Event event) > const &connection_event = nullptr,
+		double timeout = 0.0 //timeout (seconds; negative to wait for activity)
+	);
+};
+
+struct DatagramClient : DatagramTransport {
+	DatagramClient(std::string const &host, std::string const &port);
+
+	//poll() runs the connect handshake (OnOpen once it is answered) and then works like Client::poll():
+	// (anything sent before then waits in the connection's buffers)
+	void poll(
+		std::function< void(Connection *, Connection::Event event) > const &connection_event = nullptr,
+		double timeout = 0.0 //timeout (seconds; negative to wait for activity)
+	);
+
+	Connection &connection; //the only connection (it reads as closed once the server stops answering)
+};
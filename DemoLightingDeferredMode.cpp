@@ -24,13 +24,13 @@ Load< Scene > spheres_scene_deferred(LoadTagLate, []() -> Scene const * {
 	Scene *ret = new Scene(data_path("spheres.scene"), [](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = spheres_meshes->lookup(mesh_name);
 
-		scene.drawables.emplace_back(transform);
-		Scene::Drawable::Pipeline &pipeline = scene.drawables.back().pipeline;
+		Scene::Drawable::Pipeline &pipeline = scene.add_drawable(transform)->pipeline;
 		pipeline = basic_material_deferred_object_program_pipeline;
 		pipeline.vao = spheres_for_basic_material_deferred_object;
 		pipeline.type = mesh.type;
 		pipeline.start = mesh.start;
 		pipeline.count = mesh.count;
+		pipeline.index_type = mesh.index_type;
 
 		float roughness = 1.0f;
 		if (transform->name.substr(0, 9) == "Icosphere") {
@@ -283,7 +283,11 @@ void DemoLightingDeferredMode::draw(glm::uvec2 const &drawable_size) {
 		glUniformMatrix4fv(prog->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip * light_to_world));
 
 		if (mesh && mesh->count) {
-			glDrawArrays(mesh->type, mesh->start, mesh->count);
+			if (mesh->index_type != GL_NONE) {
+				glDrawElements(mesh->type, mesh->count, mesh->index_type, (GLbyte *)0 + mesh->start * sizeof(uint32_t));
+			} else {
+				glDrawArrays(mesh->type, mesh->start, mesh->count);
+			}
 		}
 	}
 
@@ -19,13 +19,13 @@ Load< Scene > spheres_scene_forward(LoadTagLate, []() -> Scene const * {
 	return new Scene(data_path("spheres.scene"), [](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = spheres_meshes->lookup(mesh_name);
 
-		scene.drawables.emplace_back(transform);
-		Scene::Drawable::Pipeline &pipeline = scene.drawables.back().pipeline;
+		Scene::Drawable::Pipeline &pipeline = scene.add_drawable(transform)->pipeline;
 		pipeline = basic_material_forward_program_pipeline;
 		pipeline.vao = spheres_for_basic_material_forward;
 		pipeline.type = mesh.type;
 		pipeline.start = mesh.start;
 		pipeline.count = mesh.count;
+		pipeline.index_type = mesh.index_type;
 
 		float roughness = 1.0f;
 		if (transform->name.substr(0, 9) == "Icosphere") {
@@ -21,13 +21,13 @@ Load< Scene > spheres_scene_multipass(LoadTagLate, []() -> Scene const * {
 	return new Scene(data_path("spheres.scene"), [](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = spheres_meshes->lookup(mesh_name);
 
-		scene.drawables.emplace_back(transform);
-		Scene::Drawable::Pipeline &pipeline = scene.drawables.back().pipeline;
+		Scene::Drawable::Pipeline &pipeline = scene.add_drawable(transform)->pipeline;
 		pipeline = basic_material_program_pipeline;
 		pipeline.vao = spheres_for_basic_material;
 		pipeline.type = mesh.type;
 		pipeline.start = mesh.start;
 		pipeline.count = mesh.count;
+		pipeline.index_type = mesh.index_type;
 
 		float roughness = 1.0f;
 		if (transform->name.substr(0, 9) == "Icosphere") {
@@ -45,9 +45,7 @@ DemoLightingMultipassMode::DemoLightingMultipassMode() {
 
 	//Set up camera-only scene:
 	{ //create a single camera:
-		camera_scene.transforms.emplace_back();
-		camera_scene.cameras.emplace_back(&camera_scene.transforms.back());
-		scene_camera = &camera_scene.cameras.back();
+		scene_camera = camera_scene.add_camera(camera_scene.add_transform());
 		scene_camera->fovy = 60.0f / 180.0f * 3.1415926f;
 		scene_camera->near = 0.01f;
 		//scene_camera->transform and scene_camera->aspect will be set in draw()
@@ -8,26 +8,72 @@
 #include "gl_errors.hpp"
 #include "check_fb.hpp"
 #include "CopyToScreenProgram.hpp"
+#include "collide.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
 
 #define PI 3.1415926f
 
+//Like MeshBuffer::make_vao_for_program, but also enables the per-instance attributes
+// (which draw_static_batches() points into 'instances'):
+static GLuint make_static_vao(MeshBuffer const &meshes, GLuint program, GLuint instances) {
+  GLuint vao = 0;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  std::pair< char const *, Attrib const * > per_vertex[] = {
+    {"Position", &meshes.Position},
+    {"Normal", &meshes.Normal},
+    {"Color", &meshes.Color},
+    {"TexCoord", &meshes.TexCoord}
+  };
+  for (auto const &name_attrib : per_vertex) {
+    GLint location = glGetAttribLocation(program, name_attrib.first);
+    if (location == -1 || name_attrib.second->buffer == 0) continue;
+    name_attrib.second->VertexAttribPointer(location);
+    glEnableVertexAttribArray(location);
+  }
+
+  //mat4 attributes take four consecutive locations:
+  std::pair< char const *, GLuint > per_instance[] = {
+    {"InstanceToWorld", 4},
+    {"InstanceColor", 1},
+    {"InstanceSmoothId", 1}
+  };
+  glBindBuffer(GL_ARRAY_BUFFER, instances);
+  for (auto const &name_slots : per_instance) {
+    GLint location = glGetAttribLocation(program, name_slots.first);
+    if (location == -1) continue;
+    for (GLuint i = 0; i < name_slots.second; ++i) {
+      glEnableVertexAttribArray(location + i);
+      glVertexAttribDivisor(location + i, 1);
+    }
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  //indexed meshes draw from the element buffer:
+  if (meshes.index_buffer != 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshes.index_buffer);
+
+  glBindVertexArray(0);
+  GL_ERRORS();
+  return vao;
+}
+
 void GameLevel::init_meshes(std::string level_name) {
   level_name.insert(level_name.size(), ".pnct");
 
   std::cout << "Loading " << level_name << std::endl;
-  meshes = new MeshBuffer(level_name);
+  //(vertex data is uploaded by upload(), unless headless)
+  meshes = new MeshBuffer(level_name, false);
 
-  std::cout << "Level meshes loaded" << std::endl;
-
-  vao_color = meshes->make_vao_for_program(flat_program->program);
-  vao_outline = meshes->make_vao_for_program(outline_program_0->program);
-
-  std::cout << "VAOs created" << std::endl;
+  std::cout << "Level meshes loaded (" << meshes->positions.size() << " vertices, " << meshes->vertex_data.size_bytes() << " bytes; "
+            << meshes->indices.size() << " indices, " << meshes->indices.size_bytes() << " bytes)" << std::endl;
 
   //collidable objects:
 
@@ -78,9 +124,17 @@ struct FB {
   GLuint color_tex = 0;
   //depth buffer is shared between objects + lights pass:
   GLuint depth_rb = 0;
+  //..or, for the compact G-buffer, a texture that positions are rebuilt from:
+  GLuint depth_tex = 0;
 
   GLuint fb_color = 0;
   GLuint fb_outline = 0;
+  //color, normal, and position attached at once, for the single-pass path:
+  GLuint fb_gbuffer = 0;
+
+  //compact G-buffer: normal_tex holds octahedral normal + smooth id as 10:10:10:2,
+  // there is no position_tex, and fb_gbuffer renders into depth_tex:
+  bool compact = false;
 
   GLuint normal_tex_main = 0;
   GLuint position_tex_main = 0;
@@ -90,39 +144,92 @@ struct FB {
   //depth buffer is shared between objects + lights pass:
   GLuint depth_rb_main = 0;
 
+  GLuint depth_tex_main = 0;
+
   GLuint fb_color_main = 0;
   GLuint fb_outline_main = 0;
+  GLuint fb_gbuffer_main = 0;
+  GLuint fb_gbuffer_compact_main = 0;
+  bool compact_main = false;
 
   GLuint color_tex_sc = 0;
   GLuint normal_tex_sc = 0;
   GLuint position_tex_sc = 0;
   GLuint depth_rb_sc = 0;
+  GLuint depth_tex_sc = 0;
 
   GLuint fb_color_sc = 0;
   GLuint fb_outline_sc = 0;
+  GLuint fb_gbuffer_sc = 0;
+  GLuint fb_gbuffer_compact_sc = 0;
   GLuint fb_output_sc = 0;
+  bool compact_sc = false;
+  bool ready_sc = false;
+
+  //attach color/normal/position (in FlatProgram's output order) and depth to one framebuffer:
+  static void init_gbuffer(GLuint &fb, GLuint color, GLuint normal, GLuint position, GLuint depth) {
+    if (fb != 0) return;
+    glGenFramebuffers(1, &fb);
+    //set up framebuffer: (don't need to do when resizing)
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, color, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_RECTANGLE, normal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_RECTANGLE, position, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    GLenum bufs[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    glDrawBuffers(3, bufs);
+    check_fb();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  //same, for the compact layout (position output is dropped; depth is a texture):
+  static void init_gbuffer_compact(GLuint &fb, GLuint color, GLuint normal, GLuint depth) {
+    if (fb != 0) return;
+    glGenFramebuffers(1, &fb);
+    //set up framebuffer: (don't need to do when resizing)
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, color, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_RECTANGLE, normal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_RECTANGLE, depth, 0);
+    GLenum bufs[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_NONE};
+    glDrawBuffers(3, bufs);
+    check_fb();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  //helper to allocate a texture:
+  // (targets a layout doesn't use are shrunk to 1x1 rather than deleted, so framebuffer attachments stay valid)
+  static void alloc_recttex(GLuint &tex, GLenum internal_format, glm::uvec2 const &tex_size,
+    GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE) {
+    if (tex == 0) glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_RECTANGLE, tex);
+    glTexImage2D(GL_TEXTURE_RECTANGLE, 0, internal_format, tex_size.x, tex_size.y, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+  }
 
   glm::uvec2 size = glm::uvec2(0);
   glm::uvec2 size_sc = glm::uvec2(640, 480);
 
-  void init_sc() {
-    auto alloc_recttex = [&] (GLuint &tex, GLenum internal_format) {
-      if (tex == 0) glGenTextures(1, &tex);
-      glBindTexture(GL_TEXTURE_RECTANGLE, tex);
-      glTexImage2D(GL_TEXTURE_RECTANGLE, 0, internal_format, size_sc.x, size_sc.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glBindTexture(GL_TEXTURE_RECTANGLE, 0);
-    };
-    //set up normal_tex as a 16-bit floating point RGBA texture:
-    alloc_recttex(normal_tex_sc, GL_RGBA32F);
-    alloc_recttex(position_tex_sc, GL_RGBA32F);
+  void init_sc(bool compact_) {
+    if (ready_sc && compact_ == compact_sc) return;
+    ready_sc = true;
+    compact_sc = compact_;
+
+    glm::uvec2 unused = glm::uvec2(1);
+    //set up normal_tex as a 32-bit floating point RGBA texture (or packed 10:10:10:2 when compact):
+    alloc_recttex(normal_tex_sc, compact_sc ? GL_RGB10_A2 : GL_RGBA32F, size_sc);
+    alloc_recttex(position_tex_sc, GL_RGBA32F, compact_sc ? unused : size_sc);
     //set up output_tex as an 8-bit fixed point RGBA texture:
-    alloc_recttex(color_tex_sc, GL_RGBA8);
+    alloc_recttex(color_tex_sc, GL_RGBA8, size_sc);
+    //set up depth_tex as a 24-bit fixed-point depth texture (only used when compact):
+    alloc_recttex(depth_tex_sc, GL_DEPTH_COMPONENT24, compact_sc ? size_sc : unused, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
     if (depth_rb_sc == 0) glGenRenderbuffers(1, &depth_rb_sc);
     //set up depth_rb as a 24-bit fixed-point depth buffer:
+    glm::uvec2 rb_size = (compact_sc ? unused : size_sc);
     glBindRenderbuffer(GL_RENDERBUFFER, depth_rb_sc);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size_sc.x, size_sc.y);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, rb_size.x, rb_size.y);
     glBindRenderbuffer(GL_RENDERBUFFER, 0);
     GL_ERRORS();
 
@@ -152,6 +259,9 @@ struct FB {
       glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
+    init_gbuffer(fb_gbuffer_sc, color_tex_sc, normal_tex_sc, position_tex_sc, depth_rb_sc);
+    init_gbuffer_compact(fb_gbuffer_compact_sc, color_tex_sc, normal_tex_sc, depth_tex_sc);
+
     GL_ERRORS();
     // The output framebuffer is used to hold the flattened textures when rendering
     // the orthographic windows.
@@ -166,37 +276,33 @@ struct FB {
     GL_ERRORS();
   }
 
-  void resize_main(glm::uvec2 const &drawable_size) {
-    if (drawable_size == size) return;
+  void resize_main(glm::uvec2 const &drawable_size, bool compact_) {
+    if (drawable_size == size && compact_ == compact_main) return;
     size = drawable_size;
+    compact_main = compact_;
 
     std::cout << "Resizing draw textures and framebuffers!" << std::endl;
 
-    //helper to allocate a texture:
-
-    auto alloc_recttex = [&] (GLuint &tex, GLenum internal_format) {
-      if (tex == 0) glGenTextures(1, &tex);
-      glBindTexture(GL_TEXTURE_RECTANGLE, tex);
-      glTexImage2D(GL_TEXTURE_RECTANGLE, 0, internal_format, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glBindTexture(GL_TEXTURE_RECTANGLE, 0);
-    };
+    glm::uvec2 unused = glm::uvec2(1);
 
-    //set up normal_tex as a 16-bit floating point RGBA texture:
-    alloc_recttex(normal_tex_main, GL_RGBA32F);
-    alloc_recttex(position_tex_main, GL_RGBA32F);
+    //set up normal_tex as a 32-bit floating point RGBA texture (or packed 10:10:10:2 when compact):
+    alloc_recttex(normal_tex_main, compact_main ? GL_RGB10_A2 : GL_RGBA32F, size);
+    alloc_recttex(position_tex_main, GL_RGBA32F, compact_main ? unused : size);
 
     //set up output_tex as an 8-bit fixed point RGBA texture:
-    alloc_recttex(color_tex_main, GL_RGBA8);
+    alloc_recttex(color_tex_main, GL_RGBA8, size);
+
+    //set up depth_tex as a 24-bit fixed-point depth texture (only used when compact):
+    alloc_recttex(depth_tex_main, GL_DEPTH_COMPONENT24, compact_main ? size : unused, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
 
     GL_ERRORS();
 
     //if depth_rb does not have a name, name it:
     if (depth_rb_main == 0) glGenRenderbuffers(1, &depth_rb_main);
     //set up depth_rb as a 24-bit fixed-point depth buffer:
+    glm::uvec2 rb_size = (compact_main ? unused : size);
     glBindRenderbuffer(GL_RENDERBUFFER, depth_rb_main);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.x, size.y);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, rb_size.x, rb_size.y);
     glBindRenderbuffer(GL_RENDERBUFFER, 0);
     GL_ERRORS();
 
@@ -227,6 +333,9 @@ struct FB {
       glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
+    init_gbuffer(fb_gbuffer_main, color_tex_main, normal_tex_main, position_tex_main, depth_rb_main);
+    init_gbuffer_compact(fb_gbuffer_compact_main, color_tex_main, normal_tex_main, depth_tex_main);
+
     GL_ERRORS();
   }
 
@@ -235,8 +344,11 @@ struct FB {
     position_tex = position_tex_main;
     color_tex = color_tex_main;
     depth_rb = depth_rb_main;
+    depth_tex = depth_tex_main;
     fb_color = fb_color_main;
     fb_outline = fb_outline_main;
+    compact = compact_main;
+    fb_gbuffer = (compact ? fb_gbuffer_compact_main : fb_gbuffer_main);
   }
 
   void set_sc() {
@@ -244,24 +356,60 @@ struct FB {
     position_tex = position_tex_sc;
     color_tex = color_tex_sc;
     depth_rb = depth_rb_sc;
+    depth_tex = depth_tex_sc;
     fb_color = fb_color_sc;
     fb_outline = fb_outline_sc;
+    compact = compact_sc;
+    fb_gbuffer = (compact ? fb_gbuffer_compact_sc : fb_gbuffer_sc);
 
   }
 } fb;
 
-GameLevel::GameLevel(std::string level_name) {
+GameLevel::RenderOptions GameLevel::render_options;
+
+GameLevel::GameLevel(std::string level_name, bool headless_, bool defer_upload) : headless(headless_) {
 
   init_meshes(level_name);
 
   level_name.insert(level_name.size(), ".scene");
 
   goals.reserve(2);
-  auto load_fn = [this](Scene &, Transform *transform, std::string const &mesh_name){
+  std::unordered_map< Mesh const *, size_t > mesh_to_batch;
+  auto load_fn = [this, &mesh_to_batch](Scene &, Transform *transform, std::string const &mesh_name){
     Mesh const *mesh = &meshes->lookup(mesh_name);
 
-    drawables.emplace_back(transform);
-    Drawable::Pipeline &pipeline = drawables.back().pipeline;
+    std::string const &name = transform->name;
+    if (name.substr(0, 4) != "Move" && name.substr(0, 5) != "Goal1" && name.substr(0, 5) != "Goal2"
+     && name.substr(0, 5) != "Body1" && name.substr(0, 5) != "Body2") {
+      //static geometry: collide with it, draw it instanced:
+      auto f = mesh_to_collider.find(mesh);
+      if (f == mesh_to_collider.end()) {
+        mesh_colliders.emplace_back(transform, *mesh, *meshes);
+      } else {
+        mesh_colliders.emplace_back(transform, *f->second, *meshes);
+      }
+
+      auto b = mesh_to_batch.find(mesh);
+      if (b == mesh_to_batch.end()) {
+        b = mesh_to_batch.emplace(mesh, static_batches.size()).first;
+        static_batches.emplace_back();
+        static_batches.back().mesh = mesh;
+      }
+      StaticBatch &batch = static_batches[b->second];
+      batch.transforms.emplace_back(transform);
+      //shaded like a vertex-colored drawable (FlatProgram::USE_VX_COLORS) with the default pipeline's smooth id:
+      batch.instances.emplace_back();
+      batch.instances.back().color = glm::vec4(1.0f);
+      batch.instances.back().smooth_id = flat_program_pipeline.smooth_id;
+      return;
+    }
+
+    Drawable *drawable = add_drawable(transform);
+    Drawable::Pipeline &pipeline = drawable->pipeline;
+
+    //bounds for frustum culling:
+    drawable->min = mesh->min;
+    drawable->max = mesh->max;
 
     //set up drawable to draw mesh from buffer:
     pipeline = flat_program_pipeline;
@@ -269,11 +417,20 @@ GameLevel::GameLevel(std::string level_name) {
     pipeline.type = mesh->type;
     pipeline.start = mesh->start;
     pipeline.count = mesh->count;
+    pipeline.index_type = mesh->index_type;
+
+    //everything that gets here can change at runtime; standpoints watch these for changes:
+    dynamics.emplace_back();
+    Dynamic &dynamic = dynamics.back();
+    dynamic.drawable = drawable;
+    dynamic.center = 0.5f * (mesh->min + mesh->max);
+    dynamic.radius = 0.5f * glm::length(mesh->max - mesh->min);
 
     if (transform->name.substr(0, 4) == "Move") {
       size_t name_len = transform->name.size();
       if (transform->name.substr(name_len-7, 6) == "Screen") {
         std::cout << "Screen detected: " << transform->name << std::endl;
+        dynamic.screen = int(screens.size());
         screens.emplace_back(transform, &pipeline);
         pipeline.set_uniforms = [](){
           glUniform1ui(flat_program->USE_TEX_uint, FlatProgram::USE_TEX);
@@ -285,6 +442,7 @@ GameLevel::GameLevel(std::string level_name) {
         Movable &data = movable_data.back();
         size_t mi = movable_data.size() - 1;
         data.index = mi;
+        dynamic.movable = int(mi);
         pipeline.set_uniforms = [&, mi](){
           glUniform1ui(flat_program->USE_TEX_uint, FlatProgram::USE_COL);
           glUniform4fv(flat_program->UNIFORM_COLOR_vec4, 1, glm::value_ptr(movable_data[mi].color));
@@ -336,22 +494,6 @@ GameLevel::GameLevel(std::string level_name) {
         glUniform1ui(flat_program->USE_TEX_uint, FlatProgram::USE_COL);
         glUniform4fv(flat_program->UNIFORM_COLOR_vec4, 1, glm::value_ptr(tmp_color));
       };
-    } else {
-      auto f = mesh_to_collider.find(mesh);
-      if (f == mesh_to_collider.end()) {
-        mesh_colliders.emplace_back(transform, *mesh, *meshes);
-      } else {
-        mesh_colliders.emplace_back(transform, *f->second, *meshes);
-      }
-
-      pipeline.set_uniforms = [](){
-        glUniform1ui(flat_program->USE_TEX_uint, FlatProgram::USE_VX_COLORS);
-      };
-      // if (f != mesh_to_collider.end()) {
-      //   mesh_colliders.emplace_back(transform, *f->second, *meshes);
-      // } else {
-      //   decorations++;
-      // }
     }
   };
   //Load scene (using Scene::load function), building proper associations as needed:
@@ -365,7 +507,7 @@ GameLevel::GameLevel(std::string level_name) {
       std::string &xf_name = m.transform->name;
       if (oc.transform->name.substr(0, xf_name.size()) == xf_name) {
         std::cout << "Matched " << xf_name << " to " << oc.transform->name << std::endl;
-        standpoints.emplace_back(&oc, &m);
+        standpoints.emplace_back(&oc, &m, false); //(upload() makes its texture)
         Standpoint &stpt = standpoints.back();
         std::list< Light >::iterator lit = lights.begin();
         while (lit != lights.end()) {
@@ -373,7 +515,7 @@ GameLevel::GameLevel(std::string level_name) {
           if (mp_name.substr(0, mp_name.size()-9) == oc.transform->name) {
             std::cout << "Matched " << mp_name << " to " << oc.transform->name << std::endl;
             stpt.move_pos.emplace_back(&(*lit));
-            lights.erase(lit++);
+            lit = erase_light(lit);
           } else {
             lit++;
           }
@@ -403,14 +545,203 @@ GameLevel::GameLevel(std::string level_name) {
     }
   }
 
-  fb.init_sc();
+  //move positions were pulled out of 'lights' above, so rebuild the packed arrays now (rather than on the first frame):
+  pack();
+
+  if (!headless) build_static_instances();
+
+  build_collision();
+
+  if (!headless && !defer_upload) upload();
+
+}
+
+void GameLevel::upload() {
+  assert(!headless && !uploaded);
+
+  meshes->upload_buffer();
+  std::cout << "Mesh buffers: " << meshes->gpu_bytes << " bytes on the GPU" << std::endl;
+
+  vao_color = meshes->make_vao_for_program(flat_program->program);
+  vao_outline = meshes->make_vao_for_program(outline_program_0->program);
+
+  glGenBuffers(1, &static_instance_buffer);
+  glGenBuffers(1, &static_visible_buffer);
+  //all of the static instances, batch after batch; views with nothing culled draw straight from this:
+  glBindBuffer(GL_ARRAY_BUFFER, static_instance_buffer);
+  glBufferData(GL_ARRAY_BUFFER, static_instance_count * sizeof(StaticInstance), nullptr, GL_STATIC_DRAW);
+  GLintptr offset = 0;
+  for (auto const &batch : static_batches) {
+    glBufferSubData(GL_ARRAY_BUFFER, offset, batch.instances.size() * sizeof(StaticInstance), batch.instances.data());
+    offset += batch.instances.size() * sizeof(StaticInstance);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  static_draw_buffer = static_instance_buffer;
+  static_visible_uploaded.clear();
+  vao_static_color = make_static_vao(*meshes, flat_instanced_program->program, static_instance_buffer);
+  vao_static_outline = make_static_vao(*meshes, outline_instanced_program_0->program, static_instance_buffer);
+
+  std::cout << "VAOs created" << std::endl;
 
+  //the scene was loaded before there were VAOs or textures to point at:
+  for (auto &drawable : drawables) {
+    drawable.pipeline.vao = vao_color;
+  }
+  for (auto &stpt : standpoints) {
+    stpt.create_texture();
+  }
+  for (auto &sc : screens) {
+    if (sc.stpt) sc.set_standpoint(sc.stpt);
+  }
+
+  fb.init_sc(render_options.compact);
+
+  uploaded = true;
 }
 
 GameLevel::~GameLevel() {
+  if (uploaded) {
+    glDeleteVertexArrays(1, &vao_static_color);
+    glDeleteVertexArrays(1, &vao_static_outline);
+    glDeleteBuffers(1, &static_instance_buffer);
+    glDeleteBuffers(1, &static_visible_buffer);
+  }
   delete meshes;
 }
 
+//helper: world-space triangles of a collider, written to out[first .. first + collider.mesh->count/3):
+static void transform_collider(GameLevel::MeshCollider const &collider, glm::mat4x3 const &collider_to_world, CollisionTriangles *out, size_t first) {
+  for (GLuint v = 0; v + 2 < collider.mesh->count; v += 3) {
+    out->set(first++, CollisionTriangle(
+      collider_to_world * glm::vec4(collider.buffer->position(*collider.mesh, v+0), 1.0f),
+      collider_to_world * glm::vec4(collider.buffer->position(*collider.mesh, v+1), 1.0f),
+      collider_to_world * glm::vec4(collider.buffer->position(*collider.mesh, v+2), 1.0f)
+    ));
+  }
+}
+
+void GameLevel::Collision::update_movable(GameLevel const &level, uint32_t m) {
+  MeshCollider const &collider = level.mesh_colliders[movables[m]];
+  movable_versions[m] = collider.transform->cache.version;
+  transform_collider(collider, collider.transform->cache.local_to_world, &movable_triangles, movable_first[m]);
+
+  movable_min[m] = glm::vec3( std::numeric_limits< float >::infinity());
+  movable_max[m] = glm::vec3(-std::numeric_limits< float >::infinity());
+  for (uint32_t i = movable_first[m]; i < movable_first[m+1]; ++i) {
+    movable_min[m] = glm::min(movable_min[m], movable_triangles.min(i));
+    movable_max[m] = glm::max(movable_max[m], movable_triangles.max(i));
+  }
+  ++stats.movable_updates;
+}
+
+void GameLevel::build_collision() {
+  collision = Collision();
+
+  for (uint32_t i = 0; i < mesh_colliders.size(); ++i) {
+    MeshCollider const &collider = mesh_colliders[i];
+    assert(collider.mesh->type == GL_TRIANGLES); //only have code for TRIANGLES not other primitive types
+
+    if (collider.movable_index >= 0) {
+      collision.movables.emplace_back(i);
+      continue;
+    }
+
+    size_t first = collision.static_triangles.size();
+    collision.static_triangles.resize(first + collider.mesh->count / 3);
+    transform_collider(collider, collider.transform->make_local_to_world(), &collision.static_triangles, first);
+  }
+
+  std::vector< glm::vec3 > mins, maxs;
+  mins.reserve(collision.static_triangles.size());
+  maxs.reserve(collision.static_triangles.size());
+  for (uint32_t i = 0; i < collision.static_triangles.size(); ++i) {
+    mins.emplace_back(collision.static_triangles.min(i));
+    maxs.emplace_back(collision.static_triangles.max(i));
+  }
+  //leaves of 8 fill one AVX batch:
+  collision.static_tree.build(mins, maxs, 8);
+
+  { //put triangles in leaf order, so leaves can be tested as [first, first+count) ranges:
+    CollisionTriangles unordered;
+    std::swap(unordered, collision.static_triangles);
+    collision.static_triangles.resize(collision.static_tree.items.size());
+    for (uint32_t i = 0; i < collision.static_tree.items.size(); ++i) {
+      uint32_t &item = collision.static_tree.items[i];
+      collision.static_triangles.set(i, unordered[item]);
+      item = i;
+    }
+  }
+
+  uint32_t movable_count = uint32_t(collision.movables.size());
+  collision.movable_first.assign(1, 0);
+  for (uint32_t m = 0; m < movable_count; ++m) {
+    collision.movable_first.emplace_back(collision.movable_first.back() + mesh_colliders[collision.movables[m]].mesh->count / 3);
+  }
+  collision.movable_triangles.resize(collision.movable_first.back());
+  collision.movable_versions.assign(movable_count, 0);
+  collision.movable_min.resize(movable_count);
+  collision.movable_max.resize(movable_count);
+  for (uint32_t m = 0; m < movable_count; ++m) {
+    mesh_colliders[collision.movables[m]].transform->update_cache();
+    collision.update_movable(*this, m);
+  }
+  //one collider per leaf, so leaf bounds are exactly the collider bounds:
+  collision.movable_tree.build(collision.movable_min, collision.movable_max, 1);
+
+  std::cout << "Collision: " << collision.static_triangles.size() << " static triangles ("
+            << collision.static_tree.nodes.size() << " nodes), "
+            << movable_count << " movable colliders (" << collision.movable_triangles.size() << " triangles)" << std::endl;
+}
+
+bool GameLevel::sweep_sphere(glm::vec3 const &from, glm::vec3 const &to, float radius, SweptSphereHit *hit) {
+  assert(hit);
+  bool collided = false;
+
+  glm::vec3 sphere_min = glm::min(from, to) - glm::vec3(radius);
+  glm::vec3 sphere_max = glm::max(from, to) + glm::vec3(radius);
+
+  { //re-transform movables that moved since the last sweep, and refit their tree:
+    bool moved = false;
+    for (uint32_t m = 0; m < collision.movables.size(); ++m) {
+      Transform const *transform = mesh_colliders[collision.movables[m]].transform;
+      transform->update_cache();
+      if (transform->cache.version == collision.movable_versions[m]) continue;
+      collision.update_movable(*this, m);
+      moved = true;
+    }
+    if (moved) collision.movable_tree.refit(collision.movable_min, collision.movable_max);
+  }
+
+  //'movable_index' follows the earliest hit: a movable sets it, and static geometry that is
+  // touched even earlier clears it again (so the player only rides what it actually landed on):
+  collision.movable_tree.query(sphere_min, sphere_max, [&](uint32_t m) {
+    if (collide_swept_sphere_vs_triangles(
+      from, to, radius,
+      collision.movable_triangles, collision.movable_first[m], collision.movable_first[m+1],
+      &hit->t, &hit->at, &hit->out, &hit->surface,
+      nullptr, &collision.stats.triangles_tested
+    )) {
+      collided = true;
+      hit->movable_index = mesh_colliders[collision.movables[m]].movable_index;
+    }
+  });
+
+  collision.static_tree.query_leaves(sphere_min, sphere_max, [&](uint32_t first, uint32_t count) {
+    if (collide_swept_sphere_vs_triangles(
+      from, to, radius,
+      collision.static_triangles, first, first + count,
+      &hit->t, &hit->at, &hit->out, &hit->surface,
+      nullptr, &collision.stats.triangles_tested
+    )) {
+      collided = true;
+      hit->movable_index = -1;
+    }
+  });
+
+  ++collision.stats.sweeps;
+  return collided;
+}
+
 bool GameLevel::detect_lose() {
   //std::cout << body_P1_transform->position.z << " "<< body_P2_transform->position.z << std::endl;
   return (body_P1_transform->position.z < die_y || body_P2_transform->position.z < die_y);
@@ -459,8 +790,19 @@ void GameLevel::draw(
   glm::mat4 const &world_to_clip
 ) {
 
+  //bring all world matrices up to date once, so the passes below only read them:
+  update_transforms();
 
-  screens_standpoints_texture_update(eye);
+  //Scene::draw counters cover everything drawn this frame (standpoint textures included):
+  draw_stats = DrawStats();
+  static_stats = StaticStats();
+  view_stats.clear();
+
+  //(re-)allocates the screen G-buffer if render_options.compact changed:
+  fb.init_sc(render_options.compact);
+
+  frame += 1;
+  screens_standpoints_texture_update(eye, world_to_clip);
   if (first_draw) {
     for (auto &stpt : standpoints) {
       //stpt.resize_texture(drawable_size);
@@ -469,76 +811,231 @@ void GameLevel::draw(
     first_draw = false;
   } else {
     for (auto &sc : screens) {
-      if (sc.draw && !sc.stpt->updated) {
-        //sc.stpt->resize_texture(drawable_size);
-        sc.stpt->update_texture(this);
+      if (!sc.draw || sc.stpt->updated) continue;
+      Standpoint &stpt = *sc.stpt;
+
+      //only re-render if something the ortho camera can see changed:
+      uint64_t signature = stpt.make_signature(this);
+      if (signature == stpt.signature) {
+        stpt.stats.reused += 1;
+        continue;
+      }
+      //screens that are only partly in view get refreshed at a lower rate:
+      if (!sc.in_view && frame - stpt.rendered_frame < Standpoint::partial_interval) {
+        stpt.stats.throttled += 1;
+        continue;
       }
+      //sc.stpt->resize_texture(drawable_size);
+      stpt.update_texture(this);
     }
   }
 
-  fb.resize_main(drawable_size);
+  if (render_options.diff_compact) {
+    render_options.diff_compact = false;
+    diff_compact(drawable_size, eye, world_to_clip);
+  }
+
+  fb.resize_main(drawable_size, render_options.compact);
   fb.set_main();
   glViewport(0, 0, drawable_size.x, drawable_size.y);
   draw_fb(eye, world_to_clip, 0);
 
 }
 
+void GameLevel::diff_compact(
+  glm::uvec2 const &drawable_size,
+  glm::vec3 const &eye,
+  glm::mat4 const &world_to_clip
+) {
+  //render the main view with both G-buffer layouts into an offscreen target:
+  GLuint tex = 0;
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, drawable_size.x, drawable_size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  GLuint out_fb = 0;
+  glGenFramebuffers(1, &out_fb);
+  glBindFramebuffer(GL_FRAMEBUFFER, out_fb);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  check_fb();
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  std::vector< glm::u8vec4 > images[2];
+  for (uint32_t i = 0; i < 2; ++i) {
+    fb.resize_main(drawable_size, i == 1);
+    fb.set_main();
+    glViewport(0, 0, drawable_size.x, drawable_size.y);
+    draw_fb(eye, world_to_clip, out_fb);
+
+    images[i].resize(drawable_size.x * drawable_size.y);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, out_fb);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, drawable_size.x, drawable_size.y, GL_RGBA, GL_UNSIGNED_BYTE, images[i].data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  }
+
+  glDeleteFramebuffers(1, &out_fb);
+  glDeleteTextures(1, &tex);
+  GL_ERRORS();
+
+  //compare: (small differences are quantization; a differing pixel is usually an outline that moved)
+  uint32_t differ = 0;
+  int max_diff = 0;
+  for (size_t p = 0; p < images[0].size(); ++p) {
+    int d = 0;
+    for (uint32_t c = 0; c < 4; ++c) {
+      d = std::max(d, std::abs(int(images[0][p][c]) - int(images[1][p][c])));
+    }
+    if (d > 2) differ += 1;
+    max_diff = std::max(max_diff, d);
+  }
+  float full_bytes = float(drawable_size.x * drawable_size.y) * (16 + 16 + 4);
+  float compact_bytes = float(drawable_size.x * drawable_size.y) * (4 + 4);
+  std::cout << "G-buffer diff (full vs. compact, " << drawable_size.x << "x" << drawable_size.y << "): "
+            << differ << " pixels differ (" << (100.0f * differ / std::max< size_t >(1, images[0].size())) << "%), "
+            << "max channel difference " << max_diff << "; "
+            << "normal+position+depth " << (full_bytes / (1024.0f * 1024.0f)) << " MiB vs. "
+            << (compact_bytes / (1024.0f * 1024.0f)) << " MiB" << std::endl;
+}
+
 void GameLevel::draw_fb(
   glm::vec3 const &eye,
   glm::mat4 const &world_to_clip,
   GLuint output_fb
 ) {
   GL_ERRORS();
-  // Color drawing
 
-  glBindFramebuffer(GL_FRAMEBUFFER, fb.fb_color);
+  uint32_t static_culled_before = static_stats.culled;
+
   GLfloat bg_color[4] = {0.93f, 0.93f, 1.0f, 1.0f};
-  glClearBufferfv(GL_COLOR, 0, bg_color);
-  glClear(GL_DEPTH_BUFFER_BIT);
+  GLfloat bg_normal[4] = {0.0f, 0.0f, 0.0f, 0.5f};
+  GLfloat bg_pos[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  //compact: smooth id 0.5 (as above) and w == 0 for "no normal":
+  GLfloat bg_normal_compact[4] = {0.0f, 0.0f, 1.0f / 1023.0f, 0.0f};
+
+  //the compact layout only exists as a single-pass G-buffer:
+  if (render_options.single_pass || fb.compact) {
+    // Color, normals, and positions in one geometry pass:
+    glBindFramebuffer(GL_FRAMEBUFFER, fb.fb_gbuffer);
+    glClearBufferfv(GL_COLOR, 0, bg_color);
+    if (fb.compact) {
+      glClearBufferfv(GL_COLOR, 1, bg_normal_compact);
+    } else {
+      glClearBufferfv(GL_COLOR, 1, bg_normal);
+      glClearBufferfv(GL_COLOR, 2, bg_pos);
+    }
+    glClear(GL_DEPTH_BUFFER_BIT);
 
-  glDisable(GL_BLEND);
-  glEnable(GL_DEPTH_TEST);
-  glDepthFunc(GL_LEQUAL);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
 
-  Scene::draw(world_to_clip);
+    //tell the geometry programs which normal encoding to write:
+    glUseProgram(flat_program->program);
+    glUniform1ui(flat_program->COMPACT_GBUFFER_uint, fb.compact ? 1 : 0);
+    glUseProgram(flat_instanced_program->program);
+    glUniform1ui(flat_instanced_program->COMPACT_GBUFFER_uint, fb.compact ? 1 : 0);
 
-  GL_ERRORS();
+    //flat_program (and its instanced variant) write the outline inputs to locations 1 and 2:
+    Scene::draw(world_to_clip);
 
-  // Draw the outlines
-  glBindFramebuffer(GL_FRAMEBUFFER, fb.fb_outline);
-  GLfloat bg_normal[4] = {0.0f, 0.0f, 0.0f, 0.5f};
-  glClearBufferfv(GL_COLOR, 0, bg_normal);
-  GLfloat bg_pos[4] = {0.0f, 0.0f, 0.0f, 0.0f};
-  glClearBufferfv(GL_COLOR, 1, bg_pos);
+    upload_static_instances(world_to_clip);
+    glUseProgram(flat_instanced_program->program);
+    glUniformMatrix4fv(flat_instanced_program->WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+    glBindVertexArray(vao_static_color);
+    draw_static_batches(flat_instanced_program->InstanceToWorld_mat4, flat_instanced_program->InstanceColor_vec4, flat_instanced_program->InstanceSmoothId_float);
 
-  glDisable(GL_BLEND);
-  glEnable(GL_DEPTH_TEST);
-  glDepthFunc(GL_LEQUAL);
+  } else {
+    // Color drawing
+    glBindFramebuffer(GL_FRAMEBUFFER, fb.fb_color);
+    glClearBufferfv(GL_COLOR, 0, bg_color);
+    glClear(GL_DEPTH_BUFFER_BIT);
 
-  glUseProgram(outline_program_0->program);
-  glBindVertexArray(vao_outline);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
 
-  for (auto const &drawable : drawables) {
+    Scene::draw(world_to_clip);
 
-    assert(drawable.transform); //drawables *must* have a transform
-    glm::mat4 object_to_world = drawable.transform->make_local_to_world();
+    //static geometry, one instanced draw per mesh (instances are shared with the outline pass below):
+    upload_static_instances(world_to_clip);
+    glUseProgram(flat_instanced_program->program);
+    glUniformMatrix4fv(flat_instanced_program->WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+    glBindVertexArray(vao_static_color);
+    draw_static_batches(flat_instanced_program->InstanceToWorld_mat4, flat_instanced_program->InstanceColor_vec4, flat_instanced_program->InstanceSmoothId_float);
 
-    if (outline_program_0->OBJECT_TO_WORLD_mat4 != -1U) {
-      glUniformMatrix4fv(outline_program_0->OBJECT_TO_WORLD_mat4, 1, GL_FALSE, glm::value_ptr(object_to_world));
-    }
-    if (outline_program_0->OBJECT_TO_CLIP_mat4 != -1U) {
-      glm::mat4 object_to_clip = world_to_clip * object_to_world;
-      glUniformMatrix4fv(outline_program_0->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
-    }
+    GL_ERRORS();
+
+    // Draw the outlines
+    glBindFramebuffer(GL_FRAMEBUFFER, fb.fb_outline);
+    glClearBufferfv(GL_COLOR, 0, bg_normal);
+    glClearBufferfv(GL_COLOR, 1, bg_pos);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+
+    glUseProgram(outline_program_0->program);
+    glBindVertexArray(vao_outline);
+
+    update_transforms();
+    bool use_packed = packed_current();
+    Frustum frustum(world_to_clip);
+    auto list_it = drawables.begin();
+    for (size_t di = 0; di < drawables.size(); ++di) {
+      Drawable const &drawable = (use_packed ? *packed.drawables[di].drawable : *list_it++);
+
+      assert(drawable.transform); //drawables *must* have a transform
+      glm::mat4 const &object_to_world = (use_packed
+        ? packed.local_to_world[packed.drawables[di].transform]
+        : drawable.transform->cache.local_to_world);
+
+      //same culling as Scene::draw (not counted again in view_stats):
+      if (cull) {
+        glm::vec3 world_min, world_max;
+        if (use_packed) {
+          world_min = packed.drawables[di].world_min;
+          world_max = packed.drawables[di].world_max;
+        } else {
+          transform_bounds(object_to_world, drawable.min, drawable.max, &world_min, &world_max);
+        }
+        if (world_min.x <= world_max.x && !frustum.intersects(world_min, world_max)) continue;
+      }
+
+      if (outline_program_0->OBJECT_TO_WORLD_mat4 != -1U) {
+        glUniformMatrix4fv(outline_program_0->OBJECT_TO_WORLD_mat4, 1, GL_FALSE, glm::value_ptr(object_to_world));
+      }
+      if (outline_program_0->OBJECT_TO_CLIP_mat4 != -1U) {
+        glm::mat4 object_to_clip = world_to_clip * object_to_world;
+        glUniformMatrix4fv(outline_program_0->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+      }
+
+      if (outline_program_0->OBJECT_SMOOTH_ID_float != -1U) {
+        glUniform1f(outline_program_0->OBJECT_SMOOTH_ID_float, drawable.pipeline.smooth_id);
+      }
+      // Uses the same pipeline as flat coloring
+      Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+      if (pipeline.index_type != GL_NONE) {
+        glDrawElements(pipeline.type, pipeline.count, pipeline.index_type, (GLbyte *)0 + pipeline.start * sizeof(uint32_t));
+      } else {
+        glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+      }
 
-    if (outline_program_0->OBJECT_SMOOTH_ID_float != -1U) {
-      glUniform1f(outline_program_0->OBJECT_SMOOTH_ID_float, drawable.pipeline.smooth_id);
     }
-    // Uses the same pipeline as flat coloring
-    Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
-    glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
 
+    glUseProgram(outline_instanced_program_0->program);
+    glUniformMatrix4fv(outline_instanced_program_0->WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+    glBindVertexArray(vao_static_outline);
+    draw_static_batches(outline_instanced_program_0->InstanceToWorld_mat4, -1U, outline_instanced_program_0->InstanceSmoothId_float);
   }
+
+  ViewStats view;
+  view.submitted = draw_stats.last_view.submitted + uint32_t(static_visible.size());
+  view.culled = draw_stats.last_view.culled + (static_stats.culled - static_culled_before);
+  view_stats.emplace_back(view);
+
   GL_ERRORS();
   // Draw to screen
   glBindFramebuffer(GL_FRAMEBUFFER, output_fb);
@@ -546,11 +1043,16 @@ void GameLevel::draw_fb(
   glClearBufferfv(GL_COLOR, 0, bg_out);
   glDisable(GL_DEPTH_TEST);
 
-  glUseProgram(outline_program_1->program);
+  OutlineProgram1 const &outline_1 = (fb.compact ? *outline_program_1_compact : *outline_program_1);
+  glUseProgram(outline_1.program);
   glBindVertexArray(vao_empty);
 
-  if (outline_program_1->EYE_vec3 != -1U) {
-    glUniform3fv(outline_program_1->EYE_vec3, 1, glm::value_ptr(eye));
+  if (outline_1.EYE_vec3 != -1U) {
+    glUniform3fv(outline_1.EYE_vec3, 1, glm::value_ptr(eye));
+  }
+  if (outline_1.CLIP_TO_WORLD_mat4 != -1U) {
+    glm::mat4 clip_to_world = glm::inverse(world_to_clip);
+    glUniformMatrix4fv(outline_1.CLIP_TO_WORLD_mat4, 1, GL_FALSE, glm::value_ptr(clip_to_world));
   }
 
   glActiveTexture(GL_TEXTURE0);
@@ -558,7 +1060,7 @@ void GameLevel::draw_fb(
   glActiveTexture(GL_TEXTURE1);
   glBindTexture(GL_TEXTURE_RECTANGLE, fb.normal_tex);
   glActiveTexture(GL_TEXTURE2);
-  glBindTexture(GL_TEXTURE_RECTANGLE, fb.position_tex);
+  glBindTexture(GL_TEXTURE_RECTANGLE, (fb.compact ? fb.depth_tex : fb.position_tex));
   glDrawArrays(GL_TRIANGLES, 0, 3);
   GL_ERRORS();
 
@@ -576,6 +1078,103 @@ void GameLevel::draw_fb(
 
 }
 
+void GameLevel::build_static_instances() {
+  update_transforms();
+  bool use_packed = packed_current();
+
+  static_instance_count = 0;
+  for (auto &batch : static_batches) {
+    assert(batch.instances.size() == batch.transforms.size());
+    batch.world_min.resize(batch.instances.size());
+    batch.world_max.resize(batch.instances.size());
+    for (size_t i = 0; i < batch.instances.size(); ++i) {
+      batch.instances[i].object_to_world = (use_packed
+        ? packed.local_to_world[batch.transforms[i]->handle]
+        : batch.transforms[i]->cache.local_to_world); //(refreshed by update_transforms(), above)
+      transform_bounds(batch.instances[i].object_to_world, batch.mesh->min, batch.mesh->max, &batch.world_min[i], &batch.world_max[i]);
+    }
+    static_instance_count += uint32_t(batch.instances.size());
+  }
+}
+
+void GameLevel::upload_static_instances(glm::mat4 const &world_to_clip) {
+  Frustum frustum(world_to_clip);
+
+  static_visible.clear();
+  uint32_t index = 0;
+  for (auto &batch : static_batches) {
+    batch.first = uint32_t(static_visible.size());
+    batch.visible = 0;
+    for (size_t i = 0; i < batch.instances.size(); ++i, ++index) {
+      //skip instances that are entirely outside the view:
+      if (cull && batch.world_min[i].x <= batch.world_max[i].x && !frustum.intersects(batch.world_min[i], batch.world_max[i])) {
+        static_stats.culled += 1;
+        continue;
+      }
+      static_visible.emplace_back(index);
+      batch.visible += 1;
+    }
+  }
+
+  //nothing culled: the ranges above match the buffer upload() filled:
+  if (static_visible.size() == static_instance_count) {
+    static_draw_buffer = static_instance_buffer;
+    return;
+  }
+
+  static_draw_buffer = static_visible_buffer;
+  if (static_visible == static_visible_uploaded) return; //(e.g. the view didn't move)
+
+  static_scratch.clear();
+  size_t v = 0;
+  index = 0;
+  for (auto const &batch : static_batches) {
+    for (; v < static_visible.size() && static_visible[v] < index + batch.instances.size(); ++v) {
+      static_scratch.emplace_back(batch.instances[static_visible[v] - index]);
+    }
+    index += uint32_t(batch.instances.size());
+  }
+
+  //re-specifying the whole store lets the driver orphan the copy the previous view is still using:
+  glBindBuffer(GL_ARRAY_BUFFER, static_visible_buffer);
+  glBufferData(GL_ARRAY_BUFFER, static_scratch.size() * sizeof(StaticInstance), static_scratch.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  static_visible_uploaded = static_visible;
+}
+
+void GameLevel::draw_static_batches(GLuint to_world, GLuint color, GLuint smooth_id) {
+  GLsizei stride = sizeof(StaticInstance);
+  glBindBuffer(GL_ARRAY_BUFFER, static_draw_buffer);
+
+  for (auto const &batch : static_batches) {
+    GLsizei count = GLsizei(batch.visible);
+    if (count == 0 || batch.mesh->count == 0) continue;
+
+    GLbyte *base = (GLbyte *)0 + size_t(batch.first) * stride;
+    if (to_world != -1U) {
+      for (GLuint c = 0; c < 4; ++c) {
+        glVertexAttribPointer(to_world + c, 4, GL_FLOAT, GL_FALSE, stride, base + offsetof(StaticInstance, object_to_world) + c * sizeof(glm::vec4));
+      }
+    }
+    if (color != -1U) {
+      glVertexAttribPointer(color, 4, GL_FLOAT, GL_FALSE, stride, base + offsetof(StaticInstance, color));
+    }
+    if (smooth_id != -1U) {
+      glVertexAttribPointer(smooth_id, 1, GL_FLOAT, GL_FALSE, stride, base + offsetof(StaticInstance, smooth_id));
+    }
+
+    if (batch.mesh->index_type != GL_NONE) {
+      glDrawElementsInstanced(batch.mesh->type, batch.mesh->count, batch.mesh->index_type, (GLbyte *)0 + batch.mesh->start * sizeof(uint32_t), count);
+    } else {
+      glDrawArraysInstanced(batch.mesh->type, batch.mesh->start, batch.mesh->count, count);
+    }
+    static_stats.instanced_draws += 1;
+    static_stats.instances += count;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 GameLevel::Movable::Movable(Transform *transform_) : transform(transform_) {
 
   init_pos = transform->position;
@@ -610,7 +1209,7 @@ void GameLevel::Movable::set_target_pos(glm::vec3 const &target, glm::vec4 const
 
 }
 
-GameLevel::Standpoint::Standpoint(OrthoCam *cam_, Movable *movable_)
+GameLevel::Standpoint::Standpoint(OrthoCam *cam_, Movable *movable_, bool make_texture)
   : cam(cam_), movable(movable_) {
 
   // Cameras are directed along the -z axis. Get the transformed z-axis.
@@ -620,10 +1219,7 @@ GameLevel::Standpoint::Standpoint(OrthoCam *cam_, Movable *movable_)
   // Get the transformed origin;
   pos = cam->transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
-  glGenTextures(1, &tex);
-  GL_ERRORS();
-
-  resize_texture(glm::uvec2(640, 480));
+  if (make_texture) create_texture();
 
   std::cout << "Standpoint created!" << std::endl;
   std::cout << "\tAxis: "; print_vec3(axis); std::cout << std::endl;
@@ -633,6 +1229,13 @@ GameLevel::Standpoint::Standpoint(OrthoCam *cam_, Movable *movable_)
   std::cout << "\tTexture #" << tex << std::endl;
 }
 
+void GameLevel::Standpoint::create_texture() {
+  glGenTextures(1, &tex);
+  GL_ERRORS();
+
+  resize_texture(glm::uvec2(640, 480));
+}
+
 void GameLevel::Standpoint::resize_texture(glm::uvec2 const &new_size) {
 
   if (size == new_size) return;
@@ -677,6 +1280,66 @@ void GameLevel::Standpoint::update_texture(GameLevel *level) {
   level->draw_fb(pos, proj * w2l, fb.fb_output_sc);
   updated = true;
 
+  signature = make_signature(level);
+  rendered_frame = level->frame;
+  stats.renders += 1;
+
+}
+
+//FNV-1a, for folding the state a standpoint depends on into one value:
+static void hash_bytes(uint64_t &h, void const *data, size_t size) {
+  uint8_t const *bytes = reinterpret_cast< uint8_t const * >(data);
+  for (size_t i = 0; i < size; ++i) {
+    h ^= bytes[i];
+    h *= 0x100000001b3ULL;
+  }
+}
+
+uint64_t GameLevel::Standpoint::make_signature(GameLevel const *level, bool nested) const {
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  //the camera (same matrix update_texture() draws with) and the renderer options:
+  float tex_h = cam->scale;
+  float tex_w = (w / h) * tex_h;
+  glm::mat4 world_to_clip = glm::ortho(-tex_w, tex_w, -tex_h, tex_h, cam->clip_near, cam->clip_far)
+    * cam->transform->make_world_to_local();
+  hash_bytes(h, &world_to_clip, sizeof(world_to_clip));
+  hash_bytes(h, &GameLevel::render_options.single_pass, sizeof(bool));
+  hash_bytes(h, &GameLevel::render_options.compact, sizeof(bool));
+
+  //everything that can move (static level geometry can't) and is inside the ortho box:
+  glm::vec3 row[3];
+  for (uint32_t r = 0; r < 3; ++r) {
+    row[r] = glm::vec3(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r]);
+  }
+  for (uint32_t i = 0; i < level->dynamics.size(); ++i) {
+    Dynamic const &dynamic = level->dynamics[i];
+    if (dynamic.screen != -1 && level->screens[dynamic.screen].stpt == this) continue; //(own screen shows last frame's texture)
+
+    glm::mat4 const &to_world = dynamic.drawable->transform->make_local_to_world();
+    float scale = std::max(glm::length(glm::vec3(to_world[0])), std::max(glm::length(glm::vec3(to_world[1])), glm::length(glm::vec3(to_world[2]))));
+    glm::vec4 center = world_to_clip * (to_world * glm::vec4(dynamic.center, 1.0f));
+    bool inside = true;
+    for (uint32_t r = 0; r < 3; ++r) {
+      if (std::abs(center[r]) > 1.0f + dynamic.radius * scale * glm::length(row[r])) inside = false;
+    }
+    if (!inside) continue;
+
+    hash_bytes(h, &i, sizeof(i));
+    hash_bytes(h, &to_world, sizeof(to_world));
+    if (dynamic.movable != -1) {
+      hash_bytes(h, &level->movable_data[dynamic.movable].color, sizeof(glm::vec4));
+    }
+    if (nested && dynamic.screen != -1 && level->screens[dynamic.screen].stpt) {
+      //another screen in view shows what its own camera sees:
+      // (one level deep only -- following screens-in-screens further would let two standpoints
+      //  facing each other keep invalidating one another)
+      uint64_t other = level->screens[dynamic.screen].stpt->make_signature(level, false);
+      hash_bytes(h, &other, sizeof(other));
+    }
+  }
+
+  return h;
 }
 
 glm::vec2 GameLevel::Standpoint::movable_center_to_screen() {
@@ -740,7 +1403,7 @@ GameLevel::Screen *GameLevel::screen_get(Transform const *transform) {
 
 }
 
-void GameLevel::screens_standpoints_texture_update(glm::vec3 const &pos) {
+void GameLevel::screens_standpoints_texture_update(glm::vec3 const &pos, glm::mat4 const &world_to_clip) {
 
   for (auto &stpt : standpoints) {
     stpt.updated = false;
@@ -749,6 +1412,9 @@ void GameLevel::screens_standpoints_texture_update(glm::vec3 const &pos) {
   for (Screen &sc : screens) {
     glm::vec3 dist = sc.pos - pos;
     sc.draw = (glm::dot(dist, dist) <= sc.draw_distance * sc.draw_distance);
+    //is the middle of the screen in the player's view? (if not, at most an edge of it is)
+    glm::vec4 clip = world_to_clip * glm::vec4(sc.pos, 1.0f);
+    sc.in_view = (clip.w > 0.0f && std::abs(clip.x) <= clip.w && std::abs(clip.y) <= clip.w);
   }
 
 }
@@ -2,6 +2,8 @@
 
 #include "Scene.hpp"
 #include "Mesh.hpp"
+#include "CollisionBVH.hpp"
+#include "collide.hpp"
 #include "GL.hpp"
 
 #include <string>
@@ -9,13 +11,38 @@
 
 struct GameLevel : Scene {
 
-  GameLevel( std::string level_name );
+  //'headless' levels skip everything that needs an OpenGL context (vertex buffers, VAOs, standpoint
+  // textures, framebuffers) and keep just the scene and collision data -- for servers:
+  //'defer_upload' levels do no OpenGL work either, but keep their vertex data for upload() --
+  // so they can be loaded on another thread (see PlayerMode::level_change):
+  GameLevel( std::string level_name, bool headless = false, bool defer_upload = false );
   virtual ~GameLevel();
 
+  bool headless = false;
+
   void init_meshes(std::string level_name);
 
+  //create the vertex buffer, VAOs, standpoint textures and framebuffers
+  // (on the thread with the OpenGL context; the constructor does this unless told not to):
+  void upload();
+  bool uploaded = false;
+
+  //Renderer switches (shared by all levels, so they survive level changes):
+  struct RenderOptions {
+    //write color + outline G-buffer in one MRT pass (false => separate color and outline passes):
+    bool single_pass = true;
+    //compact G-buffer: octahedral 10:10:10:2 normals, positions rebuilt from depth in OutlineProgram1
+    // (always single-pass; 8 instead of 36 bytes/pixel for normal + position + depth):
+    bool compact = false;
+    //(one-shot) render the next main view with both layouts and print an image diff:
+    bool diff_compact = false;
+  };
+  static RenderOptions render_options;
+
   void draw(glm::uvec2 const &drawable_size, glm::vec3 const &eye, glm::mat4 const &world_to_clip);
   void draw_fb(glm::vec3 const &eye, glm::mat4 const &world_to_clip, GLuint output_fb);
+  //draw the view offscreen with the full and compact G-buffers and report how the images differ:
+  void diff_compact(glm::uvec2 const &drawable_size, glm::vec3 const &eye, glm::mat4 const &world_to_clip);
 
   void reset();
 
@@ -57,7 +84,8 @@ struct GameLevel : Scene {
 
   struct Standpoint {
 
-    Standpoint(OrthoCam *cam_, Movable *movable);
+    Standpoint(OrthoCam *cam_, Movable *movable, bool make_texture = true);
+    void create_texture();
     void resize_texture(glm::uvec2 const &new_size);
     void update_texture(GameLevel *level);
     glm::vec2 movable_center_to_screen();
@@ -76,6 +104,21 @@ struct GameLevel : Scene {
     bool updated = false;
     bool first_draw = false;
 
+    //'tex' is only re-rendered when the signature of what the camera sees changes
+    // (camera, renderer options, and the dynamic objects inside the ortho box):
+    // ('nested' also folds in the signatures of other screens in view)
+    uint64_t make_signature(GameLevel const *level, bool nested = true) const;
+    uint64_t signature = 0; //of the last render
+    uint32_t rendered_frame = 0; //GameLevel::frame of the last render
+    //screens that are only partly in view re-render at most once per this many frames:
+    static constexpr uint32_t partial_interval = 6;
+
+    struct Stats {
+      uint32_t renders = 0; //times 'tex' was re-rendered
+      uint32_t reused = 0; //frames the screen was drawn and nothing had changed
+      uint32_t throttled = 0; //frames a change was deferred because the screen was only partly in view
+    } stats;
+
     struct MovePosition {
       MovePosition(Light *light);
       Transform *transform = nullptr;
@@ -108,6 +151,7 @@ struct GameLevel : Scene {
 
     Standpoint *stpt = nullptr;
     bool draw = false;
+    bool in_view = false; //is the screen's center in the player's view?
 
     // The position player 2 needs to stand to move the object
     glm::vec3 pos = glm::vec3(0.0f);
@@ -137,9 +181,104 @@ struct GameLevel : Scene {
     int movable_index;
   };
 
+  //Collision cache, built from mesh_colliders by build_collision():
+  // world-space triangles (with edges, normals, and bounds precomputed) in bounding volume hierarchies
+  struct Collision {
+    //static colliders never move, so their triangles are transformed once:
+    // (and stored in leaf order, so each leaf of static_tree is one contiguous batch)
+    CollisionTriangles static_triangles;
+    CollisionBVH static_tree; //items are static_triangles
+
+    //movable colliders are few and large; each is re-transformed (and the tree over them refit)
+    // only when its transform's cache version changes:
+    std::vector< uint32_t > movables; //indices into mesh_colliders
+    std::vector< uint32_t > movable_first; //movable m has movable_triangles[movable_first[m], movable_first[m+1])
+    CollisionTriangles movable_triangles;
+    std::vector< uint64_t > movable_versions; //transform cache versions movable_triangles were built at
+    std::vector< glm::vec3 > movable_min, movable_max; //world-space bounds
+    CollisionBVH movable_tree; //items index 'movables'
+    //rebuild movable m's triangles and bounds from its (current) transform cache:
+    void update_movable(GameLevel const &level, uint32_t m);
+
+    struct Stats {
+      uint32_t sweeps = 0;
+      uint32_t triangles_tested = 0; //triangles that got past the quick reject (into the swept test proper)
+      uint32_t movable_updates = 0; //times a movable was re-transformed
+    } stats;
+  } collision;
+  void build_collision();
+
+  //Sweep a sphere from 'from' to 'to' against all mesh_colliders:
+  // returns 'true' on collision, with the earliest contact in 'hit'
+  // (shared by the local player's and the other player's movement code)
+  bool sweep_sphere(glm::vec3 const &from, glm::vec3 const &to, float radius, SweptSphereHit *hit);
+
+  //Static level geometry (anything that isn't a movable, screen, goal, or player body) is kept
+  // out of 'drawables' and drawn with one instanced draw per mesh in each pass of draw_fb():
+  //Per-instance data (static geometry never moves, so this is all worked out once the scene is loaded):
+  struct StaticInstance {
+    glm::mat4 object_to_world = glm::mat4(1.0f);
+    glm::vec4 color = glm::vec4(1.0f); //(multiplies the vertex colors)
+    float smooth_id = 0.0f; //(outline shading group, as Drawable::Pipeline::smooth_id)
+  };
+  struct StaticBatch {
+    Mesh const *mesh = nullptr;
+    std::vector< Transform * > transforms;
+    std::vector< StaticInstance > instances; //(one per transform)
+    std::vector< glm::vec3 > world_min, world_max; //world-space bounds of each instance
+    uint32_t first = 0; //where this batch's visible instances start in 'static_draw_buffer'
+    uint32_t visible = 0; //instances that passed culling in the current view
+  };
+  std::vector< StaticBatch > static_batches;
+  uint32_t static_instance_count = 0;
+  //fill in the instances' world matrices and bounds (called once the scene is loaded):
+  void build_static_instances();
+
+  GLuint static_instance_buffer = 0; //every instance, uploaded once by upload()
+  GLuint static_visible_buffer = 0; //just the visible ones, when culling leaves out some
+  GLuint static_draw_buffer = 0; //which of the two the current view draws from
+  std::vector< uint32_t > static_visible; //indices (over all batches) of the instances in the current view
+  std::vector< uint32_t > static_visible_uploaded; //...and of those in 'static_visible_buffer'
+  std::vector< StaticInstance > static_scratch; //kept to avoid per-view allocation
+  GLuint vao_static_color = 0;
+  GLuint vao_static_outline = 0;
+
+  //cull static geometry against 'world_to_clip', and point 'static_draw_buffer' at the survivors
+  // (re-uploading 'static_visible_buffer' only if they aren't everything, or what it already holds):
+  void upload_static_instances(glm::mat4 const &world_to_clip);
+  //draw all static batches; pass the bound program's per-instance attribute locations (-1U if unused):
+  // (GL 3.3 has no base instance, so each batch re-points the instance attributes at its range)
+  void draw_static_batches(GLuint to_world, GLuint color, GLuint smooth_id);
+
+  //Counters for static geometry, accumulated like Scene::draw_stats:
+  struct StaticStats {
+    uint32_t instanced_draws = 0;
+    uint32_t instances = 0;
+    uint32_t culled = 0;
+  } static_stats;
+
+  //Culling results for each draw_fb() call this frame (standpoint textures first, main view last):
+  struct ViewStats {
+    uint32_t submitted = 0; //dynamic drawables + static instances drawn
+    uint32_t culled = 0;
+  };
+  std::vector< ViewStats > view_stats;
+
+  //Drawables that can change at runtime (i.e., everything but static_batches):
+  struct Dynamic {
+    Drawable const *drawable = nullptr;
+    //bounding sphere, in object space:
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+    int movable = -1; //index in movable_data, if a movable
+    int screen = -1; //index in screens, if a screen
+  };
+  std::vector< Dynamic > dynamics;
+
   Screen *screen_get(Transform const *transform);
-  void screens_standpoints_texture_update(glm::vec3 const &pos);
+  void screens_standpoints_texture_update(glm::vec3 const &pos, glm::mat4 const &world_to_clip);
   bool first_draw = true;
+  uint32_t frame = 0; //counts calls to draw()
 
   MeshBuffer *meshes = nullptr;
   std::unordered_map< Mesh const *, Mesh const * >mesh_to_collider;
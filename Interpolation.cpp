@@ -0,0 +1,68 @@
+#include "Interpolation.hpp"
+
+#include <algorithm>
+
+void RemoteClock::observe(double remote_time, double local_time) {
+	double sample = local_time - remote_time;
+	if (!have_offset || sample < offset) {
+		//a quicker delivery than any before -- that's the new reference:
+		have_offset = true;
+		offset = sample;
+	} else {
+		//(follow slowly, in case the sender's clock runs slow or the route got longer)
+		offset += Drift * (sample - offset);
+	}
+}
+
+void InterpolationBuffer::push(Sample const &sample, bool contiguous) {
+	stats.samples += 1;
+	if (!samples.empty() && sample.time <= samples.back().time) {
+		stats.late += 1;
+		return;
+	}
+	if (contiguous && !samples.empty() && sample.time - samples.back().time > QuietGap) {
+		Sample hold = samples.back();
+		hold.time = sample.time - QuietHold;
+		samples.emplace_back(hold);
+	}
+	samples.emplace_back(sample);
+}
+
+bool InterpolationBuffer::at(double time, Sample *out) {
+	if (samples.empty()) return false;
+
+	//samples before the pair around 'time' won't be needed again:
+	// (but keep two, to extrapolate from)
+	while (samples.size() > 2 && samples[1].time <= time) samples.pop_front();
+
+	if (samples.size() == 1 || time <= samples[0].time) {
+		*out = (time <= samples[0].time ? samples[0] : samples[1]);
+		out->time = time;
+		stats.held += 1;
+		return true;
+	}
+
+	Sample const &a = samples[0];
+	Sample const &b = samples[1];
+	double span = b.time - a.time;
+	double t = time;
+	if (time > b.time) {
+		//ran past the newest sample -- keep going the way it was for a bit, then ease back:
+		// (senders go quiet when things stop, so a dry buffer often just means "stopped")
+		double over = time - b.time;
+		if (over < MaxExtrapolation) {
+			stats.extrapolated += 1;
+		} else {
+			over = std::max(0.0, 2.0 * MaxExtrapolation - over);
+			stats.held += 1;
+		}
+		t = b.time + over;
+	} else {
+		stats.interpolated += 1;
+	}
+	float amt = float((t - a.time) / span);
+	out->time = time;
+	out->position = a.position + amt * (b.position - a.position);
+	out->rotation = (amt <= 1.0f ? glm::slerp(a.rotation, b.rotation, amt) : b.rotation);
+	return true;
+}
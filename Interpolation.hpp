@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+ * Smooth display of state that arrives over the network at the sender's
+ * (irregular, jittery) pace.
+ *
+ * Samples are stamped with the sender's simulation time (its step count, see
+ * PlayerMode::input_tick), which a RemoteClock maps onto local time; an
+ * InterpolationBuffer then shows the state as of 'delay' seconds ago,
+ * interpolating between the samples on either side -- so as long as packets
+ * are less than 'delay' late, motion is as smooth as it was on the sender.
+ * Past the newest sample it extrapolates (briefly), then settles back on it.
+ */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <deque>
+
+//Maps a sender's clock onto ours (tracking the fastest delivery seen, so jitter doesn't move it):
+struct RemoteClock {
+	//note that something stamped 'remote_time' arrived at 'local_time':
+	void observe(double remote_time, double local_time);
+	//sender time that corresponds to local 'local_time':
+	double remote(double local_time) const { return local_time - offset; }
+
+	void reset() { have_offset = false; offset = 0.0; }
+
+	bool have_offset = false;
+	double offset = 0.0; //local time minus remote time, for the quickest packets
+	static constexpr double Drift = 0.01; //how fast the offset follows slower arrivals (per sample)
+};
+
+struct InterpolationBuffer {
+	struct Sample {
+		double time = 0.0; //sender time
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	};
+
+	//add the sender's state at 'time' (samples older than the newest one are dropped);
+	// 'contiguous' means the sender sent nothing since the previous sample:
+	void push(Sample const &sample, bool contiguous);
+	//state at sender time 'time'; returns false if there is no sample yet:
+	bool at(double time, Sample *out);
+
+	void clear() { samples.clear(); }
+	bool empty() const { return samples.empty(); }
+	//sender time of the newest sample:
+	double newest() const { return samples.empty() ? 0.0 : samples.back().time; }
+
+	std::deque< Sample > samples; //oldest first
+
+	struct {
+		uint64_t samples = 0;
+		uint64_t late = 0; //samples that arrived after a newer one
+		uint64_t interpolated = 0; //at() calls between two samples
+		uint64_t extrapolated = 0; //at() calls past the newest sample (the buffer ran dry)
+		uint64_t held = 0; //at() calls past the extrapolation limit, or with a single sample
+	} stats;
+
+	static constexpr double MaxExtrapolation = 0.1; //seconds past the newest sample to keep moving (then it eases back over as long again)
+	//senders only send when something changes, so a contiguous sample after a long gap ends a quiet
+	// spell, and gets the previous state repeated just before it (otherwise motion would be smeared
+	// over the whole spell); after a gap from lost samples, interpolating across is the best guess:
+	static constexpr double QuietGap = 0.05; //seconds
+	static constexpr double QuietHold = 1.0 / 60.0; //seconds before the new sample to repeat the old one at
+};
@@ -0,0 +1,75 @@
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::use_mmap = true;
+MappedFile::Stats MappedFile::stats;
+
+MappedFile::MappedFile(std::string const &filename) {
+	stats.files += 1;
+
+#if !defined(_WIN32)
+	if (use_mmap) {
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd == -1) throw std::runtime_error("Failed to open '" + filename + "'.");
+		struct stat info;
+		if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+			void *at = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (at != MAP_FAILED) {
+				data = reinterpret_cast< char const * >(at);
+				size = size_t(info.st_size);
+				mapped = true;
+			}
+		}
+		close(fd); //(the mapping keeps the file)
+		if (mapped) {
+			stats.mapped_bytes += size;
+			return;
+		}
+		//(empty or special file, or mmap failed: fall back to reading it)
+	}
+#endif
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open '" + filename + "'.");
+	file.seekg(0, std::ios::end);
+	std::streamoff length = file.tellg();
+	if (length < 0) throw std::runtime_error("Failed to size '" + filename + "'.");
+	file.seekg(0, std::ios::beg);
+	copy.resize(size_t(length));
+	if (!copy.empty() && !file.read(copy.data(), copy.size())) {
+		throw std::runtime_error("Failed to read '" + filename + "'.");
+	}
+	data = copy.data();
+	size = copy.size();
+	stats.copied_bytes += size;
+}
+
+MappedFile::~MappedFile() {
+#if !defined(_WIN32)
+	if (mapped) munmap(const_cast< char * >(data), size);
+#endif
+}
+
+uint64_t peak_rss_bytes() {
+#if defined(_WIN32)
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+	#if defined(__APPLE__)
+	return uint64_t(usage.ru_maxrss); //(bytes on macOS)
+	#else
+	return uint64_t(usage.ru_maxrss) * 1024; //(kilobytes on linux)
+	#endif
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * A MappedFile is a whole file's bytes, read-only, for reading chunks in
+ * place (see ChunkReader in read_write_chunk.hpp):
+ *  - where it can, the file is memory-mapped (mmap), so nothing is copied
+ *    and pages are read in as they are touched;
+ *  - otherwise (on windows, for special files, or with use_mmap turned off)
+ *    the file is read into 'copy', the same way the stream readers would.
+ *
+ * 'data' stays valid for as long as the MappedFile does.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MappedFile {
+	//opens and maps (or reads) 'filename'; throws on failure:
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *data = nullptr;
+	size_t size = 0;
+	bool mapped = false; //(false => 'data' points into 'copy')
+	std::vector< char > copy;
+
+	//(set to false -- e.g., by main.cpp's --no-mmap -- to always read files into memory, for comparison)
+	static bool use_mmap;
+
+	//totals over all MappedFiles so far (levels load on worker threads, hence atomic):
+	struct Stats {
+		std::atomic< uint64_t > files{0};
+		std::atomic< uint64_t > mapped_bytes{0};
+		std::atomic< uint64_t > copied_bytes{0};
+	};
+	static Stats stats;
+};
+
+//peak resident set size of this process so far, in bytes (0 if unknown on this platform):
+uint64_t peak_rss_bytes();
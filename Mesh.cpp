@@ -1,5 +1,4 @@
 #include "Mesh.hpp"
-#include "read_write_chunk.hpp"
 
 #include <glm/glm.hpp>
 
@@ -11,11 +10,7 @@
 #include <set>
 #include <cstddef>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
-
-	std::ifstream file(filename, std::ios::binary);
-
+MeshBuffer::MeshBuffer(std::string const &filename, bool upload) {
 	GLuint total = 0;
 
 	struct Vertex {
@@ -25,59 +20,94 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		glm::vec2 TexCoord;
 	};
 	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
-
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	struct QuantizedVertex {
+		glm::vec3 Position; //(full precision: collision detection reads these too)
+		uint32_t Normal; //GL_INT_2_10_10_10_REV
+		glm::u8vec4 Color;
+		glm::u16vec2 TexCoord; //half floats
+	};
+	static_assert(sizeof(QuantizedVertex) == 3*4+4+4*1+2*2, "QuantizedVertex is packed.");
 
-		total = GLuint(data.size()); //store total for later checks on index
+	//read data chunk (in place):
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
+		file.reset(new MappedFile(filename));
+	} else {
+		throw std::runtime_error("Unknown file type '" + filename + "'");
+	}
+	ChunkReader reader(file->data, file->size);
+
+	ChunkSpan< glm::u8vec4 > colors;
+	//store attrib locations: (upload_buffer() fills in 'buffer')
+	if (reader.peek() == "pnq0") {
+		ChunkSpan< QuantizedVertex > data = reader.read< QuantizedVertex >("pnq0");
+		total = GLuint(data.size());
+		vertex_data.bytes = data.bytes;
+		vertex_data.count = data.size_bytes();
+		positions = data.field< glm::vec3 >(offsetof(QuantizedVertex, Position));
+		colors = data.field< glm::u8vec4 >(offsetof(QuantizedVertex, Color));
+
+		Position = Attrib(buffer, 3, GL_FLOAT, Attrib::AsFloat, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Position));
+		Normal = Attrib(buffer, 4, GL_INT_2_10_10_10_REV, Attrib::AsFloatFromFixedPoint, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Normal));
+		Color = Attrib(buffer, 4, GL_UNSIGNED_BYTE, Attrib::AsFloatFromFixedPoint, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Color));
+		TexCoord = Attrib(buffer, 2, GL_HALF_FLOAT, Attrib::AsFloat, sizeof(QuantizedVertex), offsetof(QuantizedVertex, TexCoord));
+	} else {
+		ChunkSpan< Vertex > data = reader.read< Vertex >("pnct");
+		total = GLuint(data.size());
+		vertex_data.bytes = data.bytes;
+		vertex_data.count = data.size_bytes();
+		positions = data.field< glm::vec3 >(offsetof(Vertex, Position));
+		colors = data.field< glm::u8vec4 >(offsetof(Vertex, Color));
 
-		//store attrib locations:
 		Position = Attrib(buffer, 3, GL_FLOAT, Attrib::AsFloat, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(buffer, 3, GL_FLOAT, Attrib::AsFloat, sizeof(Vertex), offsetof(Vertex, Normal));
 		Color = Attrib(buffer, 4, GL_UNSIGNED_BYTE, Attrib::AsFloatFromFixedPoint, sizeof(Vertex), offsetof(Vertex, Color));
 		TexCoord = Attrib(buffer, 2, GL_FLOAT, Attrib::AsFloat, sizeof(Vertex), offsetof(Vertex, TexCoord));
-	} else {
-		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	ChunkSpan< char > strings = reader.read< char >("str0");
 
-	{ //read index chunk, add to meshes:
-		struct IndexEntry {
-			uint32_t name_begin, name_end;
-			uint32_t vertex_begin, vertex_end;
-		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+	ChunkSpan< IndexEntry > index = reader.read< IndexEntry >("idx0");
 
+	//indexed meshes:
+	GLuint ranges_end = total; //(end of what 'idx0' ranges index into)
+	if (reader.peek() == "ind0") {
+		indices = reader.read< uint32_t >("ind0");
+		for (size_t i = 0; i < indices.size(); ++i) {
+			if (indices[i] >= total) {
+				throw std::runtime_error("index chunk has out-of-range vertex index");
+			}
+		}
+		ranges_end = GLuint(indices.size());
+	}
+
+	{ //add index entries to meshes:
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
 			}
-			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= ranges_end)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			std::string name(strings.bytes + entry.name_begin, strings.bytes + entry.name_end);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
+			if (!indices.empty()) mesh.index_type = GL_UNSIGNED_INT;
+			GLuint first = (indices.empty() ? mesh.start : indices[mesh.start]);
       for (uint32_t i = 0; i < 4; i++) {
-        mesh.color[i] = (float) (data[mesh.start].Color[i]) / 255.0f;
+        mesh.color[i] = (float) (colors[first][i]) / 255.0f;
       }
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+			for (uint32_t v = 0; v < mesh.count; ++v) {
+				mesh.min = glm::min(mesh.min, position(mesh, v));
+				mesh.max = glm::max(mesh.max, position(mesh, v));
 			}
 			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
 			if (!inserted) {
@@ -86,15 +116,12 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		}
 	}
 
-	if (file.peek() != EOF) {
+	if (!reader.done()) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
-	//store positions for collision detection use:
-	positions.reserve(data.size());
-	for (auto const &v : data) {
-		positions.emplace_back(v.Position);
-	}
+	//upload data (or leave it for upload_buffer()):
+	if (upload) upload_buffer();
 
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
@@ -107,6 +134,55 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 	*/
 }
 
+void MeshBuffer::upload_buffer() {
+	assert(file && "upload_buffer() releases the file, so it only works once");
+	if (buffer == 0) glGenBuffers(1, &buffer);
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertex_data.size_bytes(), vertex_data.bytes, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	Position.buffer = Normal.buffer = Color.buffer = TexCoord.buffer = buffer;
+	gpu_bytes = vertex_data.size_bytes();
+
+	if (!indices.empty()) {
+		//(the element buffer binding is part of the vertex array state, so don't touch the current one's)
+		GLint old_vao = 0;
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+		glBindVertexArray(0);
+
+		if (index_buffer == 0) glGenBuffers(1, &index_buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_bytes(), indices.bytes, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+		glBindVertexArray(old_vao);
+		gpu_bytes += indices.size_bytes();
+	}
+
+	//the GPU has its own copy now; don't hold on to the whole file (mapped or read) for position():
+	release_file();
+}
+
+void MeshBuffer::release_file() {
+	kept_positions.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i) {
+		kept_positions[i] = positions[i];
+	}
+	positions.bytes = reinterpret_cast< char const * >(kept_positions.data());
+	positions.stride = sizeof(glm::vec3);
+
+	kept_indices.resize(indices.size());
+	for (size_t i = 0; i < indices.size(); ++i) {
+		kept_indices[i] = indices[i];
+	}
+	indices.bytes = reinterpret_cast< char const * >(kept_indices.data());
+	indices.stride = sizeof(uint32_t);
+
+	vertex_data = ChunkSpan< char >();
+	file.reset();
+}
+
 const Mesh &MeshBuffer::lookup(std::string const &name) const {
 	auto f = meshes.find(name);
 	if (f == meshes.end()) {
@@ -123,5 +199,18 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	attribs["Color"] = &Color;
 	attribs["TexCoord"] = &TexCoord;
 
-	return ::make_vao_for_program(attribs, program);
+	GLuint vao = ::make_vao_for_program(attribs, program);
+	bind_index_buffer(vao);
+	return vao;
+}
+
+void MeshBuffer::bind_index_buffer(GLuint vao) const {
+	if (index_buffer == 0) return;
+
+	GLint old_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	glBindVertexArray(old_vao);
 }
@@ -7,14 +7,25 @@
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
  *
+ * Mesh files (.pnct) are chunks (see read_write_chunk.hpp), written by scenes/export-meshes.py:
+ *  'pnct' vertices: f32 position[3], f32 normal[3], u8 color[4], f32 texcoord[2] (36 bytes)
+ *   -or-
+ *  'pnq0' quantized vertices: f32 position[3], snorm 10:10:10:2 normal, u8 color[4], f16 texcoord[2] (24 bytes)
+ *  'str0' mesh names
+ *  'idx0' per mesh: name begin/end in 'str0', vertex begin/end
+ *  'ind0' (optional) u32 vertex indices; if present, meshes are indexed triangle lists
+ *         and the 'idx0' ranges are ranges of indices
  */
 
 #include "make_vao_for_program.hpp"
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
 #include "GL.hpp"
 
 #include <glm/glm.hpp>
 #include <map>
 #include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,6 +36,9 @@ struct Mesh {
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
 	GLuint start = 0; //index of first vertex
 	GLuint count = 0; //count of vertices
+	//indexed meshes (GL_UNSIGNED_INT; GL_NONE if not) are drawn with glDrawElements, and
+	// 'start' and 'count' are a range of the MeshBuffer's 'indices' instead:
+	GLenum index_type = GL_NONE;
 
   glm::vec4 color = glm::vec4(0.0f);
 
@@ -37,7 +51,13 @@ struct Mesh {
 struct MeshBuffer {
 	//construct from a file:
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	// ('upload' == false skips creating 'buffer' -- for use without an OpenGL context, e.g., collision
+	//  only, or to call upload_buffer() later, e.g., after reading on another thread)
+	MeshBuffer(std::string const &filename, bool upload = true);
+
+	//create 'buffer' (and 'index_buffer') from the file's data (needs the OpenGL context),
+	// then let go of the file (see 'file', below) -- so call it only once:
+	void upload_buffer();
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
@@ -46,9 +66,22 @@ struct MeshBuffer {
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
 	GLuint make_vao_for_program(GLuint program) const;
+	//(for VAOs made some other way) attach 'index_buffer' to 'vao':
+	void bind_index_buffer(GLuint vao) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//...and the element buffer with the indices of indexed meshes (0 if none are):
+	// (make_vao_for_program() binds it to the VAO)
+	GLuint index_buffer = 0;
+	//bytes upload_buffer() put in those two buffers' stores (what the meshes take up on the GPU,
+	// not counting driver overhead):
+	size_t gpu_bytes = 0;
+
+	//position of the i'th vertex of 'mesh' (indexed or not):
+	glm::vec3 position(Mesh const &mesh, GLuint i) const {
+		return positions[mesh.index_type == GL_NONE ? mesh.start + i : indices[mesh.start + i]];
+	}
 
 	//-- internals ---
 
@@ -61,6 +94,14 @@ struct MeshBuffer {
 	Attrib Color;
 	Attrib TexCoord;
 
-	//local copy of vertex information: (for collision detection)
-	std::vector< glm::vec3 > positions;
+	//the file, mapped (see MappedFile.hpp) until upload_buffer() puts its vertex data on the GPU;
+	// collision detection reads positions from it in place until then, and from copies after:
+	std::unique_ptr< MappedFile > file;
+	ChunkSpan< char > vertex_data; //(empty once the file is released)
+	ChunkSpan< glm::vec3 > positions;
+	ChunkSpan< uint32_t > indices; //(empty if the file has no 'ind0' chunk)
+	//what 'positions' and 'indices' point to once the file is released:
+	std::vector< glm::vec3 > kept_positions;
+	std::vector< uint32_t > kept_indices;
+	void release_file();
 };
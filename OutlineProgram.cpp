@@ -5,6 +5,21 @@
 
 Scene::Drawable::Pipeline flat_program_pipeline;
 
+//G-buffer normal output shared by the geometry programs:
+// COMPACT_GBUFFER == 0 => world normal in xyz, smooth id in w (RGBA32F target)
+// COMPACT_GBUFFER == 1 => octahedral normal in xy, smooth id * 2 / 1023 in z, 1 in w (RGB10_A2 target)
+//  (OutlineProgram1's compact variant decodes this; background pixels are cleared with w == 0)
+#define GBUFFER_NORMAL_OUTPUT \
+	"uniform uint COMPACT_GBUFFER;\n" \
+	"vec4 gbuffer_normal(vec3 n, float sid) {\n" \
+	"	n = normalize(n);\n" \
+	"	if (COMPACT_GBUFFER == 0U) return vec4(n, sid);\n" \
+	"	n /= abs(n.x) + abs(n.y) + abs(n.z);\n" \
+	"	vec2 e = n.xy;\n" \
+	"	if (n.z < 0.0) e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n" \
+	"	return vec4(e * 0.5 + 0.5, sid * 2.0 / 1023.0, 1.0);\n" \
+	"}\n"
+
 Load< FlatProgram > flat_program(LoadTagEarly, []() -> FlatProgram const * {
 	FlatProgram *ret = new FlatProgram();
 
@@ -14,6 +29,8 @@ Load< FlatProgram > flat_program(LoadTagEarly, []() -> FlatProgram const * {
 	flat_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
 	flat_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
 	flat_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	flat_program_pipeline.OBJECT_TO_WORLD_mat4 = ret->OBJECT_TO_WORLD_mat4;
+	flat_program_pipeline.OBJECT_SMOOTH_ID_float = ret->OBJECT_SMOOTH_ID_float;
 
 	return ret;
 });
@@ -26,16 +43,24 @@ FlatProgram::FlatProgram() {
 		"uniform mat4 OBJECT_TO_CLIP;\n"
 		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
 		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		"uniform mat4 OBJECT_TO_WORLD;\n"
+		"uniform float OBJECT_SMOOTH_ID;\n"
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
 		"in vec2 TexCoord;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
+		"out vec4 normal;\n"
+		"out vec4 position;\n"
 		"void main() {\n"
 		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
+		"	normal.xyz = (OBJECT_TO_WORLD * vec4(Normal, 0.0)).xyz;\n"
+		"	normal.w = OBJECT_SMOOTH_ID;\n"
+		"	position.xyz = (OBJECT_TO_WORLD * Position).xyz;\n"
+		"	position.w = 1.0;\n"
 		"}\n"
 	,
 		//fragment shader:
@@ -45,7 +70,12 @@ FlatProgram::FlatProgram() {
     "uniform vec4 UNIFORM_COLOR;\n"
 		"in vec4 color;\n"
 		"in vec2 texCoord;\n"
+		"in vec4 normal;\n"
+		"in vec4 position;\n"
 		"layout(location=0) out vec4 fragColor;\n"
+		"layout(location=1) out vec4 fragNormal;\n"
+		"layout(location=2) out vec4 fragPosition;\n"
+		GBUFFER_NORMAL_OUTPUT
 		"void main() {\n"
     " vec4 cout = vec4(1.0, 1.0, 1.0, 1.0);\n"
     " if (USE_TEX == 0U) {\n"
@@ -56,6 +86,8 @@ FlatProgram::FlatProgram() {
     "   cout = UNIFORM_COLOR;\n"
     " }\n"
 		"	fragColor = cout;\n"
+		"	fragNormal = gbuffer_normal(normal.xyz, normal.w);\n"
+		"	fragPosition = position;\n"
     "}\n"
 	);
 	//As you can see above, adjacent strings in C/C++ are concatenated.
@@ -71,6 +103,9 @@ FlatProgram::FlatProgram() {
 	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
 	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
 	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	OBJECT_TO_WORLD_mat4 = glGetUniformLocation(program, "OBJECT_TO_WORLD");
+	OBJECT_SMOOTH_ID_float = glGetUniformLocation(program, "OBJECT_SMOOTH_ID");
+	COMPACT_GBUFFER_uint = glGetUniformLocation(program, "COMPACT_GBUFFER");
 
   USE_TEX_uint = glGetUniformLocation(program, "USE_TEX");
   UNIFORM_COLOR_vec4 = glGetUniformLocation(program, "UNIFORM_COLOR");
@@ -161,6 +196,123 @@ OutlineProgram0::~OutlineProgram0() {
 ==========================================================================
 */
 
+Load< FlatInstancedProgram > flat_instanced_program(LoadTagEarly);
+
+FlatInstancedProgram::FlatInstancedProgram() {
+	//Same outputs as FlatProgram's USE_VX_COLORS path, but with per-instance transforms:
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"uniform mat4 WORLD_TO_CLIP;\n"
+		"in vec4 Position;\n"
+		"in vec3 Normal;\n"
+		"in vec4 Color;\n"
+		"in mat4 InstanceToWorld;\n"
+		"in vec4 InstanceColor;\n"
+		"in float InstanceSmoothId;\n"
+		"out vec4 color;\n"
+		"out vec4 normal;\n"
+		"out vec4 position;\n"
+		"void main() {\n"
+		"	color = Color * InstanceColor;\n"
+		"	normal.xyz = (InstanceToWorld * vec4(Normal, 0.0)).xyz;\n"
+		"	normal.w = InstanceSmoothId;\n"
+		"	position = InstanceToWorld * Position;\n"
+		"	position.w = 1.0;\n"
+		"	gl_Position = WORLD_TO_CLIP * position;\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330\n"
+		"in vec4 color;\n"
+		"in vec4 normal;\n"
+		"in vec4 position;\n"
+		"layout(location=0) out vec4 fragColor;\n"
+		"layout(location=1) out vec4 fragNormal;\n"
+		"layout(location=2) out vec4 fragPosition;\n"
+		GBUFFER_NORMAL_OUTPUT
+		"void main() {\n"
+		"	fragColor = color;\n"
+		"	fragNormal = gbuffer_normal(normal.xyz, normal.w);\n"
+		"	fragPosition = position;\n"
+		"}\n"
+	);
+
+	//look up the locations of vertex attributes:
+	Position_vec4 = glGetAttribLocation(program, "Position");
+	Color_vec4 = glGetAttribLocation(program, "Color");
+	InstanceToWorld_mat4 = glGetAttribLocation(program, "InstanceToWorld");
+	InstanceColor_vec4 = glGetAttribLocation(program, "InstanceColor");
+	InstanceSmoothId_float = glGetAttribLocation(program, "InstanceSmoothId");
+
+	//look up the locations of uniforms:
+	WORLD_TO_CLIP_mat4 = glGetUniformLocation(program, "WORLD_TO_CLIP");
+	COMPACT_GBUFFER_uint = glGetUniformLocation(program, "COMPACT_GBUFFER");
+}
+
+FlatInstancedProgram::~FlatInstancedProgram() {
+	glDeleteProgram(program);
+	program = 0;
+}
+
+/*
+==========================================================================
+*/
+
+Load< OutlineInstancedProgram0 > outline_instanced_program_0(LoadTagEarly);
+
+OutlineInstancedProgram0::OutlineInstancedProgram0() {
+	//Same output as OutlineProgram0, but with per-instance transforms and smooth ids:
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"uniform mat4 WORLD_TO_CLIP;\n"
+		"in vec4 Position;\n"
+		"in vec3 Normal;\n"
+		"in mat4 InstanceToWorld;\n"
+		"in float InstanceSmoothId;\n"
+		"out vec4 normal;\n"
+		"out vec4 position;\n"
+		"void main() {\n"
+		"	normal.xyz = (InstanceToWorld * vec4(Normal, 0.0)).xyz;\n"
+		"	normal.w = InstanceSmoothId;\n"
+		"	position = InstanceToWorld * Position;\n"
+		"	position.w = 1.0;\n"
+		"	gl_Position = WORLD_TO_CLIP * position;\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330\n"
+		"in vec4 normal;\n"
+		"in vec4 position;\n"
+		"layout(location = 0) out vec4 fragNormal;\n"
+		"layout(location = 1) out vec4 fragPosition;\n"
+		"void main() {\n"
+		"	fragNormal.xyz = normalize(normal.xyz);\n"
+		"	fragNormal.w = normal.w;\n"
+		"	fragPosition = position;\n"
+		"}\n"
+	);
+
+	//look up the locations of vertex attributes:
+	Position_vec4 = glGetAttribLocation(program, "Position");
+	Normal_vec3 = glGetAttribLocation(program, "Normal");
+	InstanceToWorld_mat4 = glGetAttribLocation(program, "InstanceToWorld");
+	InstanceSmoothId_float = glGetAttribLocation(program, "InstanceSmoothId");
+
+	//look up the locations of uniforms:
+	WORLD_TO_CLIP_mat4 = glGetUniformLocation(program, "WORLD_TO_CLIP");
+}
+
+OutlineInstancedProgram0::~OutlineInstancedProgram0() {
+	glDeleteProgram(program);
+	program = 0;
+}
+
+/*
+==========================================================================
+*/
+
 GLuint vao_empty = 0;
 
 Load< void > init_vao_empty(LoadTagEarly, [](){
@@ -168,8 +320,43 @@ Load< void > init_vao_empty(LoadTagEarly, [](){
 });
 
 Load< OutlineProgram1 > outline_program_1(LoadTagEarly);
+Load< OutlineProgram1 > outline_program_1_compact(LoadTagEarly, []() -> OutlineProgram1 const * {
+	return new OutlineProgram1(true);
+});
+
+OutlineProgram1::OutlineProgram1(bool compact_) : compact(compact_) {
+	//The two G-buffer layouts differ only in how normals and positions are fetched:
+	std::string fetch;
+	if (compact) {
+		fetch =
+		"uniform sampler2DRect DEPTH_TEX;\n"
+		"uniform mat4 CLIP_TO_WORLD;\n"
+		"vec4 fetch_normal(ivec2 at) {\n"
+		"	vec4 e = texelFetch(NORMAL_TEX, at);\n"
+		"	float sid = round(e.z * 1023.0) / 2.0;\n"
+		"	if (e.w < 0.5) return vec4(0.0, 0.0, 0.0, sid);\n"
+		"	vec2 f = e.xy * 2.0 - 1.0;\n"
+		"	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));\n"
+		"	float t = max(-n.z, 0.0);\n"
+		"	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);\n"
+		"	return vec4(normalize(n), sid);\n"
+		"}\n"
+		"vec4 fetch_position(ivec2 at) {\n"
+		"	float d = texelFetch(DEPTH_TEX, at).r;\n"
+		"	if (d == 1.0) return vec4(0.0);\n" //background, same as the cleared position target
+		"	vec2 ndc = (vec2(at) + 0.5) / vec2(textureSize(DEPTH_TEX)) * 2.0 - 1.0;\n"
+		"	vec4 p = CLIP_TO_WORLD * vec4(ndc, d * 2.0 - 1.0, 1.0);\n"
+		"	return vec4(p.xyz / p.w, 1.0);\n"
+		"}\n"
+		;
+	} else {
+		fetch =
+		"uniform sampler2DRect POSITION_TEX;\n"
+		"vec4 fetch_normal(ivec2 at) { return texelFetch(NORMAL_TEX, at); }\n"
+		"vec4 fetch_position(ivec2 at) { return texelFetch(POSITION_TEX, at); }\n"
+		;
+	}
 
-OutlineProgram1::OutlineProgram1() {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
@@ -183,27 +370,27 @@ OutlineProgram1::OutlineProgram1() {
     "uniform vec3 EYE;\n"
 		"uniform sampler2DRect COLOR_TEX;\n"
 		"uniform sampler2DRect NORMAL_TEX;\n"
-		"uniform sampler2DRect POSITION_TEX;\n"
+		+ fetch +
 		"layout(location=0) out vec4 fragColor;\n"
 		"void main() {\n"
     " ivec2 pos = ivec2(gl_FragCoord);\n"
-    " vec4 n_sid = texelFetch(NORMAL_TEX, ivec2(pos.x, pos.y));\n"
+    " vec4 n_sid = fetch_normal(ivec2(pos.x, pos.y));\n"
     " vec3 n = n_sid.xyz;\n"
     " float sid = n_sid.w;\n"
-    " vec4 p_bg = texelFetch(POSITION_TEX, ivec2(pos.x, pos.y));\n"
+    " vec4 p_bg = fetch_position(ivec2(pos.x, pos.y));\n"
     " vec3 p = p_bg.xyz;\n"
     " float bg = p_bg.w;\n"
     " float dist2 = dot(p.xyz - EYE, p.xyz - EYE);\n"
     " float off = 1.0;\n"
     // " if (sid == 0.0) off = floor(5.0 / (sqrt(dist2) + 1.0) + 1.0);\n"
-    " vec4 nx0 = texelFetch(NORMAL_TEX, ivec2(pos.x - off, pos.y));\n"
-    " vec4 nx1 = texelFetch(NORMAL_TEX, ivec2(pos.x + off, pos.y));\n"
-    " vec4 ny0 = texelFetch(NORMAL_TEX, ivec2(pos.x, pos.y - off));\n"
-    " vec4 ny1 = texelFetch(NORMAL_TEX, ivec2(pos.x, pos.y + off));\n"
-    " vec4 px0 = texelFetch(POSITION_TEX, ivec2(pos.x - off, pos.y));\n"
-    " vec4 px1 = texelFetch(POSITION_TEX, ivec2(pos.x + off, pos.y));\n"
-    " vec4 py0 = texelFetch(POSITION_TEX, ivec2(pos.x, pos.y - off));\n"
-    " vec4 py1 = texelFetch(POSITION_TEX, ivec2(pos.x, pos.y + off));\n"
+    " vec4 nx0 = fetch_normal(ivec2(pos.x - off, pos.y));\n"
+    " vec4 nx1 = fetch_normal(ivec2(pos.x + off, pos.y));\n"
+    " vec4 ny0 = fetch_normal(ivec2(pos.x, pos.y - off));\n"
+    " vec4 ny1 = fetch_normal(ivec2(pos.x, pos.y + off));\n"
+    " vec4 px0 = fetch_position(ivec2(pos.x - off, pos.y));\n"
+    " vec4 px1 = fetch_position(ivec2(pos.x + off, pos.y));\n"
+    " vec4 py0 = fetch_position(ivec2(pos.x, pos.y - off));\n"
+    " vec4 py1 = fetch_position(ivec2(pos.x, pos.y + off));\n"
     " vec4 cin = texelFetch(COLOR_TEX, pos);\n"
     " vec4 cout = vec4(0.0, 0.0, 0.0, 1.0);\n"
     " float dpx0 = dot(px0.xyz - p, n);\n"
@@ -232,16 +419,17 @@ OutlineProgram1::OutlineProgram1() {
 	);
 
   EYE_vec3 = glGetUniformLocation(program, "EYE");
+  CLIP_TO_WORLD_mat4 = glGetUniformLocation(program, "CLIP_TO_WORLD");
 
 	GLuint COLOR_TEX_sampler2D = glGetUniformLocation(program, "COLOR_TEX");
   GLuint NORMAL_TEX_sampler2D = glGetUniformLocation(program, "NORMAL_TEX");
-  GLuint POSITION_TEX_sampler2D = glGetUniformLocation(program, "POSITION_TEX");
+  GLuint POSITION_TEX_sampler2D = glGetUniformLocation(program, (compact ? "DEPTH_TEX" : "POSITION_TEX"));
 
 	//set TEX to always refer to texture binding zero:
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 	glUniform1i(COLOR_TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
   glUniform1i(NORMAL_TEX_sampler2D, 1); //set TEX to sample from GL_TEXTURE1
-  glUniform1i(POSITION_TEX_sampler2D, 2); //set TEX to sample from GL_TEXTURE2
+  glUniform1i(POSITION_TEX_sampler2D, 2); //set TEX to sample from GL_TEXTURE2 (depth, when compact)
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
 
@@ -20,6 +20,9 @@ struct FlatProgram{
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	GLuint OBJECT_TO_WORLD_mat4 = -1U;
+	GLuint OBJECT_SMOOTH_ID_float = -1U;
+	GLuint COMPACT_GBUFFER_uint = -1U; //normal encoding for location 1 (see OutlineProgram1)
   GLuint USE_TEX_uint = -1U;
   GLuint UNIFORM_COLOR_vec4 = -1U;
 
@@ -29,6 +32,13 @@ struct FlatProgram{
     USE_COL = 2
   };
 
+	//Outputs:
+	// location 0 - color
+	// location 1 - world normal + smooth id (same as OutlineProgram0's location 0)
+	// location 2 - world position (same as OutlineProgram0's location 1)
+	// so a framebuffer with all three attached gets the whole G-buffer in one pass;
+	// with only attachment 0 bound, it is a plain color pass.
+
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
 };
@@ -55,19 +65,67 @@ struct OutlineProgram0{
 	//TEXTURE0 - texture that is accessed by TexCoord
 };
 
+//Instanced variants of the two programs above, used for static level geometry.
+// Per-instance attributes replace the per-object uniforms:
+//  InstanceToWorld (mat4, four attribute slots), InstanceColor (multiplies vertex color), InstanceSmoothId
+struct FlatInstancedProgram {
+	FlatInstancedProgram();
+	~FlatInstancedProgram();
+
+	GLuint program = 0;
+
+	//Attribute (per-vertex variable) locations:
+	GLuint Position_vec4 = -1U;
+	GLuint Color_vec4 = -1U;
+
+	//Attribute (per-instance variable) locations:
+	GLuint InstanceToWorld_mat4 = -1U;
+	GLuint InstanceColor_vec4 = -1U;
+	GLuint InstanceSmoothId_float = -1U;
+
+	//Uniform (per-invocation variable) locations:
+	GLuint WORLD_TO_CLIP_mat4 = -1U;
+	GLuint COMPACT_GBUFFER_uint = -1U;
+};
+
+struct OutlineInstancedProgram0 {
+	OutlineInstancedProgram0();
+	~OutlineInstancedProgram0();
+
+	GLuint program = 0;
+
+	//Attribute (per-vertex variable) locations:
+	GLuint Position_vec4 = -1U;
+	GLuint Normal_vec3 = -1U;
+
+	//Attribute (per-instance variable) locations:
+	GLuint InstanceToWorld_mat4 = -1U;
+	GLuint InstanceSmoothId_float = -1U;
+
+	//Uniform (per-invocation variable) locations:
+	GLuint WORLD_TO_CLIP_mat4 = -1U;
+};
+
 struct OutlineProgram1 {
-	OutlineProgram1();
+	//compact => reads octahedral 10:10:10:2 normals from TEXTURE1 and rebuilds
+	// world positions from the depth texture in TEXTURE2 using CLIP_TO_WORLD:
+	OutlineProgram1(bool compact = false);
 	~OutlineProgram1();
 
   GLuint EYE_vec3 = -1U;
+  GLuint CLIP_TO_WORLD_mat4 = -1U; //(compact only)
 
 	GLuint program = 0;
+	bool compact = false;
 
 };
 
 extern Load< FlatProgram > flat_program;
 extern Load< OutlineProgram0 > outline_program_0;
 extern Load< OutlineProgram1 > outline_program_1;
+extern Load< OutlineProgram1 > outline_program_1_compact;
+extern Load< FlatInstancedProgram > flat_instanced_program;
+extern Load< OutlineInstancedProgram0 > outline_instanced_program_0;
 extern GLuint vao_empty;
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+//Player movement constants, shared by the game modes and the headless server:
+struct Physics {
+  // fixed simulation rate
+  static constexpr uint32_t tick_rate = 120;
+  static constexpr float tick = 1.0f / float(tick_rate);
+
+  // max speed for ground movement / walking
+  static constexpr float player_move_max_speed = 15.0f;
+  // interpolation half-life for ground movement
+  static constexpr float player_move_halflife = 0.02f;
+
+  // sprinting ground movement multiplier
+  static constexpr float player_sprint_multiplier = 2.0f;
+
+  // max speed for air movement
+  static constexpr float player_air_move_max_speed = 5.0f;
+  // interpolation half-life for air movement
+  static constexpr float player_air_move_halflife = 0.1f;
+
+  // Cosine of the max angle of the surface with respect to the horizontal
+  // plane that will reset jumping for the player.
+  static constexpr float player_jumpable_reset_angle_cos = 0.1f;
+
+  // gravitational acceleration vector
+  static constexpr glm::vec3 gravity = glm::vec3(0.0f, 0.0f, -100.0f);
+
+  // jumping force, in seconds (time from jumping start to peak height)
+  static constexpr float player_jump_sec = 0.3f;
+
+  // fastest a body can plausibly move sideways or up (sprinting, jumping, riding a movable), with
+  // some margin -- the dedicated server corrects faster moves (falling is never limited)
+  static constexpr float player_plausible_speed = 150.0f;
+};
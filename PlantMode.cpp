@@ -53,16 +53,15 @@ PlantMode::PlantMode() {
 		tile_info.vao = *plant_meshes_for_lit_color_texture_program;
 		tile_info.start = plant_tile->start;
 		tile_info.count = plant_tile->count;
+		tile_info.index_type = plant_tile->index_type;
 
 		for (int32_t x = -5; x <= 5; ++x) {
 			for (int32_t y = -5; y <= 5; ++y) {
-				scene.transforms.emplace_back();
-				Scene::Transform *transform = &scene.transforms.back();
+				Scene::Transform *transform = scene.add_transform();
 				transform->name = "Tile-" + std::to_string(x) + "," + std::to_string(y); //<-- no reason to do this, we don't have scene debugger or anything
 				transform->position = glm::vec3(2.0f*x, 2.0f*y, 0.0f);
 
-				scene.drawables.emplace_back(transform);
-				Scene::Drawable *tile = &scene.drawables.back();
+				Scene::Drawable *tile = scene.add_drawable(transform);
 				tile->pipeline = tile_info;
 			}
 		}
@@ -91,11 +90,9 @@ PlantMode::PlantMode() {
 				player->set_uniform(bone_lit_color_texture_program->BONES_mat4x3_array);
 			};
 
-			scene.transforms.emplace_back();
-			Scene::Transform *transform = &scene.transforms.back();
+			Scene::Transform *transform = scene.add_transform();
 			transform->position.x = x * 2.5f;
-			scene.drawables.emplace_back(transform);
-			Scene::Drawable *plant = &scene.drawables.back();
+			Scene::Drawable *plant = scene.add_drawable(transform);
 			plant->pipeline = plant_info;
 
 			if (x == 0) this->plant = plant;
@@ -104,16 +101,14 @@ PlantMode::PlantMode() {
 	}
 
 	{ //make a camera:
-		scene.transforms.emplace_back();
-		Scene::Transform *transform = &scene.transforms.back();
+		Scene::Transform *transform = scene.add_transform();
 		transform->position = glm::vec3(0.0f, -10.0f, 3.0f);
 		transform->rotation = glm::quat_cast(glm::mat3(glm::lookAt(
 			transform->position,
 			glm::vec3(0.0f, 0.0f, 0.0f),
 			glm::vec3(0.0f, 0.0f, 1.0f)
 		)));
-		scene.cameras.emplace_back(transform);
-		camera = &scene.cameras.back();
+		camera = scene.add_camera(transform);
 		camera->near = 0.01f;
 		camera->fovy = glm::radians(45.0f);
 	}
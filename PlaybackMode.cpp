@@ -0,0 +1,154 @@
+#include "PlaybackMode.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+PlaybackMode::PlaybackMode(Recording const &recording_, bool parse_only_)
+  : PlayerMode(recording_.level, recording_.player), recording(recording_), parse_only(parse_only_) {
+
+  //keep the snapshots and acks we send, to compare with the recording:
+  link.on_send = [this](void const *data, size_t size, bool) {
+    char const *bytes = reinterpret_cast< char const * >(data);
+    if (size && (bytes[0] == 'S' || bytes[0] == 'K')) sent_now.emplace_back(bytes, bytes + size);
+  };
+
+}
+
+void PlaybackMode::run() {
+  auto before = std::chrono::steady_clock::now();
+
+  //records are grouped by frame: a 'f' record, then what was received and sent during that frame:
+  Recording::Cursor cursor;
+  Recording::Record record;
+  Recording::Record frame;
+  bool have_frame = false;
+  auto flush = [&]() {
+    if (have_frame) play_frame(frame);
+    have_frame = false;
+    opens = false;
+    received.clear();
+    sent_then.clear();
+  };
+  uint64_t duration = 0;
+  while (recording.next(&cursor, &record)) {
+    duration = record.time;
+    if (record.kind == 'f') {
+      flush();
+      frame = record;
+      have_frame = true;
+    } else if (record.kind == 'i') {
+      if (have_frame) received.emplace_back(record);
+    } else if (record.kind == 'o' || record.kind == 'p') {
+      if (record.length == 0) continue;
+      char type = record.payload[0];
+      if (type == 'H') {
+        //hello: sent when the connection opened (ClientMode, before the first frame; ServerMode, once the peer connects):
+        if (have_frame) opens = true;
+        else connect = &link;
+      } else if (have_frame && (type == 'S' || type == 'K')) {
+        sent_then.emplace_back(record.payload, record.payload + record.length);
+      }
+    } else if (record.kind == 'l') {
+      flush();
+      if (record.length == 1) level_change(uint8_t(record.payload[0]));
+    } else {
+      //(kinds from a newer recorder are skipped)
+    }
+  }
+  flush();
+
+  double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+  double recorded = double(duration) * 1e-6;
+  std::cout << "Played " << stats.frames << " frames (" << recorded << " s recorded) in " << seconds << " s"
+            << " (" << (seconds > 0.0 ? recorded / seconds : 0.0) << "x real time)." << std::endl;
+  std::cout << "Parsed " << net_stats.messages_received << " messages (" << stats.received_bytes << " bytes in "
+            << stats.received << " receives) in " << stats.parse_seconds << " s: "
+            << (stats.parse_seconds > 0.0 ? double(net_stats.messages_received) / stats.parse_seconds : 0.0) << " messages/s, "
+            << (stats.parse_seconds > 0.0 ? double(stats.received_bytes) / stats.parse_seconds / (1024.0 * 1024.0) : 0.0) << " MB/s." << std::endl;
+  if (!parse_only) {
+    if (stats.mismatched_frames) {
+      std::cout << "Snapshots/acks differ from the recording in " << stats.mismatched_frames << " frames (first: frame "
+                << stats.first_mismatch << ")." << std::endl;
+    } else {
+      std::cout << "Snapshots/acks match the recording." << std::endl;
+    }
+    std::cout << "Final state hash " << std::hex << simulation_hash() << std::dec << " (step " << simulation.steps << ")." << std::endl;
+  }
+}
+
+void PlaybackMode::play_frame(Recording::Record const &frame) {
+  //f32 elapsed, u16 controls, f32 azimuth, f32 elevation:
+  if (frame.length != 4 + 2 + 4 + 4) return;
+  auto u32_at = [&frame](size_t i) {
+    uint32_t value = 0;
+    for (uint32_t b = 0; b < 4; ++b) value |= uint32_t(uint8_t(frame.payload[i + b])) << (8 * b);
+    return value;
+  };
+  auto f32_at = [&u32_at](size_t i) {
+    uint32_t bits = u32_at(i);
+    float value;
+    std::memcpy(&value, &bits, 4);
+    return value;
+  };
+  float elapsed = f32_at(0);
+  uint16_t bits = uint16_t(uint8_t(frame.payload[4]) | (uint8_t(frame.payload[5]) << 8));
+  stats.frames += 1;
+
+  controls.forward = (bits & Recorder::Forward) != 0;
+  controls.backward = (bits & Recorder::Backward) != 0;
+  controls.left = (bits & Recorder::Left) != 0;
+  controls.right = (bits & Recorder::Right) != 0;
+  controls.sprint = (bits & Recorder::Sprint) != 0;
+  controls.jump = (bits & Recorder::Jump) != 0;
+  controls_shift.flat = (bits & Recorder::Flat) != 0;
+  pause = (bits & Recorder::Pause) != 0;
+  if ((bits & Recorder::WantReset) && !we_want_reset) {
+    //(as handle_reset() did)
+    we_want_reset = true;
+    reset_countdown = 0.01f;
+  }
+  pov.azimuth = f32_at(6);
+  pov.elevation = f32_at(10);
+
+  sent_now.clear();
+  if (parse_only) {
+    feed();
+    return;
+  }
+  update(elapsed);
+
+  if (sent_now != sent_then) {
+    stats.mismatched_frames += 1;
+    if (stats.first_mismatch == 0) stats.first_mismatch = stats.frames;
+  }
+}
+
+void PlaybackMode::update_network() {
+  update_send();
+  if (opens && !connect) {
+    connect = &link;
+    peer_hello = false;
+  }
+  feed();
+}
+
+void PlaybackMode::feed() {
+  for (auto const &record : received) {
+    size_t at = 0;
+    uint64_t reliable = 0;
+    if (!read_varint(record.payload, record.length, &at, &reliable) || reliable > record.length - at) {
+      std::cout << "Skipping malformed 'i' record." << std::endl;
+      continue;
+    }
+    link.recv_buffer.push(record.payload + at, size_t(reliable));
+    at += size_t(reliable);
+    link.unreliable_recv_buffer.push(record.payload + at, record.length - at);
+
+    stats.received += 1;
+    stats.received_bytes += record.length - (at - size_t(reliable));
+    auto before = std::chrono::steady_clock::now();
+    update_recv(&link);
+    stats.parse_seconds += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "PlayerMode.hpp"
+#include "Recording.hpp"
+
+#include <vector>
+
+//Plays a recorded session (see Recording.hpp) back through PlayerMode -- headless, and
+// as fast as it will go -- then reports how long that took and whether our snapshots
+// and acks came out the same as they were sent at the time:
+struct PlaybackMode : PlayerMode {
+
+  //'parse_only' skips the simulation and just feeds received bytes to update_recv() (a parser benchmark):
+  PlaybackMode(Recording const &recording, bool parse_only);
+
+  void handle_reset() override { }
+
+  //sends into 'link', and hands it the frame's received bytes:
+  void update_network() override;
+
+  //play the whole recording, then print the results:
+  void run();
+
+  Recording const &recording;
+  bool parse_only = false;
+  Connection link; //(stands in for the connection; never opened)
+
+  //the frame being played:
+  bool opens = false; //(the connection opened during it -- e.g. ServerMode's peer connected)
+  std::vector< Recording::Record > received;
+  std::vector< std::vector< char > > sent_then; //'S' and 'K' messages, as recorded...
+  std::vector< std::vector< char > > sent_now; //...and as sent during playback
+  void play_frame(Recording::Record const &frame);
+  //hand the frame's received bytes to update_recv():
+  void feed();
+
+  struct {
+    uint64_t frames = 0;
+    uint64_t received = 0; //update_recv() calls
+    uint64_t received_bytes = 0;
+    uint64_t mismatched_frames = 0; //frames whose snapshots or acks differ from the recording
+    uint64_t first_mismatch = 0; //(frame number, counting from 1)
+    double parse_seconds = 0.0; //time spent in update_recv()
+  } stats;
+};
@@ -2,6 +2,8 @@
 #include "demo_menu.hpp"
 #include "collide.hpp"
 #include "data_path.hpp"
+#include <cassert>
+#include <cmath>
 #include <iostream>
 #include <algorithm>
 
@@ -11,15 +13,37 @@ extern void print_mat4(glm::mat4 const &M);
 template< class X >
 extern void print_vec4(X const& v);
 
+PlayerMode::Transport PlayerMode::transport;
+bool PlayerMode::headless = false;
+
 PlayerMode::PlayerMode(uint32_t level_num_, uint32_t player_num_)
 : player_num(player_num_) {
   level_change(level_num_);
-  SDL_SetRelativeMouseMode(SDL_TRUE);
+  if (!headless) SDL_SetRelativeMouseMode(SDL_TRUE);
 }
 
 PlayerMode::~PlayerMode(){
-  SDL_SetRelativeMouseMode(SDL_FALSE);
+  if (recorder) {
+    std::cout << "Recorded " << recorder->records << " records (" << recorder->bytes << " bytes) to '" << transport.record_path << "'." << std::endl;
+  }
+  if (!headless) SDL_SetRelativeMouseMode(SDL_FALSE);
   delete level;
+  //(any loads still running -- in 'loading', 'prefetch', or 'abandoned' -- are waited for as their futures are destroyed)
+}
+
+void PlayerMode::start_recording() {
+  if (transport.record_path.empty()) return;
+  recorder.reset(new Recorder(transport.record_path, level_num, player_num));
+  std::cout << "Recording session to '" << transport.record_path << "'." << std::endl;
+}
+
+void PlayerMode::record_connection(Connection *connection) {
+  recv_recorded = 0;
+  if (!recorder || !connection) return;
+  Recorder *r = recorder.get();
+  connection->on_send = [r](void const *data, size_t size, bool unreliable) {
+    r->sent(data, size, unreliable);
+  };
 }
 
 bool PlayerMode::handle_ui(SDL_Event const &evt, glm::uvec2 const &window_size) {
@@ -29,22 +53,125 @@ bool PlayerMode::handle_ui(SDL_Event const &evt, glm::uvec2 const &window_size)
     pause = !pause;
     if (pause) SDL_SetRelativeMouseMode(SDL_FALSE);
     else SDL_SetRelativeMouseMode(SDL_TRUE);
+  } else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F2) {
+    GameLevel::render_options.single_pass = !GameLevel::render_options.single_pass;
+    std::cout << "G-buffer: " << (GameLevel::render_options.single_pass ? "single pass" : "two passes") << std::endl;
+  } else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F3) {
+    GameLevel::render_options.compact = !GameLevel::render_options.compact;
+    std::cout << "G-buffer: " << (GameLevel::render_options.compact ? "compact" : "full") << std::endl;
+  } else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F4) {
+    GameLevel::render_options.diff_compact = true;
+  } else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F5) {
+    //(compare with the final hash PlaybackMode prints for this session's recording)
+    std::cout << "Simulation: step " << simulation.steps << ", state hash " << std::hex << simulation_hash() << std::dec << std::endl;
+  } else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F6) {
+    if (net_stats.sends) {
+      std::cout << "Network: " << net_stats.sends << " updates sent, "
+                << double(net_stats.bytes_sent) / net_stats.sends << " bytes/update (raw structs: "
+                << double(net_stats.raw_bytes) / net_stats.sends << "); "
+                << net_stats.bytes_received << " bytes received" << std::endl;
+      std::cout << "Prediction: " << net_stats.corrections << " corrections, "
+                << net_stats.replayed_steps << " steps replayed; interpolation ("
+                << transport.interpolation_delay * 1000.0 << " ms behind): "
+                << remote_body.stats.samples << " samples (" << remote_body.stats.late << " late), "
+                << remote_body.stats.interpolated << " frames interpolated, "
+                << remote_body.stats.extrapolated << " extrapolated, "
+                << remote_body.stats.held << " held" << std::endl;
+    } else {
+      std::cout << "Network: nothing sent yet." << std::endl;
+    }
   } else return false;
 
   return true;
 }
 
 void PlayerMode::level_change(uint32_t level_num_) {
+  if (loading.level_num == level_num_) return; //(already on its way)
+
+  if (prefetch.level_num == level_num_) {
+    std::cout << "Using prefetched level " << level_num_ << std::endl;
+    abandon_load(&loading);
+    loading = std::move(prefetch);
+    prefetch = LevelLoad();
+  } else {
+    start_load(&loading, level_num_);
+  }
+  loading.asked = std::chrono::steady_clock::now();
+
+  //with no level to hold on to (or when headless, where nothing should wait a frame), wait for it:
+  finish_level_change(!level || headless);
+}
+
+void PlayerMode::abandon_load(LevelLoad *load) {
+  assert(load);
+  if (load->level.valid()) {
+    std::cout << "Abandoning load of level " << load->level_num << std::endl;
+    abandoned.emplace_back(std::move(load->level));
+  }
+  *load = LevelLoad();
+}
+
+void PlayerMode::reap_abandoned() {
+  for (auto f = abandoned.begin(); f != abandoned.end(); ) {
+    //(deferred -- i.e., headless -- loads never started, so dropping them costs nothing)
+    if (f->wait_for(std::chrono::seconds(0)) == std::future_status::timeout) {
+      ++f;
+      continue;
+    }
+    try {
+      f->get(); //(the level, never uploaded, is deleted right here)
+    } catch (std::exception const &e) {
+      std::cout << "(abandoned level load failed: " << e.what() << ")" << std::endl;
+    }
+    f = abandoned.erase(f);
+  }
+}
+
+void PlayerMode::start_load(LevelLoad *load, uint32_t level_num_) {
+  assert(load);
+  abandon_load(load);
+  std::string level_str ("level");
+  level_str = level_str + std::to_string(level_num_);
+  std::cout << "Loading level " << level_num_ << std::endl;
+
+  //headless loads are run by finish_level_change() itself (on this thread, so playback stays repeatable):
+  bool defer_upload = !headless;
+  load->level_num = level_num_;
+  load->level = std::async(headless ? std::launch::deferred : std::launch::async, [level_str, defer_upload](){
+    return std::unique_ptr< GameLevel >(new GameLevel(data_path(level_str), headless, defer_upload));
+  });
+}
+
+bool PlayerMode::finish_level_change(bool wait) {
+  reap_abandoned();
+  if (loading.level_num == 0) return true;
+  if (!wait && loading.level.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+
+  std::unique_ptr< GameLevel > loaded = loading.level.get(); //(throws if the load did)
+  auto ready = std::chrono::steady_clock::now();
+  if (!headless) loaded->upload();
+  auto uploaded = std::chrono::steady_clock::now();
+  std::cout << "Level " << loading.level_num << " ready after "
+            << std::chrono::duration< double, std::milli >(ready - loading.asked).count() << " ms (then "
+            << std::chrono::duration< double, std::milli >(uploaded - ready).count() << " ms uploading; peak RSS "
+            << (peak_rss_bytes() / 1024) << " KiB)" << std::endl;
+
   std::cout << "Deleting old level" << std::endl;
   if (level) delete level;
+  level = loaded.release();
+  level_num = loading.level_num;
+  loading = LevelLoad();
 
-  level_num = level_num_;
-  std::string level_str ("level");
-  level_str = level_str + std::to_string(level_num);
-  std::cout << "Loading new level" << std::endl;
-  level = new GameLevel(data_path(level_str));
+  if (recorder) recorder->level(level_num);
   player_set();
   level_reset();
+  level_loaded();
+
+  //get the next level ready while this one is played:
+  uint32_t next = (level_num == level_count ? 1 : level_num + 1);
+  if (!headless && prefetch.level_num != next) start_load(&prefetch, next);
+
+  return true;
 }
 
 void PlayerMode::level_reset() {
@@ -65,6 +192,17 @@ void PlayerMode::level_reset() {
   currently_moving.clear();
   pov.on_movable = nullptr;
 
+  //the level was reloaded, so the peer (and we) need everything again:
+  owned_movables.clear();
+  replicator.reset_sent();
+  replicator.reset_applied();
+  reset_remote();
+  input_history.clear();
+
+  simulation.accumulator = 0.0f;
+  simulation.steps = 0;
+  simulation.level = nullptr;
+
 }
 
 void PlayerMode::player_set() {
@@ -140,7 +278,26 @@ bool PlayerMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_siz
 }
 
 void PlayerMode::update(float elapsed) {
+  //hold everything (the old level stays on screen) until the next level is in:
+  // (before recording, so playback never sees these frames)
+  if (!finish_level_change(false)) return;
+
+  if (recorder) {
+    uint16_t bits = 0;
+    if (controls.forward) bits |= Recorder::Forward;
+    if (controls.backward) bits |= Recorder::Backward;
+    if (controls.left) bits |= Recorder::Left;
+    if (controls.right) bits |= Recorder::Right;
+    if (controls.sprint) bits |= Recorder::Sprint;
+    if (controls.jump) bits |= Recorder::Jump;
+    if (controls_shift.flat) bits |= Recorder::Flat;
+    if (we_want_reset) bits |= Recorder::WantReset;
+    if (pause) bits |= Recorder::Pause;
+    recorder->frame(elapsed, bits, pov.azimuth, pov.elevation);
+  }
+
   if (pause) return;
+  local_time += elapsed;
   we_reached_goal = level->detect_goal(player_num);
   if (!won && level->detect_win()) {
     won = true;
@@ -152,13 +309,141 @@ void PlayerMode::update(float elapsed) {
 
   update_reset_timer(elapsed);
   update_shift(elapsed);
+  update_simulation(elapsed);
   if (shift.progress == 0.0f) {
-    update_me_move(elapsed);
+    update_look();
   }
-  update_movables_move(elapsed);
 
   update_network();
+  update_remote();
+
+}
+
+void PlayerMode::update_step(float tick) {
+  InputCommand input;
+  input.tick = ++input_tick;
+  input.moved = (shift.progress == 0.0f);
+  input.forward = controls.forward;
+  input.backward = controls.backward;
+  input.left = controls.left;
+  input.right = controls.right;
+  input.sprint = controls.sprint;
+  input.jump = controls.jump;
+  input.azimuth = pov.azimuth;
+
+  if (input.moved) {
+    update_me_move(tick);
+  }
+  update_movables_move(tick);
+
+  input.position = pov.body->position;
+  input.vel = pov.vel;
+  input.in_air = pov.in_air;
+  input_history.emplace_back(input);
+  if (input_history.size() > InputHistory) input_history.pop_front();
+}
+
+void PlayerMode::reconcile(uint32_t tick, glm::vec3 const &position) {
+  net_stats.corrections += 1;
+  glm::vec3 was = pov.body->position;
+
+  auto at = std::find_if(input_history.begin(), input_history.end(), [tick](InputCommand const &input) {
+    return input.tick == tick;
+  });
+  if (at == input_history.end()) {
+    //(too old to replay from) just go there:
+    pov.body->position = position;
+    pov.vel = glm::vec3(0.0f);
+    input_history.clear();
+    std::cout << "Corrected by server: moved " << glm::length(position - was) << " units." << std::endl;
+    return;
+  }
+
+  //re-run each later step's movement, with the controls as they were then:
+  auto current_controls = controls;
+  float current_azimuth = pov.azimuth;
+  pov.body->position = position;
+  pov.vel = at->vel;
+  pov.in_air = at->in_air;
+  at->position = position;
+  uint32_t replayed = 0;
+  for (auto input = at + 1; input != input_history.end(); ++input) {
+    if (input->moved) {
+      controls.forward = input->forward;
+      controls.backward = input->backward;
+      controls.left = input->left;
+      controls.right = input->right;
+      controls.sprint = input->sprint;
+      controls.jump = input->jump;
+      pov.azimuth = input->azimuth;
+      update_me_move(Physics::tick);
+      ++replayed;
+    }
+    input->position = pov.body->position;
+    input->vel = pov.vel;
+    input->in_air = pov.in_air;
+  }
+  controls = current_controls;
+  pov.azimuth = current_azimuth;
+
+  net_stats.replayed_steps += replayed;
+  std::cout << "Corrected by server: moved " << glm::length(pov.body->position - was) << " units (" << replayed << " steps replayed)." << std::endl;
+}
+
+void PlayerMode::update_simulation(float elapsed) {
+
+  //how many fixed steps does this frame's time cover?
+  uint32_t steps = 0;
+  simulation.accumulator += elapsed;
+  while (simulation.accumulator >= Physics::tick) {
+    simulation.accumulator -= Physics::tick;
+    ++steps;
+  }
+
+  //(re-)gather the transforms that steps move, if the level changed:
+  // (bodies first, then movables in movable_data order -- update_remote() relies on this)
+  if (simulation.level != level) {
+    simulation.level = level;
+    simulation.transforms.clear();
+    simulation.transforms.emplace_back(level->body_P1_transform);
+    simulation.transforms.emplace_back(level->body_P2_transform);
+    for (auto const &m : level->movable_data) {
+      simulation.transforms.emplace_back(m.transform);
+    }
+    simulation.previous.clear();
+    for (auto const *t : simulation.transforms) {
+      simulation.previous.emplace_back(t->position);
+    }
+  }
+
+  for (uint32_t step = 0; step < steps; ++step) {
+    for (uint32_t i = 0; i < simulation.transforms.size(); ++i) {
+      simulation.previous[i] = simulation.transforms[i]->position;
+    }
+    update_step(Physics::tick);
+    ++simulation.steps;
+  }
+
+  simulation.alpha = simulation.accumulator / Physics::tick;
+}
+
+//helper: FNV-1a over some bytes:
+static void hash_bytes(uint64_t &h, void const *data, size_t size) {
+  uint8_t const *bytes = reinterpret_cast< uint8_t const * >(data);
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ bytes[i]) * 0x100000001b3ULL;
+  }
+}
 
+uint64_t PlayerMode::simulation_hash() const {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  hash_bytes(h, &level->body_P1_transform->position, sizeof(glm::vec3));
+  hash_bytes(h, &level->body_P2_transform->position, sizeof(glm::vec3));
+  hash_bytes(h, &pov.vel, sizeof(glm::vec3));
+  for (auto const &m : level->movable_data) {
+    hash_bytes(h, &m.transform->position, sizeof(glm::vec3));
+  }
+  return h;
 }
 
 void PlayerMode::update_shift(float elapsed) {
@@ -315,96 +600,14 @@ void PlayerMode::update_me_move(float elapsed) {
       glm::vec3 sphere_from = pl_pos;
       glm::vec3 sphere_to = pl_pos + pl_vel * remain;
 
-      bool collided = false;
-      float collision_t = 1.0f;
-      glm::vec3 collision_at = glm::vec3(0.0f);
-      glm::vec3 collision_out = glm::vec3(0.0f);
-      bool is_surface_collision = false;
-
-      glm::vec3 sphere_min = glm::min(sphere_from, sphere_to) - glm::vec3(sphere_radius);
-      glm::vec3 sphere_max = glm::max(sphere_from, sphere_to) + glm::vec3(sphere_radius);
-      for (auto const &collider : level->mesh_colliders) {
-        glm::mat4x3 collider_to_world = collider.transform->make_local_to_world();
-
-        { // Early discard:
-          // check if AABB of collider overlaps AABB of swept sphere:
-
-          // (1) compute bounding box of collider in world space:
-          glm::vec3 local_center = 0.5f * (collider.mesh->max + collider.mesh->min);
-          glm::vec3 local_radius = 0.5f * (collider.mesh->max - collider.mesh->min);
-
-          glm::vec3 world_min = collider_to_world * glm::vec4(local_center, 1.0f)
-            - glm::abs(local_radius.x * collider_to_world[0])
-            - glm::abs(local_radius.y * collider_to_world[1])
-            - glm::abs(local_radius.z * collider_to_world[2]);
-          glm::vec3 world_max = collider_to_world * glm::vec4(local_center, 1.0f)
-            + glm::abs(local_radius.x * collider_to_world[0])
-            + glm::abs(local_radius.y * collider_to_world[1])
-            + glm::abs(local_radius.z * collider_to_world[2]);
-
-          // (2) check if bounding boxes overlap:
-          bool can_skip = !collide_AABB_vs_AABB(sphere_min, sphere_max, world_min, world_max);
-
-          // draw to indicate result of check:
-          // if (iter == 0 && DEBUG_draw_lines && DEBUG_show_geometry) {
-          //   DEBUG_draw_lines->draw_box(glm::mat4x3(
-          //     0.5f * (world_max.x - world_min.x), 0.0f, 0.0f,
-          //     0.0f, 0.5f * (world_max.y - world_min.y), 0.0f,
-          //     0.0f, 0.0f, 0.5f * (world_max.z - world_min.z),
-          //     0.5f * (world_max.x+world_min.x), 0.5f * (world_max.y+world_min.y), 0.5f * (world_max.z+world_min.z)
-          //   ), (can_skip ? glm::u8vec4(0x88, 0x88, 0x88, 0xff) : glm::u8vec4(0x88, 0x88, 0x00, 0xff) ) );
-          // }
-
-          if (can_skip) {
-            // AABBs do not overlap; skip detailed check:
-            continue;
-          }
-        }
-
-        // Full (all triangles) test:
-
-        assert(collider.mesh->type == GL_TRIANGLES); //only have code for TRIANGLES not other primitive types
-
-        for (GLuint v = 0; v + 2 < collider.mesh->count; v += 3) {
-          // get vertex positions from associated positions buffer:
-          // (and transform to world space)
-          glm::vec3 a = collider_to_world * glm::vec4(collider.buffer->positions[collider.mesh->start+v+0], 1.0f);
-          glm::vec3 b = collider_to_world * glm::vec4(collider.buffer->positions[collider.mesh->start+v+1], 1.0f);
-          glm::vec3 c = collider_to_world * glm::vec4(collider.buffer->positions[collider.mesh->start+v+2], 1.0f);
-          // check triangle:
-          bool did_collide = collide_swept_sphere_vs_triangle(
-            sphere_from, sphere_to, sphere_radius,
-            a, b, c,
-            &collision_t, &collision_at, &collision_out, &is_surface_collision
-          );
-
-          if (did_collide) {
-            collided = true;
-            if (collider.movable_index >= 0) {
-              pov.on_movable = &level->movable_data[collider.movable_index];
-              pov.on_movable->add_player(pov.body, player_num);
-              //std::cout << "Got player!" << std::endl;
-            }
-          }
-
-          //draw to indicate result of check:
-          // if (iter == 0 && DEBUG_draw_lines) {
-          //   glm::u8vec4 color = (did_collide ? glm::u8vec4(0x88, 0x00, 0x00, 0xff) : glm::u8vec4(0x88, 0x88, 0x00, 0xff));
-          //   if (DEBUG_show_geometry || (did_collide && DEBUG_show_collision)) {
-          //     DEBUG_draw_lines->draw(a,b,color);
-          //     DEBUG_draw_lines->draw(b,c,color);
-          //     DEBUG_draw_lines->draw(c,a,color);
-          //   }
-          //   //do a bit more to highlight colliding triangles (otherwise edges can be over-drawn by non-colliding triangles):
-          //   if (did_collide && DEBUG_show_collision) {
-          //     glm::vec3 m = (a + b + c) / 3.0f;
-          //     DEBUG_draw_lines->draw(glm::mix(a,m,0.1f),glm::mix(b,m,0.1f),color);
-          //     DEBUG_draw_lines->draw(glm::mix(b,m,0.1f),glm::mix(c,m,0.1f),color);
-          //     DEBUG_draw_lines->draw(glm::mix(c,m,0.1f),glm::mix(a,m,0.1f),color);
-          //   }
-          // }
-        }
+      SweptSphereHit hit;
+      bool collided = level->sweep_sphere(sphere_from, sphere_to, sphere_radius, &hit);
+      if (collided && hit.movable_index >= 0) {
+        pov.on_movable = &level->movable_data[hit.movable_index];
+        pov.on_movable->add_player(pov.body, player_num);
       }
+      float collision_t = hit.t;
+      glm::vec3 collision_out = hit.out;
 
       if (!collided) {
         pl_pos = sphere_to;
@@ -470,95 +673,179 @@ void PlayerMode::update_me_move(float elapsed) {
     pov.vel = pl_vel;
   } // end collision compute
 
-    {
-    // body rotation update:
-    glm::quat rot_h = glm::angleAxis(pov.azimuth, glm::vec3(0.0f, 0.0f, 1.0f));
-    pov.body->rotation = rot_h;
-    //camera update:
-    pov.camera->transform->rotation =
-      glm::angleAxis(-pov.elevation + 0.5f * PI, glm::vec3(1.0f, 0.0f, 0.0f));
-    }
-
 }
 
-// Returns -1 for invalid message, 1 for message incomplete, 0 for message read
-int PlayerMode::update_recv_msg(char msg_type, char *buf, size_t buf_len, size_t *used_len) {
+void PlayerMode::update_look() {
+  // body rotation update:
+  glm::quat rot_h = glm::angleAxis(pov.azimuth, glm::vec3(0.0f, 0.0f, 1.0f));
+  pov.body->rotation = rot_h;
+  //camera update:
+  pov.camera->transform->rotation =
+    glm::angleAxis(-pov.elevation + 0.5f * PI, glm::vec3(1.0f, 0.0f, 0.0f));
+}
 
-  size_t msg_size;
-  size_t msg_unit_size;
+// Returns false if the message was malformed or of an unknown type
+bool PlayerMode::update_recv_msg(char msg_type, Protocol::Reader &reader) {
 
   if (msg_type == 'R') {
-    msg_size = 0;
-    //if (buf_len < msg_size) return 1;
-
     they_want_reset = true;
     reset_countdown = 0.01f;
     std::cout << "Received reset" << std::endl;
 
-  } else if (msg_type == 'P') {
-    msg_size = sizeof(glm::vec3) + sizeof(glm::quat);
-    if (buf_len < msg_size) return 1;
-
-    glm::vec3* pos = reinterpret_cast<glm::vec3*> (buf);
-    buf += sizeof(glm::vec3);
-
-    glm::quat* rot = reinterpret_cast<glm::quat*> (buf);
-    buf += sizeof(glm::quat);
-
-    other_player->position = *pos;
-    other_player->rotation = *rot;
-
-  } else if (msg_type == 'C') {
-    play_moving_sound = 1;
-    msg_unit_size = sizeof(size_t) + sizeof(glm::vec3) + sizeof(glm::vec4);
-    size_t* len = reinterpret_cast<size_t*> (buf);
-    msg_size = sizeof(size_t) + *len * msg_unit_size;
-    if (buf_len < msg_size) return 1;
+  } else if (msg_type == 'J') {
+    //join announcement (level, player number) -- the dedicated server sends one when a
+    // new peer takes the other seat, which has none of our snapshots yet:
+    reader.u8();
+    reader.u8();
+    if (!reader.done()) return false;
+    replicator.reset_sent();
+    replicator.reset_received();
+    reset_remote();
+
+  } else if (msg_type == 'S') {
+    SnapshotChanges changes;
+    if (!replicator.receive(reader, &changes)) return false;
+    for (auto const &movable : changes.movables) {
+      if (movable.index >= level->movable_data.size()) return false;
+    }
+    apply(changes);
 
-    //std::cout << *len << std::endl;
-    buf += sizeof(size_t);
-    for (size_t i = 0 ; i < *len; i++) {
+  } else if (msg_type == 'K') {
+    if (!replicator.ack(reader)) return false;
 
-      size_t* index = reinterpret_cast<size_t*> (buf);
-      buf += sizeof(size_t);
+  } else if (msg_type == 'M') {
+    //the dedicated server didn't believe one of our snapshots:
+    uint32_t tick = reader.u32();
+    glm::vec3 position = reader.position();
+    if (!reader.done()) return false;
+    reconcile(tick, position);
 
-      glm::vec3* pos = reinterpret_cast<glm::vec3*> (buf);
-      buf += sizeof(glm::vec3);
+  } else {
+    std::cout << "ERROR: Invalid message type!" << std::endl;
+    return false;
+  }
 
-      glm::vec4* color = reinterpret_cast<glm::vec4*> (buf);
-      buf += sizeof(glm::vec4);
+  return reader.done();
 
-      glm::vec3 offset = *pos - (&(level->movable_data[*index]))->transform->position;
-      level->movable_data[*index].update(offset);
-      level->movable_data[*index].color = *color;
+}
 
+void PlayerMode::update_recv(Connection *connection) {
+  RingBuffer &data = connection->recv_buffer;
+  if (recorder && connection == connect) {
+    //(anything past recv_recorded arrived since the last call)
+    assert(recv_recorded <= data.size());
+    RingBuffer &unreliable = connection->unreliable_recv_buffer;
+    recorder->received(data.data() + recv_recorded, data.size() - recv_recorded,
+                       unreliable.data(), unreliable.size());
+  }
+  //messages are parsed in place; each pop() just advances the read cursor:
+  Protocol::Frame frame;
+  while (Protocol::peek_frame(data, &frame)) {
+    if (!peer_hello) {
+      //the first message has to be a hello for our protocol version:
+      if (!Protocol::check_hello(frame)) {
+        std::cout << "ERROR: peer doesn't speak protocol version " << Protocol::Version << "; disconnecting." << std::endl;
+        connection->close();
+        if (connect == connection) connect = nullptr;
+        return;
+      }
+      peer_hello = true;
+      //a new peer knows nothing of what we sent before:
+      replicator.reset_sent();
+      replicator.reset_received();
+      reset_remote();
+    } else {
+      Protocol::Reader reader(frame.payload, frame.length);
+      if (!update_recv_msg(frame.type, reader)) {
+        std::cout << "Skipping bad '" << frame.type << "' message." << std::endl;
+      }
     }
-
-  } else {
-    std::cout << "ERROR: Invalid message type!" << std::endl;
-    return -1;
+    net_stats.bytes_received += frame.size();
+    net_stats.messages_received += 1;
+    data.pop(frame.size());
+  }
+  //(what's left is the start of a message that is still arriving)
+  if (connection == connect) recv_recorded = data.size();
+
+  //(datagram connections) messages that came over the unreliable channel -- always whole ones:
+  RingBuffer &unreliable = connection->unreliable_recv_buffer;
+  while (Protocol::peek_frame(unreliable, &frame)) {
+    if (peer_hello) { //(anything from before the hello is from before the peer was ready)
+      Protocol::Reader reader(frame.payload, frame.length);
+      if (!update_recv_msg(frame.type, reader)) {
+        std::cout << "Skipping bad '" << frame.type << "' message." << std::endl;
+      }
+    }
+    net_stats.bytes_received += frame.size();
+    net_stats.messages_received += 1;
+    unreliable.pop(frame.size());
   }
+  unreliable.clear(); //(drop any stray partial frame)
 
-  // Return the number of bytes used up
-  if (used_len) *used_len = msg_size;
-  return 0;
+  //let the peer know which of its snapshots we have:
+  replicator.send_ack(connection);
+}
 
+Snapshot PlayerMode::snapshot() const {
+  Snapshot current;
+  current.tick = input_tick;
+  current.position = Protocol::pack_position(pov.body->position);
+  current.rotation = Protocol::pack_rotation(pov.body->rotation);
+  for (uint16_t index : owned_movables) {
+    GameLevel::Movable const &movable = level->movable_data[index];
+    Snapshot::Movable &entry = current.movables[index];
+    entry.position = Protocol::pack_position(movable.transform->position);
+    entry.color = Protocol::pack_color(movable.color);
+  }
+  return current;
 }
 
-void PlayerMode::update_recv(std::vector< char >& data) {
-  while (!data.empty()) {
-    char msg_type = data[0];
-    size_t msg_size;
-    int status = update_recv_msg(msg_type, &data[1], data.size() - 1, &msg_size);
-    if (status == 0) {
-      data.erase(data.begin(),data.begin() + 1 + msg_size);
-    } else if (status == 1) {
-      break;
-    } else if (status == -1) {
-      std::cout << "Resetting message buffer..." << std::endl;
-      data.clear();
+void PlayerMode::apply(SnapshotChanges const &changes) {
+  if (!changes.fresh) return;
+
+  //positions go through the interpolation buffers (see update_remote()):
+  double time = double(changes.tick) * Physics::tick;
+  remote_clock.observe(time, local_time);
+  if (changes.full) {
+    //(the peer started over -- don't glide from where it was)
+    remote_body.clear();
+    remote_movables.clear();
+  }
+
+  if (changes.has_position || changes.has_rotation) {
+    InterpolationBuffer::Sample sample;
+    sample.time = time;
+    sample.position = (changes.has_position ? changes.position : other_player->position);
+    sample.rotation = (changes.has_rotation ? changes.rotation : other_player->rotation);
+    if (!remote_body.empty()) {
+      //(the other field is as of the newest sample, not as currently shown)
+      if (!changes.has_position) sample.position = remote_body.samples.back().position;
+      if (!changes.has_rotation) sample.rotation = remote_body.samples.back().rotation;
     }
+    remote_body.push(sample, changes.contiguous);
+  }
 
+  for (auto const &change : changes.movables) {
+    GameLevel::Movable &movable = level->movable_data[change.index];
+    if (change.has_position) {
+      InterpolationBuffer &buffer = remote_movables[change.index];
+      if (buffer.empty() && !changes.full) {
+        //start from where it is now, rather than jumping:
+        InterpolationBuffer::Sample from;
+        from.time = time - InterpolationBuffer::QuietHold;
+        from.position = movable.transform->position;
+        buffer.push(from, false);
+      }
+      InterpolationBuffer::Sample sample;
+      sample.time = time;
+      sample.position = change.position;
+      buffer.push(sample, changes.contiguous);
+    }
+    //(colors don't need smoothing)
+    if (change.has_color) movable.color = change.color;
+    //the peer has it now:
+    owned_movables.erase(change.index);
+    play_moving_sound = 1;
   }
 }
 
@@ -566,32 +853,73 @@ void PlayerMode::update_send() {
 
   if (!connect) return;
 
+  for (size_t index : currently_moving) {
+    assert(index <= 0xffff);
+    owned_movables.insert(uint16_t(index));
+    remote_movables.erase(uint16_t(index)); //(ours to move now)
+  }
+
+  //only what changed since the peer's last ack goes out (nothing, if nothing changed):
+  size_t sent = replicator.send(connect, snapshot());
+
+  //what the original raw-struct format took (player every update, plus moved objects):
+  size_t raw = 1 + sizeof(glm::vec3) + sizeof(glm::quat);
   if (!currently_moving.empty()) {
-    connect->send('C');
-    size_t len = currently_moving.size();
-    //send number of moved objects
-    connect->send(len);
-    for (auto it = currently_moving.begin(); it != currently_moving.end(); ++it) {
-      //send index
-      connect->send(*it);
-      //send pos
-      glm::vec3 pos = level->movable_data[*it].transform->position;
-      connect->send(pos);
-      //send color
-      glm::vec4 color = level->movable_data[*it].color;
-      connect->send(color);
-    }
+    raw += 1 + sizeof(size_t) + currently_moving.size() * (sizeof(size_t) + sizeof(glm::vec3) + sizeof(glm::vec4));
   }
 
-  //syncing player pos
-  connect->send('P');
-  auto pos = pov.body->position;
-  connect->send(pos);
-  auto rot = pov.body->rotation;
-  connect->send(rot);
+  net_stats.sends += 1;
+  net_stats.bytes_sent += sent;
+  net_stats.raw_bytes += raw;
 
 }
 
+void PlayerMode::update_remote() {
+  if (!remote_clock.have_offset) return;
+  double time = remote_clock.remote(local_time) - transport.interpolation_delay;
+
+  //remotely driven transforms aren't moved by steps, so draw() mustn't blend them back toward
+  // where they were at the last step -- their 'previous' positions move along with them:
+  glm::vec3 *previous = nullptr;
+  auto previous_of = [&](Scene::Transform const *t) -> glm::vec3 * {
+    if (simulation.level != level || t == nullptr) return nullptr;
+    if (t == level->body_P1_transform) return &simulation.previous[0];
+    if (t == level->body_P2_transform) return &simulation.previous[1];
+    return nullptr;
+  };
+
+  InterpolationBuffer::Sample sample;
+  if (remote_body.at(time, &sample)) {
+    other_player->position = sample.position;
+    other_player->rotation = sample.rotation;
+    if ((previous = previous_of(other_player))) *previous = other_player->position;
+  }
+
+  for (auto m = remote_movables.begin(); m != remote_movables.end(); /* later */) {
+    GameLevel::Movable &movable = level->movable_data[m->first];
+    if (m->second.at(time, &sample)) {
+      glm::vec3 diff = sample.position - movable.transform->position;
+      movable.update(diff);
+      if (simulation.level == level) simulation.previous[2 + m->first] = movable.transform->position;
+      for (Scene::Transform *rider : movable.players) {
+        if ((previous = previous_of(rider))) *previous += diff;
+      }
+    }
+    //(done once it has settled on its last position)
+    if (time > m->second.newest() + 2.0 * InterpolationBuffer::MaxExtrapolation) {
+      m = remote_movables.erase(m);
+    } else {
+      ++m;
+    }
+  }
+}
+
+void PlayerMode::reset_remote() {
+  remote_clock.reset();
+  remote_body.clear();
+  remote_movables.clear();
+}
+
 void PlayerMode::update_network() {
   update_send();
   // Can't receive. Needs inherited class to implement!
@@ -599,6 +927,22 @@ void PlayerMode::update_network() {
 
 void PlayerMode::draw(glm::uvec2 const &drawable_size) {
 
+  //show simulated transforms part of the way into the current tick:
+  // (the simulated positions are put back at the end of draw())
+  std::vector< glm::vec3 > simulated;
+  if (simulation.level == level) {
+    simulated.reserve(simulation.transforms.size());
+    for (uint32_t i = 0; i < simulation.transforms.size(); ++i) {
+      Scene::Transform *t = simulation.transforms[i];
+      simulated.emplace_back(t->position);
+      //(resting transforms are left exactly alone -- glm::mix() can be an ulp off even then, which
+      // would make their caches and standpoint signatures change every frame)
+      glm::vec3 const &previous = simulation.previous[i];
+      if (previous == t->position) continue;
+      t->position = previous + simulation.alpha * (t->position - previous);
+    }
+  }
+
   float aspect = drawable_size.x / float(drawable_size.y);
 
   if (shift.progress > 0.0f) {
@@ -634,4 +978,8 @@ void PlayerMode::draw(glm::uvec2 const &drawable_size) {
     level->draw(drawable_size, eye, world_to_clip);
   }
 
+  for (uint32_t i = 0; i < simulated.size(); ++i) {
+    simulation.transforms[i]->position = simulated[i];
+  }
+
 }
@@ -3,15 +3,31 @@
 #include "Mode.hpp"
 #include "GameLevel.hpp"
 #include "Connection.hpp"
+#include "Datagram.hpp"
+#include "Protocol.hpp"
+#include "Replication.hpp"
+#include "Interpolation.hpp"
+#include "Recording.hpp"
 #include "Sound.hpp"
+#include "Physics.hpp"
 
+#include <chrono>
+#include <deque>
 #include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
 
 struct PlayerMode : Mode {
   PlayerMode(uint32_t level_num_, uint32_t player_num_);
   virtual ~PlayerMode();
 
+  //starts loading the level (see 'loading' below); waits for it only if there is no level yet:
   virtual void level_change(uint32_t level_num_);
+  //(the level level_change() asked for is now 'level')
+  virtual void level_loaded() { }
   virtual void level_reset();
   virtual void player_set();
 
@@ -24,9 +40,20 @@ struct PlayerMode : Mode {
   void update_reset_timer(float elapsed);
   void update_movables_move(float elapsed);
   void update_me_move(float elapsed);
-
-  virtual int update_recv_msg(char msg_type, char *buf, size_t buf_len, size_t *used_len);
-  virtual void update_recv(std::vector< char >& data);
+  //point the body and camera along azimuth/elevation (every frame, so looking around isn't tied to the tick rate):
+  void update_look();
+
+  //run update_step() once per Physics::tick of accumulated frame time:
+  void update_simulation(float elapsed);
+  //advance the simulation by one fixed step (and remember its inputs, see input_history):
+  virtual void update_step(float tick);
+  //hash of simulated state (bodies, velocities, movables) -- handy for checking determinism:
+  uint64_t simulation_hash() const;
+
+  //handle one message (see Protocol.hpp); returns false if it was malformed:
+  virtual bool update_recv_msg(char msg_type, Protocol::Reader &reader);
+  //handle all complete messages in connection's recv_buffer:
+  virtual void update_recv(Connection *connection);
   virtual void update_send();
   virtual void update_network();
 
@@ -89,33 +116,112 @@ struct PlayerMode : Mode {
 
   Connection *connect = nullptr;
   std::function<void(Connection *, Connection::Event)> callback_fn;
+  bool peer_hello = false; //got the peer's hello (Protocol handshake) on connect
+
+  //how ClientMode and ServerMode connect (set from the command line in main.cpp):
+  static struct Transport {
+    bool datagrams = false; //UDP (see Datagram.hpp) instead of TCP
+    DatagramConditions conditions; //(datagrams only) simulated loss and latency
+    double interpolation_delay = 0.1; //seconds the peer is shown behind its snapshots (see Interpolation.hpp)
+    std::string record_path; //if set, ClientMode and ServerMode record the session there (see Recording.hpp)
+  } transport;
+
+  //session recording (see Recording.hpp), if transport.record_path was set:
+  //(connections hold on to it through on_send, so it has to outlive them -- ClientMode and ServerMode own theirs)
+  std::unique_ptr< Recorder > recorder;
+  size_t recv_recorded = 0; //bytes at the front of connect->recv_buffer that are already recorded
+  void start_recording();
+  //log everything sent over 'connection' (call once it becomes 'connect'):
+  void record_connection(Connection *connection);
+
+  //(playback) levels load without GL, and the mouse is left alone:
+  static bool headless;
+
+  //state replication (see Replication.hpp): our body, plus the movables we moved last:
+  Replicator replicator;
+  std::set< uint16_t > owned_movables; //(a movable is given up when the peer moves it)
+  Snapshot snapshot() const;
+  void apply(SnapshotChanges const &changes);
+
+  //prediction: our body moves as soon as we press a key, and each step's inputs are kept
+  // (numbered by input_tick, which our snapshots carry) so that a correction from the
+  // dedicated server ('M') can be replayed forward from the corrected position:
+  struct InputCommand {
+    uint32_t tick = 0;
+    bool moved = false; //(update_me_move() ran -- it doesn't during a perspective shift)
+    bool forward = false, backward = false, left = false, right = false, sprint = false, jump = false;
+    float azimuth = 0.0f;
+    //the body after the step:
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 vel = glm::vec3(0.0f);
+    bool in_air = false;
+  };
+  std::deque< InputCommand > input_history; //oldest first
+  uint32_t input_tick = 0; //steps taken (never reset, so the peer's RemoteClock never sees it go back)
+  static constexpr size_t InputHistory = 2 * Physics::tick_rate; //steps kept (round trips up to two seconds)
+  //the body was really at 'position' after step 'tick'; re-run the inputs since:
+  void reconcile(uint32_t tick, glm::vec3 const &position);
+
+  //interpolation: the peer's body and the movables it moves are shown
+  // transport.interpolation_delay behind its snapshots, so they move smoothly:
+  double local_time = 0.0; //seconds of (unpaused) update() time
+  RemoteClock remote_clock;
+  InterpolationBuffer remote_body;
+  std::map< uint16_t, InterpolationBuffer > remote_movables;
+  //(every frame) put them where the buffers say:
+  void update_remote();
+  //forget the peer's timing and state (e.g. a new peer, or a level reset):
+  void reset_remote();
+
+  //wire traffic (F6 prints it):
+  struct {
+    uint64_t sends = 0; //update_send() calls while connected
+    uint64_t bytes_sent = 0;
+    uint64_t raw_bytes = 0; //bytes the same updates took as raw structs (the pre-Protocol format, sent every update)
+    uint64_t bytes_received = 0;
+    uint64_t messages_received = 0;
+    uint64_t corrections = 0; //'M' messages handled
+    uint64_t replayed_steps = 0; //update_me_move() calls re-run for them
+  } net_stats;
 
   GameLevel *level = nullptr;
 
-  struct Physics {
-    
-    // max speed for ground movement / walking
-    static constexpr float player_move_max_speed = 15.0f;
-    // interpolation half-life for ground movement
-    static constexpr float player_move_halflife = 0.02f;
-
-    // sprinting ground movement multiplier
-    static constexpr float player_sprint_multiplier = 2.0f;
-
-    // max speed for air movement
-    static constexpr float player_air_move_max_speed = 5.0f;
-    // interpolation half-life for air movement
-    static constexpr float player_air_move_halflife = 0.1f;
-
-    // Cosine of the max angle of the surface with respect to the horizontal
-    // plane that will reset jumping for the player.
-    static constexpr float player_jumpable_reset_angle_cos = 0.1f;
-
-    // gravitational acceleration vector
-    static constexpr glm::vec3 gravity = glm::vec3(0.0f, 0.0f, -100.0f);
-
-    // jumping force, in seconds (time from jumping start to peak height)
-    static constexpr float player_jump_sec = 0.3f;
+  //level loading: levels are read and parsed (scene, meshes, collision) on a worker thread, and only
+  // upload()ed on this one; until the level level_change() asked for is ready, update() holds the
+  // game on the old one. Meanwhile the level after the current one is loaded in the background:
+  struct LevelLoad {
+    uint32_t level_num = 0; //(0 = nothing loading)
+    std::future< std::unique_ptr< GameLevel > > level;
+    std::chrono::steady_clock::time_point asked; //when level_change() asked for it
   };
+  LevelLoad loading; //the level level_change() asked for
+  LevelLoad prefetch; //the next level, in case it is asked for
+  static constexpr uint32_t level_count = 5; //(levels are numbered 1 .. level_count)
+  //loads nobody wants any more; a std::async future blocks in its destructor (or on being assigned
+  // over) until the load finishes, so these are kept here and only dropped once they are done:
+  std::vector< std::future< std::unique_ptr< GameLevel > > > abandoned;
+  //moves whatever 'load' held to 'abandoned' and clears it:
+  void abandon_load(LevelLoad *load);
+  //drops the finished entries of 'abandoned' (never waits):
+  void reap_abandoned();
+  //(abandons whatever 'load' held first)
+  void start_load(LevelLoad *load, uint32_t level_num_);
+  //if 'loading' is done (or 'wait'), swap it in; returns false while still loading:
+  bool finish_level_change(bool wait);
+
+  //Fixed-timestep simulation state:
+  struct Simulation {
+    //(the steps a frame takes depend only on the frame times so far, so replaying a recording's
+    // frame times -- see Recording.hpp -- replays exactly the same steps)
+    float accumulator = 0.0f; //seconds of frame time not yet simulated
+    uint64_t steps = 0; //update_step() calls since the level was (re)loaded
+
+    //render-side interpolation: draw() shows transforms moved by update_step()
+    // 'alpha' of the way from their positions before the latest step to their current positions:
+    GameLevel const *level = nullptr; //level 'transforms' belong to
+    std::vector< Scene::Transform * > transforms;
+    std::vector< glm::vec3 > previous;
+    float alpha = 1.0f;
+  } simulation;
 
 };
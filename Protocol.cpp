@@ -0,0 +1,205 @@
+#include "Protocol.hpp"
+#include "Connection.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace Protocol;
+
+static const float PositionScale = 512.0f; //steps per unit
+static const int32_t PositionMax = (1 << 23) - 1;
+static const float RotationScale = 1023.0f;
+static const float InvSqrt2 = 0.70710678f; //largest possible magnitude of the three smaller components
+
+Position Protocol::pack_position(glm::vec3 const &value) {
+	int32_t q[3];
+	for (uint32_t i = 0; i < 3; ++i) {
+		q[i] = int32_t(std::lround(value[i] * PositionScale));
+		q[i] = std::max(-PositionMax, std::min(PositionMax, q[i]));
+	}
+	Position packed;
+	packed.x = q[0];
+	packed.y = q[1];
+	packed.z = q[2];
+	return packed;
+}
+
+glm::vec3 Protocol::unpack_position(Position const &packed) {
+	return glm::vec3(float(packed.x), float(packed.y), float(packed.z)) / PositionScale;
+}
+
+uint32_t Protocol::pack_rotation(glm::quat const &value) {
+	float c[4] = {value.x, value.y, value.z, value.w};
+	float length = std::sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2] + c[3]*c[3]);
+	if (!(length > 0.0f)) { //(zero or nan) send identity
+		c[0] = c[1] = c[2] = 0.0f; c[3] = 1.0f; length = 1.0f;
+	}
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i) {
+		if (std::abs(c[i]) > std::abs(c[largest])) largest = i;
+	}
+	//q and -q are the same rotation, so make the dropped component positive:
+	float sign = (c[largest] < 0.0f ? -1.0f : 1.0f) / length;
+
+	uint32_t packed = largest;
+	uint32_t shift = 2;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		float v = (c[i] * sign / InvSqrt2) * 0.5f + 0.5f; //[-1/sqrt(2), 1/sqrt(2)] -> [0,1]
+		uint32_t q = uint32_t(std::lround(std::max(0.0f, std::min(1.0f, v)) * RotationScale));
+		packed |= q << shift;
+		shift += 10;
+	}
+	return packed;
+}
+
+glm::quat Protocol::unpack_rotation(uint32_t packed) {
+	uint32_t largest = packed & 0x3;
+	float c[4];
+	float sum = 0.0f;
+	uint32_t shift = 2;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		float v = float((packed >> shift) & 0x3ff) / RotationScale;
+		c[i] = (v * 2.0f - 1.0f) * InvSqrt2;
+		sum += c[i] * c[i];
+		shift += 10;
+	}
+	c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+	return glm::normalize(glm::quat(c[3], c[0], c[1], c[2]));
+}
+
+uint32_t Protocol::pack_color(glm::vec4 const &value) {
+	uint32_t packed = 0;
+	for (uint32_t i = 0; i < 4; ++i) {
+		packed |= uint32_t(std::lround(std::max(0.0f, std::min(1.0f, value[i])) * 255.0f)) << (8 * i);
+	}
+	return packed;
+}
+
+glm::vec4 Protocol::unpack_color(uint32_t packed) {
+	glm::vec4 value;
+	for (uint32_t i = 0; i < 4; ++i) {
+		value[i] = float((packed >> (8 * i)) & 0xff) / 255.0f;
+	}
+	return value;
+}
+
+//---------------------------------
+
+Message::Message(char type) {
+	bytes.reserve(64);
+	bytes.emplace_back(type);
+	bytes.emplace_back('\0'); //payload length, filled in by send()
+	bytes.emplace_back('\0');
+}
+
+void Message::u8(uint8_t value) {
+	bytes.emplace_back(char(value));
+}
+
+void Message::u16(uint16_t value) {
+	bytes.emplace_back(char(value & 0xff));
+	bytes.emplace_back(char(value >> 8));
+}
+
+void Message::u32(uint32_t value) {
+	u16(uint16_t(value & 0xffff));
+	u16(uint16_t(value >> 16));
+}
+
+void Message::position(Position const &packed) {
+	int32_t const q[3] = {packed.x, packed.y, packed.z};
+	for (uint32_t i = 0; i < 3; ++i) {
+		uint32_t u = uint32_t(q[i]) & 0xffffff;
+		bytes.emplace_back(char(u & 0xff));
+		bytes.emplace_back(char((u >> 8) & 0xff));
+		bytes.emplace_back(char(u >> 16));
+	}
+}
+
+size_t Message::send(Connection *connection) {
+	size_t length = bytes.size() - HeaderSize;
+	assert(length <= MaxPayload && "message too long to frame");
+	bytes[1] = char(length & 0xff);
+	bytes[2] = char(length >> 8);
+	if (connection) connection->send_raw(bytes.data(), bytes.size());
+	return bytes.size();
+}
+
+size_t Message::send_unreliable(Connection *connection) {
+	size_t length = bytes.size() - HeaderSize;
+	assert(length <= MaxPayload && "message too long to frame");
+	bytes[1] = char(length & 0xff);
+	bytes[2] = char(length >> 8);
+	if (connection) connection->send_unreliable(bytes.data(), bytes.size());
+	return bytes.size();
+}
+
+//---------------------------------
+
+uint8_t Reader::u8() {
+	if (end - at < 1) {
+		failed = true;
+		return 0;
+	}
+	return uint8_t(*(at++));
+}
+
+uint16_t Reader::u16() {
+	uint16_t lo = u8();
+	uint16_t hi = u8();
+	return uint16_t(lo | (hi << 8));
+}
+
+uint32_t Reader::u32() {
+	uint32_t lo = u16();
+	uint32_t hi = u16();
+	return lo | (hi << 16);
+}
+
+Position Reader::packed_position() {
+	int32_t q[3];
+	for (uint32_t i = 0; i < 3; ++i) {
+		uint32_t u = uint32_t(u8());
+		u |= uint32_t(u8()) << 8;
+		u |= uint32_t(u8()) << 16;
+		q[i] = int32_t(u << 8) >> 8; //sign-extend from 24 bits
+	}
+	Position packed;
+	packed.x = q[0];
+	packed.y = q[1];
+	packed.z = q[2];
+	return packed;
+}
+
+//---------------------------------
+
+bool Protocol::peek_frame(RingBuffer &data, Frame *frame) {
+	assert(frame);
+	if (data.size() < HeaderSize) return false;
+	size_t length = size_t(uint8_t(data[1])) | (size_t(uint8_t(data[2])) << 8);
+	if (data.size() < HeaderSize + length) return false;
+
+	char *bytes = data.data();
+	frame->type = bytes[0];
+	frame->payload = bytes + HeaderSize;
+	frame->length = length;
+	return true;
+}
+
+void Protocol::send_hello(Connection *connection) {
+	Message hello('H');
+	hello.u32(Magic);
+	hello.u16(Version);
+	hello.send(connection);
+}
+
+bool Protocol::check_hello(Frame const &frame) {
+	if (frame.type != 'H') return false;
+	Reader reader(frame.payload, frame.length);
+	uint32_t magic = reader.u32();
+	uint16_t version = reader.u16();
+	return reader.done() && magic == Magic && version == Version;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+/*
+ * Wire format for game messages (PlayerMode peers and the dedicated server).
+ *
+ * Every message is a frame:
+ *   [u8 type][u16 payload length][payload]
+ * so a reader can always find the next message (and skip ones it doesn't know).
+ * All multi-byte values are little-endian and nothing depends on the sender's
+ * struct layout or sizeof(size_t).
+ *
+ * Messages:
+ *  'H' hello   u32 magic, u16 version -- first message each side sends; peers
+ *              with a different version are disconnected
+ *  'J' join    u8 level, u8 player number (0 = any) -- client to dedicated server
+ *  'R' reset   (empty)
+ *  'S' snapshot of the sender's replicated state, as a delta (see Replication.hpp):
+ *              u32 sequence, u32 baseline sequence (0 = none), u32 sender's step,
+ *              u8 fields (1 = position, 2 = rotation), [position], [rotation],
+ *              u16 count, then count x (u16 movable index, u8 fields (1 = position,
+ *              2 = color), [position], [color])
+ *  'K' ack     u32 sequence of the newest snapshot applied
+ *  'M' move correction  u32 step, position -- dedicated server to a player whose
+ *              snapshot for that step moved their body implausibly far; the body
+ *              was at 'position' then (the player replays its later inputs from there)
+ *  'T' ping    u32 id, u32 sender's clock (microseconds) -- player to dedicated server, which
+ *              answers right away (it isn't relayed) with 'T': the same two fields, then u32 mean
+ *              and u32 longest tick time of the player's room so far (nanoseconds); see bots.cpp
+ *
+ * Field encodings:
+ *  position: 3 x signed 24-bit, 1/512 unit steps (+/-16384 units range)
+ *  rotation: "smallest three" -- 2-bit index of the largest component, then the
+ *            other three in 10 bits each (32 bits total)
+ *  color:    4 x u8 (RGBA, 0-1 mapped to 0-255)
+ */
+
+#include "RingBuffer.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct Connection;
+
+namespace Protocol {
+	const uint32_t Magic = 0x54525056; //"VPRT" on the wire
+	const uint16_t Version = 3;
+
+	const size_t HeaderSize = 1 + 2; //type + payload length
+	const size_t MaxPayload = 0xffff;
+
+	//payload sizes of fixed-size messages:
+	const size_t HelloSize = 4 + 2;
+	const size_t JoinSize = 1 + 1;
+	const size_t AckSize = 4;
+	const size_t CorrectionSize = 4 + 3 * 3;
+	const size_t PingSize = 4 + 4; //(the answer adds 4 + 4)
+	const size_t PositionSize = 3 * 3;
+	const size_t RotationSize = 4;
+	const size_t ColorSize = 4;
+
+	//Field encodings as integers (so senders can tell whether what the receiver sees would change):
+	struct Position {
+		int32_t x = 0, y = 0, z = 0;
+		bool operator==(Position const &o) const { return x == o.x && y == o.y && z == o.z; }
+		bool operator!=(Position const &o) const { return !(*this == o); }
+	};
+	Position pack_position(glm::vec3 const &value);
+	glm::vec3 unpack_position(Position const &packed);
+	uint32_t pack_rotation(glm::quat const &value);
+	glm::quat unpack_rotation(uint32_t packed);
+	uint32_t pack_color(glm::vec4 const &value);
+	glm::vec4 unpack_color(uint32_t packed);
+
+	//Builds one message; send() frames it and appends it to a connection's send buffer:
+	struct Message {
+		Message(char type);
+
+		void u8(uint8_t value);
+		void u16(uint16_t value);
+		void u32(uint32_t value);
+		void position(Position const &packed);
+		void position(glm::vec3 const &value) { position(pack_position(value)); }
+		void rotation(glm::quat const &value) { u32(pack_rotation(value)); }
+		void color(glm::vec4 const &value) { u32(pack_color(value)); }
+
+		//returns the number of bytes sent (header included):
+		size_t send(Connection *connection);
+		//same, for messages that may be lost (see Connection::send_unreliable):
+		size_t send_unreliable(Connection *connection);
+
+		std::vector< char > bytes; //header, then payload
+	};
+
+	//Reads the fields of a message's payload; reading past the end sets 'failed':
+	struct Reader {
+		Reader(char const *data, size_t size) : at(data), end(data + size) { }
+
+		uint8_t u8();
+		uint16_t u16();
+		uint32_t u32();
+		Position packed_position();
+		glm::vec3 position() { return unpack_position(packed_position()); }
+		glm::quat rotation() { return unpack_rotation(u32()); }
+		glm::vec4 color() { return unpack_color(u32()); }
+
+		//everything was read, and nothing more than was there:
+		bool done() const { return !failed && at == end; }
+
+		char const *at;
+		char const *end;
+		bool failed = false;
+	};
+
+	//A whole message at the front of a receive buffer:
+	struct Frame {
+		char type = '\0';
+		char *payload = nullptr; //points into the buffer (valid until it is next modified)
+		size_t length = 0; //of payload
+		size_t size() const { return HeaderSize + length; }
+	};
+	//returns false if the buffer doesn't hold a whole message yet:
+	bool peek_frame(RingBuffer &data, Frame *frame);
+
+	//handshake:
+	void send_hello(Connection *connection);
+	bool check_hello(Frame const &frame); //is 'frame' a hello from a peer speaking our version?
+}
@@ -0,0 +1,151 @@
+#include "Recording.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+void push_varint(std::vector< char > &bytes, uint64_t value) {
+	while (value >= 0x80) {
+		bytes.emplace_back(char(uint8_t(value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	bytes.emplace_back(char(value));
+}
+
+bool read_varint(char const *data, size_t end, size_t *at, uint64_t *value) {
+	*value = 0;
+	for (uint32_t shift = 0; shift < 64; shift += 7) {
+		if (*at >= end) return false;
+		uint8_t byte = uint8_t(data[(*at)++]);
+		*value |= uint64_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false; //(too long to be a varint we wrote)
+}
+
+//helpers: little-endian fields:
+static void push_u16(std::vector< char > &bytes, uint16_t value) {
+	bytes.emplace_back(char(value & 0xff));
+	bytes.emplace_back(char(value >> 8));
+}
+static void push_u32(std::vector< char > &bytes, uint32_t value) {
+	for (uint32_t i = 0; i < 4; ++i) bytes.emplace_back(char((value >> (8 * i)) & 0xff));
+}
+static void push_f32(std::vector< char > &bytes, float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, 4);
+	push_u32(bytes, bits);
+}
+
+Recorder::Recorder(std::string const &path, uint32_t level, uint32_t player)
+	: out(path, std::ios::binary), last(std::chrono::steady_clock::now()) {
+	if (!out) {
+		throw std::runtime_error("Failed to open recording file '" + path + "' for writing.");
+	}
+	std::vector< char > header;
+	push_u32(header, Recording::Magic);
+	push_u16(header, Recording::Version);
+	header.emplace_back(char(level));
+	header.emplace_back(char(player));
+	header.emplace_back(char(0)); //flags
+	out.write(header.data(), header.size());
+	bytes += header.size();
+}
+
+Recorder::~Recorder() {
+	out.flush();
+}
+
+void Recorder::record(char kind, std::vector< char > const &payload) {
+	auto now = std::chrono::steady_clock::now();
+	uint64_t us = uint64_t(std::chrono::duration_cast< std::chrono::microseconds >(now - last).count());
+	//(keep the remainder, so timestamps don't drift)
+	last += std::chrono::microseconds(us);
+
+	std::vector< char > header;
+	header.emplace_back(kind);
+	push_varint(header, us);
+	push_varint(header, payload.size());
+	out.write(header.data(), header.size());
+	out.write(payload.data(), payload.size());
+
+	records += 1;
+	bytes += header.size() + payload.size();
+}
+
+void Recorder::frame(float elapsed, uint16_t controls, float azimuth, float elevation) {
+	scratch.clear();
+	push_f32(scratch, elapsed);
+	push_u16(scratch, controls);
+	push_f32(scratch, azimuth);
+	push_f32(scratch, elevation);
+	record('f', scratch);
+}
+
+void Recorder::received(char const *reliable, size_t reliable_size, char const *unreliable, size_t unreliable_size) {
+	if (reliable_size == 0 && unreliable_size == 0) return;
+	scratch.clear();
+	push_varint(scratch, reliable_size);
+	scratch.insert(scratch.end(), reliable, reliable + reliable_size);
+	scratch.insert(scratch.end(), unreliable, unreliable + unreliable_size);
+	record('i', scratch);
+}
+
+void Recorder::sent(void const *data, size_t size, bool unreliable) {
+	char const *begin = reinterpret_cast< char const * >(data);
+	scratch.assign(begin, begin + size);
+	record(unreliable ? 'p' : 'o', scratch);
+}
+
+void Recorder::level(uint32_t level) {
+	scratch.clear();
+	scratch.emplace_back(char(level));
+	record('l', scratch);
+}
+
+Recording::Recording(std::string const &path) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("Failed to open recording file '" + path + "'.");
+	}
+	data.assign(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+
+	const size_t HeaderSize = 4 + 2 + 1 + 1 + 1;
+	if (data.size() < HeaderSize) {
+		throw std::runtime_error("Recording '" + path + "' is too short to be one.");
+	}
+	auto byte = [this](size_t i) { return uint32_t(uint8_t(data[i])); };
+	uint32_t magic = byte(0) | (byte(1) << 8) | (byte(2) << 16) | (byte(3) << 24);
+	uint16_t version = uint16_t(byte(4) | (byte(5) << 8));
+	if (magic != Magic) {
+		throw std::runtime_error("File '" + path + "' isn't a recording.");
+	}
+	if (version != Version) {
+		throw std::runtime_error("Recording '" + path + "' is version " + std::to_string(version) + "; expecting version " + std::to_string(Version) + ".");
+	}
+	level = byte(6);
+	player = byte(7);
+	first = HeaderSize;
+}
+
+bool Recording::next(Cursor *cursor, Record *record) const {
+	assert(cursor && record);
+	size_t at = (cursor->at == 0 ? first : cursor->at);
+	if (at >= data.size()) return false;
+
+	Record read;
+	read.kind = data[at++];
+	uint64_t us = 0, length = 0;
+	if (!read_varint(data.data(), data.size(), &at, &us)) return false;
+	if (!read_varint(data.data(), data.size(), &at, &length)) return false;
+	if (length > data.size() - at) return false;
+	read.time = cursor->time + us;
+	read.payload = data.data() + at;
+	read.length = size_t(length);
+
+	cursor->at = at + read.length;
+	cursor->time = read.time;
+	*record = read;
+	return true;
+}
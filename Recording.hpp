@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * Session recordings, for reproducing desyncs between peers (and for
+ * benchmarking the message parser).
+ *
+ * A Recorder logs what a PlayerMode saw and did, with timestamps:
+ *  - the bytes that arrived at each update_recv() call (reliable stream and
+ *    unreliable messages),
+ *  - the bytes sent (everything appended through Connection::on_send),
+ *  - each frame's elapsed time and controls, and level changes;
+ * PlaybackMode feeds a recording back through the same code, headless and as
+ * fast as it can go (see main.cpp's --play).
+ *
+ * File format (little-endian):
+ *   header: [u32 magic "VREC"][u16 version][u8 level][u8 player][u8 flags (none yet; 0)]
+ *   records: [u8 kind][varint microseconds since the previous record][varint length][bytes]
+ *   kinds:
+ *    'f' frame       f32 elapsed, u16 control bits (see Recorder::Controls), f32 azimuth, f32 elevation
+ *    'i' received    varint reliable byte count, reliable bytes, then unreliable messages
+ *    'o' sent        bytes (reliable)
+ *    'p' sent        bytes (unreliable)
+ *    'l' level       u8 level number
+ * (varints are LEB128: 7 bits per byte, low bits first, high bit set on all but the last byte)
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct Recorder {
+	//opens (truncates) 'path'; throws on failure:
+	Recorder(std::string const &path, uint32_t level, uint32_t player);
+	~Recorder();
+
+	//bits in a 'f' record's controls:
+	enum Controls : uint16_t {
+		Forward = 1, Backward = 2, Left = 4, Right = 8, Sprint = 16, Jump = 32,
+		Flat = 64, //(perspective shift key)
+		WantReset = 128, //(a reset was requested locally)
+		Pause = 256,
+	};
+
+	void frame(float elapsed, uint16_t controls, float azimuth, float elevation);
+	void received(char const *reliable, size_t reliable_size, char const *unreliable, size_t unreliable_size);
+	void sent(void const *data, size_t size, bool unreliable);
+	void level(uint32_t level);
+
+	//write one record (the other functions build their payloads and call this):
+	void record(char kind, std::vector< char > const &payload);
+
+	std::ofstream out;
+	std::chrono::steady_clock::time_point last; //time of the previous record
+	uint64_t records = 0;
+	uint64_t bytes = 0; //file size so far
+	std::vector< char > scratch; //(reused record buffer)
+};
+
+//A whole recording, read into memory:
+struct Recording {
+	//reads 'path'; throws if it isn't a recording (or is of another version):
+	Recording(std::string const &path);
+
+	uint32_t level = 1;
+	uint32_t player = 1;
+
+	struct Record {
+		char kind = '\0';
+		uint64_t time = 0; //microseconds since the recording started
+		char const *payload = nullptr; //(points into 'data')
+		size_t length = 0;
+	};
+	//reading position:
+	struct Cursor {
+		size_t at = 0; //(0 = before the first record)
+		uint64_t time = 0;
+	};
+	//read the record at 'cursor' and advance it; returns false at the end:
+	// (a truncated final record -- e.g. from a crash -- reads as the end)
+	bool next(Cursor *cursor, Record *record) const;
+
+	std::vector< char > data; //whole file, header included
+	size_t first = 0; //offset of the first record
+
+	static constexpr uint32_t Magic = 0x43455256; //"VREC" on the wire
+	static constexpr uint16_t Version = 1;
+};
+
+//varint helpers (shared by Recorder and PlaybackMode):
+void push_varint(std::vector< char > &bytes, uint64_t value);
+//reads a varint at *at (advancing it); returns false if it runs past 'end':
+bool read_varint(char const *data, size_t end, size_t *at, uint64_t *value);
@@ -0,0 +1,223 @@
+#include "Replication.hpp"
+#include "Connection.hpp"
+
+#include <cassert>
+
+//field bits in 'S' messages:
+static const uint8_t BodyPosition = 1;
+static const uint8_t BodyRotation = 2;
+static const uint8_t MovablePosition = 1;
+static const uint8_t MovableColor = 2;
+//(a movable entry with no field bits means it left the snapshot)
+
+size_t Replicator::send(Connection *connection, Snapshot current) {
+	updates_since_send += 1;
+
+	//does the peer (possibly) not have this yet?
+	Snapshot const *newest = (!unacked.empty() ? &unacked.back() : (have_acked ? &acked : nullptr));
+	if (newest && newest->same_state(current)) {
+		//nothing new; but do repeat unacked changes now and then:
+		if (unacked.empty() || updates_since_send < ResendUpdates) return 0;
+	}
+
+	current.sequence = ++sequence;
+	Snapshot const *baseline = (have_acked ? &acked : nullptr);
+
+	Protocol::Message message('S');
+	message.u32(current.sequence);
+	message.u32(baseline ? baseline->sequence : 0);
+	message.u32(current.tick);
+
+	uint8_t fields = 0;
+	if (!baseline || current.position != baseline->position) fields |= BodyPosition;
+	if (!baseline || current.rotation != baseline->rotation) fields |= BodyRotation;
+	message.u8(fields);
+	if (fields & BodyPosition) message.position(current.position);
+	if (fields & BodyRotation) message.u32(current.rotation);
+
+	//movables, merging current and baseline lists (both sorted by index):
+	size_t count_at = message.bytes.size();
+	message.u16(0); //count, filled in below
+	uint16_t count = 0;
+	auto c = current.movables.begin();
+	auto b = (baseline ? baseline->movables.begin() : current.movables.end());
+	auto b_end = (baseline ? baseline->movables.end() : current.movables.end());
+	while (c != current.movables.end() || b != b_end) {
+		if (b == b_end || (c != current.movables.end() && c->first < b->first)) {
+			//new since baseline:
+			message.u16(c->first);
+			message.u8(MovablePosition | MovableColor);
+			message.position(c->second.position);
+			message.u32(c->second.color);
+			++count;
+			++c;
+		} else if (c == current.movables.end() || b->first < c->first) {
+			//gone since baseline:
+			message.u16(b->first);
+			message.u8(0);
+			++count;
+			++b;
+		} else {
+			uint8_t changed = 0;
+			if (c->second.position != b->second.position) changed |= MovablePosition;
+			if (c->second.color != b->second.color) changed |= MovableColor;
+			if (changed) {
+				message.u16(c->first);
+				message.u8(changed);
+				if (changed & MovablePosition) message.position(c->second.position);
+				if (changed & MovableColor) message.u32(c->second.color);
+				++count;
+			}
+			++c;
+			++b;
+		}
+	}
+	message.bytes[count_at] = char(count & 0xff);
+	message.bytes[count_at + 1] = char(count >> 8);
+
+	unacked.emplace_back(std::move(current));
+	if (unacked.size() > MaxHistory) unacked.pop_front();
+	updates_since_send = 0;
+
+	return message.send_unreliable(connection);
+}
+
+bool Replicator::ack(Protocol::Reader &reader) {
+	uint32_t sequence = reader.u32();
+	if (!reader.done()) return false;
+
+	while (!unacked.empty() && unacked.front().sequence <= sequence) {
+		if (unacked.front().sequence == sequence) {
+			acked = std::move(unacked.front());
+			have_acked = true;
+		}
+		unacked.pop_front();
+	}
+	return true;
+}
+
+void Replicator::reset_sent() {
+	have_acked = false;
+	acked = Snapshot();
+	unacked.clear();
+	updates_since_send = 0;
+}
+
+bool Replicator::receive(Protocol::Reader &reader, SnapshotChanges *changes) {
+	assert(changes);
+	*changes = SnapshotChanges();
+
+	//decode on top of the baseline:
+	Snapshot full;
+	full.sequence = reader.u32();
+	uint32_t baseline_sequence = reader.u32();
+	full.tick = reader.u32();
+	Snapshot const *baseline = nullptr;
+	if (baseline_sequence != 0) {
+		for (auto const &snapshot : received) {
+			if (snapshot.sequence == baseline_sequence) baseline = &snapshot;
+		}
+	}
+	if (baseline) {
+		full.position = baseline->position;
+		full.rotation = baseline->rotation;
+		full.movables = baseline->movables;
+	}
+
+	uint8_t fields = reader.u8();
+	if (fields & BodyPosition) full.position = reader.packed_position();
+	if (fields & BodyRotation) full.rotation = reader.u32();
+
+	uint16_t count = reader.u16();
+	for (uint16_t i = 0; i < count; ++i) {
+		uint16_t index = reader.u16();
+		uint8_t changed = reader.u8();
+		if (changed == 0) {
+			full.movables.erase(index);
+			continue;
+		}
+		Snapshot::Movable &movable = full.movables[index];
+		if (changed & MovablePosition) movable.position = reader.packed_position();
+		if (changed & MovableColor) movable.color = reader.u32();
+	}
+	if (!reader.done()) return false;
+
+	//stale, repeated, or undecodable (baseline forgotten) snapshots change nothing;
+	// the last case means the sender hasn't heard an ack we can still decode against, so repeat it:
+	if (baseline_sequence != 0 && !baseline) {
+		ack_wanted = true;
+		return true;
+	}
+	if (!received.empty() && full.sequence <= received.back().sequence) return true;
+
+	changes->fresh = true;
+	changes->tick = full.tick;
+	changes->full = (baseline_sequence == 0);
+	changes->contiguous = (!received.empty() && received.back().sequence + 1 == full.sequence);
+
+	//report differences from what was applied last:
+	Snapshot const *before = (have_applied ? &applied : nullptr);
+	if (!before || full.position != before->position) {
+		changes->has_position = true;
+		changes->position = Protocol::unpack_position(full.position);
+	}
+	if (!before || full.rotation != before->rotation) {
+		changes->has_rotation = true;
+		changes->rotation = Protocol::unpack_rotation(full.rotation);
+	}
+	for (auto const &entry : full.movables) {
+		Snapshot::Movable const *was = nullptr;
+		if (before) {
+			auto f = before->movables.find(entry.first);
+			if (f != before->movables.end()) was = &f->second;
+		}
+		if (was && *was == entry.second) continue;
+		changes->movables.emplace_back();
+		SnapshotChanges::Movable &change = changes->movables.back();
+		change.index = entry.first;
+		if (!was || was->position != entry.second.position) {
+			change.has_position = true;
+			change.position = Protocol::unpack_position(entry.second.position);
+		}
+		if (!was || was->color != entry.second.color) {
+			change.has_color = true;
+			change.color = Protocol::unpack_color(entry.second.color);
+		}
+	}
+
+	applied = full;
+	have_applied = true;
+
+	//the sender never goes back to an older baseline, so older snapshots can go:
+	while (!received.empty() && received.front().sequence < baseline_sequence) {
+		received.pop_front();
+	}
+	//...but the baseline itself stays, however old: the sender keeps using it until one of our acks arrives:
+	while (received.size() >= MaxHistory) {
+		auto oldest = received.begin();
+		if (baseline_sequence != 0 && oldest->sequence == baseline_sequence) ++oldest;
+		received.erase(oldest);
+	}
+	received.emplace_back(std::move(full));
+
+	return true;
+}
+
+size_t Replicator::send_ack(Connection *connection) {
+	if (received.empty()) return 0;
+	if (received.back().sequence == received_acked && !ack_wanted) return 0;
+	received_acked = received.back().sequence;
+	ack_wanted = false;
+
+	Protocol::Message message('K');
+	message.u32(received_acked);
+	return message.send_unreliable(connection);
+}
+
+void Replicator::reset_received() {
+	received.clear();
+	have_applied = false;
+	applied = Snapshot();
+	received_acked = 0;
+	ack_wanted = false;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+/*
+ * Snapshot replication of the state a player is authoritative for:
+ * their own body, and the movables they have moved.
+ *
+ *  - the sender numbers its snapshots and remembers the ones not yet acked,
+ *  - the receiver acks ('K') the newest snapshot it has applied,
+ *  - each snapshot ('S') only carries what differs from the newest acked
+ *    snapshot (its "baseline"; everything, if nothing has been acked yet).
+ *
+ * The receiver keeps the snapshots it has decoded, rebuilds each new one from
+ * its baseline plus the delta, and reports only what differs from what it
+ * applied last -- so stale, repeated, or out-of-order snapshots are harmless.
+ * When nothing changes, nothing is sent.
+ * Each snapshot is stamped with the sender's simulation step, so the receiver
+ * can show it at an even pace (see Interpolation.hpp).
+ *
+ * Both messages go over the unreliable channel (Connection::send_unreliable): a
+ * lost snapshot is superseded by the next one (or repeated, under a new sequence
+ * number, if nothing newer comes along), and so is a lost ack. The receiver
+ * always keeps the baseline the sender is using, and if a snapshot still comes
+ * in against one it has dropped, it repeats its last ack.
+ *
+ * Snapshots hold field values as encoded on the wire (Protocol::pack_*), so
+ * changes too small to survive quantization don't cost any bandwidth.
+ */
+
+#include "Protocol.hpp"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+struct Snapshot {
+	uint32_t sequence = 0;
+	uint32_t tick = 0; //sender's simulation step when it was taken (not part of the state: a new tick alone isn't sent)
+
+	Protocol::Position position;
+	uint32_t rotation = 0;
+
+	struct Movable {
+		Protocol::Position position;
+		uint32_t color = 0;
+		bool operator==(Movable const &o) const { return position == o.position && color == o.color; }
+		bool operator!=(Movable const &o) const { return !(*this == o); }
+	};
+	std::map< uint16_t, Movable > movables; //by movable index
+
+	//same replicated state (sequence numbers aside)?
+	bool same_state(Snapshot const &o) const {
+		return position == o.position && rotation == o.rotation && movables == o.movables;
+	}
+};
+
+//What a received snapshot changes, relative to the last one applied:
+struct SnapshotChanges {
+	bool fresh = false; //a newer snapshot than any before (else nothing below is set)
+	uint32_t tick = 0; //(fresh only) the sender's step when it was taken
+	bool full = false; //(fresh only) sent without a baseline -- the sender started over (level reset, new peer)
+	bool contiguous = false; //(fresh only) the sender sent nothing between the previous fresh snapshot and this one
+
+	bool has_position = false;
+	glm::vec3 position = glm::vec3(0.0f);
+	bool has_rotation = false;
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+
+	struct Movable {
+		uint16_t index = 0;
+		bool has_position = false;
+		glm::vec3 position = glm::vec3(0.0f);
+		bool has_color = false;
+		glm::vec4 color = glm::vec4(0.0f);
+	};
+	std::vector< Movable > movables;
+};
+
+struct Replicator {
+	//--- sending ---
+
+	//send 'current' (as a delta against the acked snapshot) if the peer doesn't have it yet;
+	// returns the number of bytes sent (0 if nothing needed sending):
+	size_t send(Connection *connection, Snapshot current);
+
+	//handle the payload of a 'K' message from the peer; returns false if malformed:
+	bool ack(Protocol::Reader &reader);
+
+	//forget what the peer has (e.g. after a level reset); the next snapshot is sent in full:
+	void reset_sent();
+
+	uint32_t sequence = 0; //of the newest snapshot sent (keeps counting up across reset_sent())
+	bool have_acked = false;
+	Snapshot acked; //newest snapshot the peer has acked
+	std::deque< Snapshot > unacked; //sent after 'acked', oldest first
+	uint32_t updates_since_send = 0;
+
+	//re-send unacked changes after this many quiet send() calls (in case the snapshot was lost):
+	static constexpr uint32_t ResendUpdates = 30;
+	//snapshots to remember (on either side) beyond the baseline:
+	static constexpr uint32_t MaxHistory = 128;
+
+	//--- receiving ---
+
+	//decode the payload of an 'S' message; returns false if malformed
+	// (a snapshot that is stale or whose baseline is unknown decodes to no changes):
+	bool receive(Protocol::Reader &reader, SnapshotChanges *changes);
+
+	//send 'K' for the newest snapshot received, if it hasn't been acked yet (or the ack seems lost):
+	size_t send_ack(Connection *connection);
+
+	//report everything in the next snapshot as changed (e.g. the level was reloaded under it):
+	void reset_applied() { have_applied = false; }
+
+	//forget everything received (e.g. a new peer connected):
+	void reset_received();
+
+	std::deque< Snapshot > received; //decoded snapshots, oldest first
+	bool have_applied = false;
+	Snapshot applied; //newest snapshot reported by receive()
+	uint32_t received_acked = 0; //newest sequence we have sent 'K' for
+	bool ack_wanted = false; //a snapshot came against a baseline we no longer have: send 'K' again
+};
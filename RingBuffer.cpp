@@ -0,0 +1,75 @@
+#include "RingBuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+RingBuffer::RingBuffer(size_t capacity) {
+	reserve(capacity);
+}
+
+void RingBuffer::reserve(size_t size) {
+	if (size <= storage.size()) return;
+	size_t capacity = std::max< size_t >(storage.size(), 16);
+	while (capacity < size) capacity *= 2;
+
+	//unwrap into the new storage:
+	std::vector< char > grown(capacity);
+	peek(0, grown.data(), count);
+	storage.swap(grown);
+	mask = capacity - 1;
+	head = 0;
+}
+
+void RingBuffer::push(void const *data_, size_t size) {
+	if (size == 0) return; //(storage may not even exist yet)
+	reserve(count + size);
+	char const *data = reinterpret_cast< char const * >(data_);
+	size_t tail = (head + count) & mask;
+	size_t first = std::min(size, storage.size() - tail);
+	std::memcpy(&storage[tail], data, first);
+	std::memcpy(&storage[0], data + first, size - first);
+	count += size;
+}
+
+void RingBuffer::peek(size_t offset, void *out_, size_t size) const {
+	assert(offset + size <= count);
+	if (size == 0) return;
+	char *out = reinterpret_cast< char * >(out_);
+	size_t start = (head + offset) & mask;
+	size_t first = std::min(size, storage.size() - start);
+	std::memcpy(out, &storage[start], first);
+	std::memcpy(out + first, &storage[0], size - first);
+}
+
+char *RingBuffer::data() {
+	if (head + count > storage.size()) {
+		//waiting bytes wrap around the end; rotate them to the start of storage:
+		std::rotate(storage.begin(), storage.begin() + head, storage.end());
+		head = 0;
+	}
+	return storage.data() + head;
+}
+
+uint32_t RingBuffer::readable_spans(Span spans[2]) {
+	if (count == 0) return 0;
+	size_t first = std::min(count, storage.size() - head);
+	spans[0].data = &storage[head];
+	spans[0].size = first;
+	if (first == count) return 1;
+	spans[1].data = &storage[0];
+	spans[1].size = count - first;
+	return 2;
+}
+
+uint32_t RingBuffer::writable_spans(Span spans[2], size_t at_least) {
+	reserve(count + std::max< size_t >(at_least, 1));
+	size_t tail = (head + count) & mask;
+	size_t free = storage.size() - count;
+	size_t first = std::min(free, storage.size() - tail);
+	spans[0].data = &storage[tail];
+	spans[0].size = first;
+	if (first == free) return 1;
+	spans[1].data = &storage[0];
+	spans[1].size = free - first;
+	return 2;
+}
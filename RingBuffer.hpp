@@ -0,0 +1,85 @@
+#pragma once
+
+/*
+ * RingBuffer is the byte queue behind Connection's send and receive buffers.
+ *
+ * Bytes are appended at the back and consumed from the front in O(1) (no
+ * shifting of the remaining data); storage is a power-of-two ring that doubles
+ * when it runs out of room.
+ *
+ * Parsing code looks at messages in place with data() (which only has to move
+ * bytes when the readable region wraps around the end of the ring) and then
+ * pop()s them; sockets read and write directly into/out of the ring through the
+ * spans from readable_spans() / writable_spans() (readv/writev style).
+ */
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct RingBuffer {
+	RingBuffer(size_t capacity = 4096);
+
+	//number of bytes waiting to be consumed:
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	void clear() { head = 0; count = 0; }
+
+	//i'th waiting byte:
+	char operator[](size_t i) const {
+		assert(i < count);
+		return storage[(head + i) & mask];
+	}
+
+	//append bytes at the back:
+	void push(void const *data, size_t size);
+
+	//copy 'size' bytes starting at 'offset' out (without consuming them):
+	void peek(size_t offset, void *out, size_t size) const;
+
+	//all waiting bytes as one contiguous block (valid until the next push/pop/commit):
+	// (rotates the ring if the bytes wrap around its end)
+	char *data();
+
+	//consume bytes from the front:
+	void pop(size_t size) {
+		assert(size <= count);
+		head = (head + size) & mask;
+		count -= size;
+		if (count == 0) head = 0; //(keeps the next data() contiguous for free)
+	}
+
+	//for scatter/gather I/O:
+	struct Span {
+		char *data = nullptr;
+		size_t size = 0;
+	};
+	//regions holding the waiting bytes, in order; returns the number of spans used (0-2):
+	uint32_t readable_spans(Span spans[2]);
+	//free regions after the waiting bytes, growing first if fewer than 'at_least' bytes are free;
+	// returns the number of spans used (1-2):
+	uint32_t writable_spans(Span spans[2], size_t at_least);
+	//mark 'size' bytes written into the writable spans as waiting:
+	void commit(size_t size) {
+		assert(count + size <= storage.size());
+		count += size;
+	}
+
+	void swap(RingBuffer &other) {
+		storage.swap(other.storage);
+		std::swap(mask, other.mask);
+		std::swap(head, other.head);
+		std::swap(count, other.count);
+	}
+
+	size_t capacity() const { return storage.size(); }
+
+	//internals:
+	void reserve(size_t size); //grow (to a power of two) so at least 'size' bytes fit
+	std::vector< char > storage;
+	size_t mask = 0; //storage.size() - 1
+	size_t head = 0; //index of the first waiting byte
+	size_t count = 0; //number of waiting bytes
+};
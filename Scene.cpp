@@ -1,11 +1,13 @@
 #include "Scene.hpp"
 
 #include "gl_errors.hpp"
+#include "MappedFile.hpp"
 #include "read_write_chunk.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <iomanip>
 
@@ -54,18 +56,45 @@ glm::mat4 Scene::Transform::make_parent_to_local() const {
 }
 
 glm::mat4 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * make_local_to_parent();
-	}
+	update_cache();
+	return cache.local_to_world;
 }
 glm::mat4 Scene::Transform::make_world_to_local() const {
+	update_cache();
+	return cache.world_to_local;
+}
+
+void Scene::Transform::update_cache(bool check_parent) const {
+	//versions are handed out from a single counter so that a stale parent_version can never match by accident:
+	// (atomic because the server updates several levels at once from worker threads)
+	static std::atomic< uint64_t > next_version(0);
+
+	if (parent && check_parent) parent->update_cache();
+	uint64_t parent_version = (parent ? parent->cache.version : 0);
+
+	if (cache.version != 0
+	 && cache.position == position
+	 && cache.rotation == rotation
+	 && cache.scale == scale
+	 && cache.parent == parent
+	 && cache.parent_version == parent_version) {
+		return; //still good
+	}
+
 	if (!parent) {
-		return make_parent_to_local();
+		cache.local_to_world = make_local_to_parent();
+		cache.world_to_local = make_parent_to_local();
 	} else {
-		return make_parent_to_local() * parent->make_world_to_local();
+		cache.local_to_world = parent->cache.local_to_world * make_local_to_parent();
+		cache.world_to_local = make_parent_to_local() * parent->cache.world_to_local;
 	}
+
+	cache.position = position;
+	cache.rotation = rotation;
+	cache.scale = scale;
+	cache.parent = parent;
+	cache.parent_version = parent_version;
+	cache.version = ++next_version;
 }
 
 //-------------------------
@@ -83,6 +112,259 @@ glm::mat4 Scene::OrthoCam::make_projection() const {
 
 //-------------------------
 
+Scene::Transform *Scene::add_transform() {
+	transforms.emplace_back();
+	Transform *t = &transforms.back();
+
+	//take a free handle, or make a new one:
+	if (!packed.free.empty()) {
+		t->handle = packed.free.back();
+		packed.free.pop_back();
+	} else {
+		t->handle = uint32_t(packed.transforms.size());
+		packed.transforms.emplace_back();
+		packed.parents.emplace_back();
+		packed.positions.emplace_back();
+		packed.rotations.emplace_back();
+		packed.scales.emplace_back();
+		packed.local_to_world.emplace_back();
+		packed.dirty.emplace_back();
+		packed.changed.emplace_back();
+	}
+	packed.transforms[t->handle] = t;
+	packed.parents[t->handle] = -1U;
+	packed.dirty[t->handle] = 1;
+
+	++generation;
+	return t;
+}
+
+Scene::Drawable *Scene::add_drawable(Transform *transform) {
+	drawables.emplace_back(transform);
+	++generation;
+	return &drawables.back();
+}
+
+Scene::Camera *Scene::add_camera(Transform *transform) {
+	cameras.emplace_back(transform);
+	++generation;
+	return &cameras.back();
+}
+
+Scene::OrthoCam *Scene::add_orthocam(Transform *transform) {
+	orthocams.emplace_back(transform);
+	++generation;
+	return &orthocams.back();
+}
+
+Scene::Light *Scene::add_light(Transform *transform) {
+	lights.emplace_back(transform);
+	++generation;
+	return &lights.back();
+}
+
+std::list< Scene::Transform >::iterator Scene::erase_transform(std::list< Transform >::iterator at) {
+	uint32_t h = packed_handle(&*at);
+	if (h < packed.transforms.size()) {
+		packed.transforms[h] = nullptr;
+		packed.free.emplace_back(h);
+	}
+	++generation;
+	return transforms.erase(at);
+}
+
+std::list< Scene::Drawable >::iterator Scene::erase_drawable(std::list< Drawable >::iterator at) {
+	++generation;
+	return drawables.erase(at);
+}
+
+std::list< Scene::Camera >::iterator Scene::erase_camera(std::list< Camera >::iterator at) {
+	++generation;
+	return cameras.erase(at);
+}
+
+std::list< Scene::OrthoCam >::iterator Scene::erase_orthocam(std::list< OrthoCam >::iterator at) {
+	++generation;
+	return orthocams.erase(at);
+}
+
+std::list< Scene::Light >::iterator Scene::erase_light(std::list< Light >::iterator at) {
+	++generation;
+	return lights.erase(at);
+}
+
+uint32_t Scene::packed_handle(Transform const *t) const {
+	if (!t) return -1U;
+	if (t->handle < packed.transforms.size() && packed.transforms[t->handle] == t) return t->handle;
+	return -2U;
+}
+
+void Scene::pack() const {
+	packed.generation = generation;
+	packed.ok = false;
+	packed.order.clear();
+	packed.drawables.clear();
+	packed.cameras.clear();
+	packed.orthocams.clear();
+	packed.lights.clear();
+
+	//every transform needs a handle here (i.e., was added with add_transform()), and
+	// packed updates need parents that live in this scene and come before their children:
+	std::vector< uint8_t > &seen = packed.changed;
+	std::fill(seen.begin(), seen.end(), 0);
+	packed.order.reserve(transforms.size());
+	for (auto const &t : transforms) {
+		uint32_t h = packed_handle(&t);
+		if (h >= -2U) return;
+		uint32_t p = packed_handle(t.parent);
+		if (p == -2U || (p != -1U && !seen[p])) return;
+		if (packed.parents[h] != p) {
+			packed.parents[h] = p;
+			packed.dirty[h] = 1;
+		}
+		seen[h] = 1;
+		packed.order.emplace_back(h);
+	}
+
+	//drawables/cameras/lights must reference transforms in this scene:
+	bool ok = true;
+	auto lookup_checked = [&](Transform const *t) {
+		uint32_t h = packed_handle(t);
+		if (h >= -2U) ok = false;
+		return h;
+	};
+
+	packed.drawables.reserve(drawables.size());
+	for (auto const &d : drawables) {
+		Packed::Drawable pd;
+		pd.transform = lookup_checked(d.transform);
+		pd.drawable = &d;
+		packed.drawables.emplace_back(pd);
+	}
+	for (auto const &c : cameras) packed.cameras.emplace_back(lookup_checked(c.transform));
+	for (auto const &c : orthocams) packed.orthocams.emplace_back(lookup_checked(c.transform));
+	for (auto const &l : lights) packed.lights.emplace_back(lookup_checked(l.transform));
+
+	packed.ok = ok;
+}
+
+bool Scene::packed_current() const {
+	//(the sizes catch lists edited around the add/erase functions, at least when that adds or removes)
+	return packed.ok && packed.generation == generation
+	    && packed.order.size() == transforms.size()
+	    && packed.drawables.size() == drawables.size()
+	    && packed.cameras.size() == cameras.size()
+	    && packed.orthocams.size() == orthocams.size()
+	    && packed.lights.size() == lights.size();
+}
+
+void Scene::update_transforms() const {
+	if (!packed_current() && (packed.generation != generation || packed.ok)) pack();
+
+	if (!packed.ok) {
+		//transforms are created parent-first (see load() and set()), so each parent's cache is
+		// already current when its children are visited.
+		//(if some code re-parents onto a later transform, the child just picks up the
+		// parent's new version lazily at its next make_local_to_world() call.)
+		for (auto const &t : transforms) {
+			t.update_cache(false);
+		}
+		return;
+	}
+
+	//packed path: compare local transforms against the arrays and recompute only what changed
+	// (a transform needs recomputing if its own local transform or any ancestor changed):
+	std::vector< uint8_t > &changed = packed.changed;
+	for (uint32_t h : packed.order) {
+		Transform const &t = *packed.transforms[h];
+		uint32_t p = packed.parents[h];
+		if (packed_handle(t.parent) != p) {
+			//re-parented since pack(); re-pack (the order may have to change) or fall back to the list:
+			packed.generation = -1ULL;
+			update_transforms();
+			return;
+		}
+		if (packed.dirty[h]
+		 || packed.positions[h] != t.position
+		 || packed.rotations[h] != t.rotation
+		 || packed.scales[h] != t.scale
+		 || (p != -1U && changed[p])) {
+			packed.positions[h] = t.position;
+			packed.rotations[h] = t.rotation;
+			packed.scales[h] = t.scale;
+			if (p == -1U) {
+				packed.local_to_world[h] = t.make_local_to_parent();
+			} else {
+				packed.local_to_world[h] = packed.local_to_world[p] * t.make_local_to_parent();
+			}
+			packed.dirty[h] = 0;
+			changed[h] = 1;
+		} else {
+			changed[h] = 0;
+		}
+	}
+
+	//refresh world bounds of drawables that moved (or whose object-space bounds were edited):
+	for (auto &pd : packed.drawables) {
+		Drawable const &d = *pd.drawable;
+		if (pd.fresh && !changed[pd.transform] && pd.local_min == d.min && pd.local_max == d.max) continue;
+		pd.fresh = true;
+		pd.local_min = d.min;
+		pd.local_max = d.max;
+		transform_bounds(packed.local_to_world[pd.transform], d.min, d.max, &pd.world_min, &pd.world_max);
+	}
+}
+
+Scene::Frustum::Frustum(glm::mat4 const &world_to_clip) {
+	//a point is inside if -w <= x,y,z <= w, i.e., (row3 +/- row_i) . p >= 0:
+	glm::vec4 rows[4];
+	for (uint32_t r = 0; r < 4; ++r) {
+		rows[r] = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+	}
+	for (uint32_t r = 0; r < 3; ++r) {
+		for (float sign : {1.0f, -1.0f}) {
+			glm::vec4 plane = rows[3] + sign * rows[r];
+			float len = glm::length(glm::vec3(plane));
+			//infinite perspective projections have a far 'plane' with no normal:
+			if (len < 1e-6f) continue;
+			planes[count++] = plane / len;
+		}
+	}
+}
+
+bool Scene::Frustum::intersects(glm::vec3 const &min, glm::vec3 const &max) const {
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::vec4 const &plane = planes[i];
+		//the box corner furthest along the plane normal:
+		glm::vec3 corner = glm::vec3(
+			plane.x >= 0.0f ? max.x : min.x,
+			plane.y >= 0.0f ? max.y : min.y,
+			plane.z >= 0.0f ? max.z : min.z
+		);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) return false;
+	}
+	return true;
+}
+
+void Scene::transform_bounds(glm::mat4 const &to_world, glm::vec3 const &min, glm::vec3 const &max,
+	glm::vec3 *world_min, glm::vec3 *world_max) {
+	assert(world_min && world_max);
+	if (!(min.x <= max.x && min.y <= max.y && min.z <= max.z)) {
+		*world_min = min;
+		*world_max = max;
+		return;
+	}
+	//center/extent form, extent goes through |M| (Arvo):
+	glm::vec3 center = glm::vec3(to_world * glm::vec4(0.5f * (min + max), 1.0f));
+	glm::vec3 extent = 0.5f * (max - min);
+	glm::vec3 world_extent = glm::vec3(0.0f);
+	for (uint32_t c = 0; c < 3; ++c) {
+		world_extent += glm::abs(glm::vec3(to_world[c])) * extent[c];
+	}
+	*world_min = center - world_extent;
+	*world_max = center + world_extent;
+}
+
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
 	glm::mat4 world_to_clip = camera.make_projection() * camera.transform->make_world_to_local();
@@ -92,8 +374,24 @@ void Scene::draw(Camera const &camera) const {
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
+	//bring world matrices up to date:
+	update_transforms();
+
+	//Gather drawables into the render queue:
+	// (walks the packed array if available, otherwise the list)
+	std::vector< RenderQueue::Item > &items = render_queue.items;
+	items.clear();
+	items.reserve(drawables.size());
+
+	Frustum frustum(world_to_clip);
+	DrawStats::View &view = draw_stats.last_view;
+	view = DrawStats::View();
+
+	bool use_packed = packed_current();
+	auto list_it = drawables.begin();
+	for (size_t di = 0; di < drawables.size(); ++di) {
+		Scene::Drawable const &drawable = (use_packed ? *packed.drawables[di].drawable : *list_it++);
+
 		//Reference to drawable's pipeline for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
@@ -102,17 +400,96 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
 
+		assert(drawable.transform); //drawables *must* have a transform
+		glm::mat4 const &object_to_world = (use_packed
+			? packed.local_to_world[packed.drawables[di].transform]
+			: drawable.transform->cache.local_to_world); //(refreshed by update_transforms(), above)
+
+		//skip any drawables that are entirely outside the view:
+		if (cull) {
+			glm::vec3 world_min, world_max;
+			if (use_packed) {
+				world_min = packed.drawables[di].world_min;
+				world_max = packed.drawables[di].world_max;
+			} else {
+				transform_bounds(object_to_world, drawable.min, drawable.max, &world_min, &world_max);
+			}
+			if (world_min.x <= world_max.x && !frustum.intersects(world_min, world_max)) {
+				view.culled += 1;
+				continue;
+			}
+		}
+		view.submitted += 1;
+
+		RenderQueue::Item item;
+		item.program = pipeline.program;
+		item.vao = pipeline.vao;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			item.textures[i] = pipeline.textures[i].texture;
+		}
+		glm::vec4 origin = world_to_clip * object_to_world[3];
+		item.depth = origin.z;
+		item.drawable = uint32_t(di);
+		item.ptr = &drawable;
+		item.object_to_world = &object_to_world;
+		items.emplace_back(item);
+	}
+
+	draw_stats.submitted += view.submitted;
+	draw_stats.culled += view.culled;
+
+	//Sort by state, then front-to-back (ties keep scene order, so the result is stable frame to frame):
+	std::sort(items.begin(), items.end(), [](RenderQueue::Item const &a, RenderQueue::Item const &b) {
+		if (a.program != b.program) return a.program < b.program;
+		if (a.vao != b.vao) return a.vao < b.vao;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			if (a.textures[i] != b.textures[i]) return a.textures[i] < b.textures[i];
+		}
+		if (a.depth != b.depth) return a.depth < b.depth;
+		return a.drawable < b.drawable;
+	});
+
+	//Currently bound state (program 0 / vao -1U => nothing bound by us yet):
+	GLuint bound_program = 0;
+	GLuint bound_vao = -1U;
+	Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount];
+
+	for (auto const &item : items) {
+		Scene::Drawable const &drawable = *item.ptr;
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+		//what binding everything per drawable (and un-binding textures after) would have cost:
+		uint32_t naive_changes = 2;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			if (pipeline.textures[i].texture != 0) naive_changes += 2;
+		}
+		uint32_t changes = 0;
+
 		//Set shader program:
-		glUseProgram(pipeline.program);
+		if (pipeline.program != bound_program) {
+			glUseProgram(pipeline.program);
+			bound_program = pipeline.program;
+			draw_stats.program_binds += 1;
+			changes += 1;
+		}
 
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		if (pipeline.vao != bound_vao) {
+			glBindVertexArray(pipeline.vao);
+			bound_vao = pipeline.vao;
+			draw_stats.vao_binds += 1;
+			changes += 1;
+		}
 
 		//Configure program uniforms:
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4 object_to_world = drawable.transform->make_local_to_world();
+		//the object-to-world matrix is used in all four of these uniforms:
+		glm::mat4 const &object_to_world = *item.object_to_world;
+
+		//OBJECT_TO_WORLD takes vertices from object space to world space:
+		if (pipeline.OBJECT_TO_WORLD_mat4 != -1U) {
+			glUniformMatrix4fv(pipeline.OBJECT_TO_WORLD_mat4, 1, GL_FALSE, glm::value_ptr(object_to_world));
+		}
 
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
@@ -134,31 +511,53 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
 		}
 
+		if (pipeline.OBJECT_SMOOTH_ID_float != -1U) {
+			glUniform1f(pipeline.OBJECT_SMOOTH_ID_float, pipeline.smooth_id);
+		}
+
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
 		//set up textures:
+		// (units the new key doesn't use are cleared, so programs never see a stale texture)
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[i];
+			Drawable::Pipeline::TextureInfo &have = bound_textures[i];
+			if (want.texture == have.texture && (want.texture == 0 || want.target == have.target)) continue;
+			glActiveTexture(GL_TEXTURE0 + i);
+			if (have.texture != 0 && (want.texture == 0 || want.target != have.target)) {
+				glBindTexture(have.target, 0);
+				draw_stats.texture_binds += 1;
+				changes += 1;
+			}
+			if (want.texture != 0) {
+				glBindTexture(want.target, want.texture);
+				draw_stats.texture_binds += 1;
+				changes += 1;
 			}
+			have = want;
 		}
 
 		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
-
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+		if (pipeline.index_type != GL_NONE) {
+			glDrawElements(pipeline.type, pipeline.count, pipeline.index_type, (GLbyte *)0 + pipeline.start * sizeof(uint32_t));
+		} else {
+			glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
 		}
-		glActiveTexture(GL_TEXTURE0);
 
+		draw_stats.draws += 1;
+		if (naive_changes > changes) draw_stats.state_changes_saved += naive_changes - changes;
 	}
 
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (bound_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(bound_textures[i].target, 0);
+		}
+	}
+	glActiveTexture(GL_TEXTURE0);
+
 	glUseProgram(0);
 	glBindVertexArray(0);
 
@@ -169,10 +568,11 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	//read chunks in place:
+	MappedFile file(filename);
+	ChunkReader reader(file.data, file.size);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkSpan< char > names = reader.read< char >("str0");
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +583,7 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	ChunkSpan< HierarchyEntry > hierarchy = reader.read< HierarchyEntry >("xfh0");
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +591,7 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkSpan< MeshEntry > meshes = reader.read< MeshEntry >("msh0");
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +600,7 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	ChunkSpan< CameraEntry > cameras = reader.read< CameraEntry >("cam0");
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,10 +611,9 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
+	ChunkSpan< LightEntry > lights = reader.read< LightEntry >("lmp0");
 
-	if (file.peek() != EOF) {
+	if (!reader.done()) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -228,8 +624,7 @@ void Scene::load(std::string const &filename,
 	hierarchy_transforms.reserve(hierarchy.size());
 
 	for (auto const &h : hierarchy) {
-		transforms.emplace_back();
-		Transform *t = &transforms.back();
+		Transform *t = add_transform();
 		if (h.parent != -1U) {
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
@@ -238,7 +633,7 @@ void Scene::load(std::string const &filename,
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			t->name = std::string(names.bytes + h.name_begin, names.bytes + h.name_end);
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -258,7 +653,7 @@ void Scene::load(std::string const &filename,
 		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
+		std::string name = std::string(names.bytes + m.name_begin, names.bytes + m.name_end);
 
 		if (on_drawable) {
 			on_drawable(*this, hierarchy_transforms[m.transform], name);
@@ -271,14 +666,12 @@ void Scene::load(std::string const &filename,
 			throw std::runtime_error("scene file '" + filename + "' contains camera entry with invalid transform index (" + std::to_string(c.transform) + ")");
 		}
 		if (std::string(c.type, 4) == "pers") {
-  		this->cameras.emplace_back(hierarchy_transforms[c.transform]);
-  		Camera *camera = &this->cameras.back();
+  		Camera *camera = add_camera(hierarchy_transforms[c.transform]);
   		camera->fovy = c.data / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
   		camera->near = c.clip_near;
   		//N.b. far plane is ignored because cameras use infinite perspective matrices.
 		} else if (std::string(c.type, 4) == "orth") {
-      this->orthocams.emplace_back(hierarchy_transforms[c.transform]);
-  		OrthoCam *orthocam = &this->orthocams.back();
+  		OrthoCam *orthocam = add_orthocam(hierarchy_transforms[c.transform]);
       orthocam->scale = c.data;
       orthocam->clip_near = c.clip_near;
       orthocam->clip_far = c.clip_far;
@@ -303,8 +696,7 @@ void Scene::load(std::string const &filename,
 			std::cout << "Ignoring unrecognized lamp type (" + std::string(&l.type, 1) + ") stored in file." << std::endl;
 			continue;
 		}
-		this->lights.emplace_back(hierarchy_transforms[l.transform]);
-		Light *light = &this->lights.back();
+		Light *light = add_light(hierarchy_transforms[l.transform]);
 		light->type = static_cast<Light::Type>(l.type);
     light->color = glm::vec3(l.color) / 255.0f;
 		light->energy = light->color * l.energy;
@@ -314,6 +706,7 @@ void Scene::load(std::string const &filename,
     print_u8vec3(l.color); std::cout << std::endl;
 	}
 
+	pack();
 
 }
 
@@ -334,6 +727,61 @@ Scene &Scene::operator=(Scene const &other) {
 
 void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
 
+	if (other.packed_current()) {
+		//Packed copy: everything in 'other' refers to transforms by handle, so fixup is just an array lookup.
+
+		//Copy transforms (parents first), remembering the copy of each handle:
+		std::vector< Transform * > handle_to_transform(other.packed.transforms.size(), nullptr);
+		auto at = [&handle_to_transform](uint32_t h) -> Transform * {
+			return (h == -1U ? nullptr : handle_to_transform[h]);
+		};
+		for (uint32_t h : other.packed.order) {
+			Transform const &t = *other.packed.transforms[h];
+			Transform *copy = add_transform();
+			copy->name = t.name;
+			copy->position = t.position;
+			copy->rotation = t.rotation;
+			copy->scale = t.scale;
+			copy->parent = at(other.packed.parents[h]);
+			handle_to_transform[h] = copy;
+		}
+
+		//copy other's drawables, cameras, orthocams, and lights, updating transform pointers:
+		drawables = other.drawables;
+		{
+			uint32_t i = 0;
+			for (auto &d : drawables) d.transform = at(other.packed.drawables[i++].transform);
+		}
+		cameras = other.cameras;
+		{
+			uint32_t i = 0;
+			for (auto &c : cameras) c.transform = at(other.packed.cameras[i++]);
+		}
+		orthocams = other.orthocams;
+		{
+			uint32_t i = 0;
+			for (auto &c : orthocams) c.transform = at(other.packed.orthocams[i++]);
+		}
+		lights = other.lights;
+		{
+			uint32_t i = 0;
+			for (auto &l : lights) l.transform = at(other.packed.lights[i++]);
+		}
+		++generation;
+
+		//caller asked for the mapping explicitly, so build it:
+		if (transform_map_) {
+			transform_map_->clear();
+			transform_map_->insert(std::make_pair(nullptr, nullptr));
+			for (uint32_t h : other.packed.order) {
+				transform_map_->insert(std::make_pair(other.packed.transforms[h], handle_to_transform[h]));
+			}
+		}
+
+		pack();
+		return;
+	}
+
 	std::unordered_map< Transform const *, Transform * > t2t_temp;
 	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
 
@@ -344,21 +792,22 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 
 	//Copy transforms and store mapping:
 	for (auto const &t : other.transforms) {
-		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
+		Transform *copy = add_transform();
+		copy->name = t.name;
+		copy->position = t.position;
+		copy->rotation = t.rotation;
+		copy->scale = t.scale;
+		copy->parent = t.parent; //will update later
 
 		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
+		auto ret = transform_to_transform.insert(std::make_pair(&t, copy));
 		assert(ret.second);
 	}
 
-	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	//update transform parents (of the copies):
+	for (auto const &t : other.transforms) {
+		Transform *copy = transform_to_transform.at(&t);
+		copy->parent = transform_to_transform.at(t.parent);
 	}
 
 	//copy other's drawables, updating transform pointers:
@@ -373,9 +822,18 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 		c.transform = transform_to_transform.at(c.transform);
 	}
 
+	//copy other's orthographic cameras, updating transform pointers:
+	orthocams = other.orthocams;
+	for (auto &c : orthocams) {
+		c.transform = transform_to_transform.at(c.transform);
+	}
+
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
 		l.transform = transform_to_transform.at(l.transform);
 	}
+	++generation;
+
+	pack();
 }
@@ -17,6 +17,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <limits>
 #include <list>
 #include <memory>
 #include <functional>
@@ -42,9 +43,31 @@ struct Scene {
 		glm::mat4 make_local_to_parent() const;
 		glm::mat4 make_parent_to_local() const;
 		// ..relative to the world:
+		// (these are served from 'cache', below, and only rebuilt when something changed)
 		glm::mat4 make_local_to_world() const;
 		glm::mat4 make_world_to_local() const;
 
+		//World matrices are cached per-transform. The cache remembers the local
+		// position/rotation/scale/parent it was built from and the version of the
+		// parent's cache, so code that assigns those fields directly invalidates it
+		// without having to do anything special:
+		struct Cache {
+			uint64_t version = 0; //0 => never built; bumped every time the matrices change
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			uint64_t parent_version = 0;
+			glm::mat4 local_to_world = glm::mat4(1.0f);
+			glm::mat4 world_to_local = glm::mat4(1.0f);
+		};
+		mutable Cache cache;
+		//bring 'cache' up to date; if 'check_parent' is false, parent's cache is assumed to be current:
+		void update_cache(bool check_parent = true) const;
+
+		//this transform's index in its scene's packed arrays (see Scene::Packed; -1U until it is added):
+		uint32_t handle = -1U;
+
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
@@ -56,6 +79,11 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//(optional) object-space bounding box, used for frustum culling:
+		// (drawables with min > max -- the default -- are never culled)
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -66,6 +94,7 @@ struct Scene {
 			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
+			GLenum index_type = GL_NONE; //if set (see Mesh::index_type), start/count are a range of the vao's element buffer, drawn with glDrawElements
 
 			//uniforms:
       GLuint OBJECT_TO_WORLD_mat4 = -1U; //uniform location for object to world space matrix
@@ -75,6 +104,7 @@ struct Scene {
 
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
+      GLuint OBJECT_SMOOTH_ID_float = -1U; //uniform location for 'smooth_id', below (outline shading groups)
       float smooth_id = 0.0f;
 			//texture objects to bind for the first TextureCount textures:
 			enum : uint32_t { TextureCount = 4 };
@@ -135,13 +165,135 @@ struct Scene {
 		float spot_fov = glm::radians(45.0f);
 	};
 
-	//Scenes, of course, may have many of the above objects:
+	//Scenes, of course, may have many of the above objects.
+	// Add and remove them with the functions below, not through the lists themselves: those keep
+	// 'packed' in step. (The lists are public for iterating and for editing elements in place.)
 	std::list< Transform > transforms;
 	std::list< Drawable > drawables;
 	std::list< Camera > cameras;
 	std::list< OrthoCam > orthocams;
 	std::list< Light > lights;
 
+	//new transforms go at the end of 'transforms', so add parents before their children:
+	Transform *add_transform();
+	Drawable *add_drawable(Transform *transform);
+	Camera *add_camera(Transform *transform);
+	OrthoCam *add_orthocam(Transform *transform);
+	Light *add_light(Transform *transform);
+	//remove (as std::list::erase, these return the next element):
+	// (erase a transform only once nothing -- drawable, camera, light, or child -- refers to it)
+	std::list< Transform >::iterator erase_transform(std::list< Transform >::iterator at);
+	std::list< Drawable >::iterator erase_drawable(std::list< Drawable >::iterator at);
+	std::list< Camera >::iterator erase_camera(std::list< Camera >::iterator at);
+	std::list< OrthoCam >::iterator erase_orthocam(std::list< OrthoCam >::iterator at);
+	std::list< Light >::iterator erase_light(std::list< Light >::iterator at);
+	//bumped by every add/erase above (and by load() and set()):
+	uint64_t generation = 0;
+
+	//Packed storage: the transforms as structure-of-arrays, plus index-addressed copies of what
+	// refers to them, for the per-frame loops (world matrix updates, culling, drawing, copying).
+	// The lists stay the owners (so Transform * / Drawable * held by game code stay valid); the
+	// per-transform arrays are addressed by Transform::handle, which a transform keeps for as long
+	// as it is in the scene (erased transforms' handles are reused by later add_transform() calls):
+	struct Packed {
+		uint64_t generation = -1ULL; //Scene::generation as of the last pack() (-1 => not packed)
+		bool ok = false; //did that pack() work? (if not, the lists are walked until the next add/erase)
+
+		//per transform handle (entries of free handles are unused):
+		std::vector< Transform const * > transforms; //(nullptr for free handles)
+		std::vector< uint32_t > parents; //handle of parent, or -1U for roots
+		std::vector< glm::vec3 > positions; //(the local transforms local_to_world was built from)
+		std::vector< glm::quat > rotations;
+		std::vector< glm::vec3 > scales;
+		std::vector< glm::mat4 > local_to_world;
+		std::vector< uint8_t > dirty; //local_to_world needs rebuilding regardless (new handle, new parent)
+		std::vector< uint8_t > changed; //scratch space for pack() and update_transforms()
+		std::vector< uint32_t > free; //handles not in use
+
+		std::vector< uint32_t > order; //handles of all transforms, parents first (same order as 'transforms')
+
+		//per drawable, in the same order as 'drawables':
+		struct Drawable {
+			uint32_t transform; //transform handle
+			Scene::Drawable const *drawable;
+			//world-space bounds, kept current by update_transforms():
+			bool fresh = false; //(have they been computed at all?)
+			glm::vec3 local_min, local_max; //(the object-space bounds world_min/max were built from)
+			glm::vec3 world_min, world_max;
+		};
+		std::vector< Drawable > drawables;
+
+		//transform handles of cameras, orthocams, and lights (same order as their lists):
+		std::vector< uint32_t > cameras;
+		std::vector< uint32_t > orthocams;
+		std::vector< uint32_t > lights;
+	};
+	mutable Packed packed;
+	//handle of 't' if it is one of this scene's transforms; -1U for nullptr, -2U otherwise:
+	uint32_t packed_handle(Transform const *t) const;
+
+	//(re-)build the order and drawable/camera/light arrays of 'packed' from the lists:
+	// (update_transforms() does this itself after adds, erases, and re-parenting)
+	void pack() const;
+	//does 'packed' match the lists?
+	bool packed_current() const;
+
+	//Refresh world matrices in one parent-before-child pass:
+	// (transforms are stored in topological order, so this is one matrix product per changed transform)
+	// if the scene packs, this fills packed.local_to_world; otherwise it refreshes each Transform::cache.
+	void update_transforms() const;
+
+	//Frustum culling:
+	// planes are extracted from a world_to_clip matrix, so this works for perspective
+	// (including infinite far planes, which are skipped) and orthographic projections alike:
+	struct Frustum {
+		Frustum(glm::mat4 const &world_to_clip);
+		glm::vec4 planes[6]; //(xyz = inward normal, w = offset)
+		uint32_t count = 0;
+		//could anything inside the world-space box [min,max] be visible?
+		bool intersects(glm::vec3 const &min, glm::vec3 const &max) const;
+	};
+	//world-space box around an object-space box (min > max passes through unchanged):
+	static void transform_bounds(glm::mat4 const &to_world, glm::vec3 const &min, glm::vec3 const &max,
+		glm::vec3 *world_min, glm::vec3 *world_max);
+	//draw() skips drawables whose bounds are outside the view:
+	bool cull = true;
+
+	//Render queue: draw() sorts drawables by the GL state they need (program, then vao,
+	// then textures) and then front-to-back, and only changes state when that key changes:
+	struct RenderQueue {
+		struct Item {
+			GLuint program;
+			GLuint vao;
+			GLuint textures[Drawable::Pipeline::TextureCount];
+			float depth; //clip-space z of the object's origin; smaller is nearer
+			uint32_t drawable; //index into packed.drawables (or position in the 'drawables' list)
+			Drawable const *ptr;
+			glm::mat4 const *object_to_world;
+		};
+		std::vector< Item > items; //kept around so draw() doesn't allocate every frame
+	};
+	mutable RenderQueue render_queue;
+
+	//Counters accumulated by draw(); clear with 'draw_stats = DrawStats();' at the start of a frame:
+	struct DrawStats {
+		uint32_t draws = 0; //drawables actually submitted
+		uint32_t program_binds = 0;
+		uint32_t vao_binds = 0;
+		uint32_t texture_binds = 0; //includes un-binds of units the next key doesn't use
+		//binds skipped compared to setting (and clearing) all state for every drawable:
+		uint32_t state_changes_saved = 0;
+		//culling results, summed over draw() calls:
+		uint32_t submitted = 0; //passed the frustum test
+		uint32_t culled = 0;
+		//..and for the most recent draw() call alone:
+		struct View {
+			uint32_t submitted = 0;
+			uint32_t culled = 0;
+		} last_view;
+	};
+	mutable DrawStats draw_stats;
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
 
@@ -161,7 +313,7 @@ struct Scene {
 	//load a scene:
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
 
-	//copy a scene (with proper pointer fixup):
+	//copy a scene (with proper pointer fixup; by index if 'other' is packed):
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
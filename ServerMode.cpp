@@ -10,8 +10,14 @@ ServerMode::ServerMode(std::string const &port,
 
   connect = nullptr;
   if (port != "") {
-	  server.reset(new Server(port));
+    if (transport.datagrams) {
+      datagram_server.reset(new DatagramServer(port));
+      datagram_server->conditions = transport.conditions;
+    } else {
+      server.reset(new Server(port));
+    }
   }
+  start_recording();
 
 }
 
@@ -19,7 +25,7 @@ void ServerMode::handle_reset() {
   if (connect) {
     we_want_reset = true;
     reset_countdown = 0.01f;
-    connect->send('R');
+    Protocol::Message('R').send(connect);
     std::cout << "Requested reset" << std::endl;
     // TODO just call resume at the end
     pause = false;
@@ -31,17 +37,23 @@ void ServerMode::handle_reset() {
 void ServerMode::update_network() {
 
   update_send();
-  server->poll([this](Connection *connection, Connection::Event evt) {
+  auto on_event = [this](Connection *connection, Connection::Event evt) {
     //Read server state
     if (evt == Connection::OnRecv) {
-      update_recv(connection->recv_buffer);
+      update_recv(connection);
     } else if (evt == Connection::OnClose) {
-      connect = nullptr;
+      if (connection == connect) connect = nullptr;
     } else if (evt == Connection::OnOpen) {
-      if (server->connections.size() == 1) {
-        connect = &server->connections.front();
+      //(play with the first peer to connect)
+      if (!connect) {
+        connect = connection;
+        record_connection(connect);
+        peer_hello = false;
+        Protocol::send_hello(connect);
       }
     }
-  }, 0.0);
+  };
+  if (datagram_server) datagram_server->poll(on_event, 0.0);
+  else if (server) server->poll(on_event, 0.0);
 
 }
@@ -2,6 +2,7 @@
 
 #include "PlayerMode.hpp"
 #include "Connection.hpp"
+#include "Datagram.hpp"
 
 struct ServerMode : PlayerMode {
 
@@ -12,5 +13,6 @@ struct ServerMode : PlayerMode {
   void update_network() override;
 
   std::unique_ptr< Server > server;
+  std::unique_ptr< DatagramServer > datagram_server; //(instead of 'server' if transport.datagrams)
 
 };
@@ -0,0 +1,340 @@
+#include "Session.hpp"
+#include "data_path.hpp"
+#include "Physics.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+LevelLoader::LevelLoader(uint32_t thread_count, size_t max_queued_) : max_queued(max_queued_) {
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		threads.emplace_back(&LevelLoader::run, this);
+	}
+}
+
+LevelLoader::~LevelLoader() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		stopping = true;
+		queue.clear();
+	}
+	wake.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+std::shared_ptr< LevelLoader::Load > LevelLoader::request(uint32_t level_num) {
+	std::shared_ptr< Load > load = std::make_shared< Load >();
+	load->level_num = level_num;
+	load->asked = std::chrono::steady_clock::now();
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		//(loads nobody wants any more don't take up room in the queue)
+		queue.erase(std::remove_if(queue.begin(), queue.end(), [](std::shared_ptr< Load > const &l) {
+			return l->cancelled.load();
+		}), queue.end());
+		if (queue.size() >= max_queued) return nullptr;
+		queue.emplace_back(load);
+	}
+	wake.notify_one();
+	return load;
+}
+
+void LevelLoader::run() {
+	while (true) {
+		std::shared_ptr< Load > load;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			wake.wait(lock, [this](){ return stopping || !queue.empty(); });
+			if (stopping) return;
+			load = std::move(queue.front());
+			queue.pop_front();
+		}
+		if (load->cancelled) continue;
+
+		std::string level_str ("level");
+		level_str = level_str + std::to_string(load->level_num);
+		try {
+			load->level.reset(new GameLevel(data_path(level_str), true));
+		} catch (std::exception const &e) {
+			load->error = e.what();
+		}
+		load->done = true;
+	}
+}
+
+Session::Session(uint64_t id_, uint32_t level_num_, LevelLoader &loader_) : id(id_), loader(loader_) {
+	level_change(level_num_);
+}
+
+Session::~Session() {
+	if (load) load->cancelled = true;
+	delete level;
+}
+
+void Session::level_change(uint32_t level_num_) {
+	level_num = level_num_;
+	std::cout << "[Session " << id << "] loading level " << level_num << std::endl;
+
+	if (load) load->cancelled = true;
+	load = loader.request(level_num);
+	loading = true;
+}
+
+bool Session::finish_level_change() {
+	if (!loading) return true;
+	if (failed) return false;
+	if (!load && !(load = loader.request(level_num))) return false; //(queue still full)
+	if (!load->done) return false;
+
+	std::shared_ptr< LevelLoader::Load > done = std::move(load);
+	load = nullptr;
+	if (!done->level) {
+		std::cout << "[Session " << id << "] failed to load level " << level_num << ": " << done->error << std::endl;
+		failed = true;
+		return false;
+	}
+	std::cout << "[Session " << id << "] level " << level_num << " ready after "
+	          << std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - done->asked).count() << " ms" << std::endl;
+	delete level;
+	level = done->level.release();
+	loading = false;
+	level_reset();
+	//(the fresh level needs everything in the players' next snapshots)
+	replicators[0].reset_applied();
+	replicators[1].reset_applied();
+	return true;
+}
+
+void Session::level_reset() {
+	level->reset();
+
+	won = false;
+	to_next_level = 0.0f;
+	want_reset[0] = want_reset[1] = false;
+	reset_countdown = 0.0f;
+	//(bodies jump back to the start)
+	accepted[0] = accepted[1] = Accepted();
+}
+
+bool Session::add_player(Connection *connection, uint32_t player_num) {
+	if (player_num == 0) player_num = open_player();
+	if (player_num < 1 || player_num > 2 || players[player_num - 1]) return false;
+	players[player_num - 1] = connection;
+	replicators[player_num - 1].reset_received();
+	accepted[player_num - 1] = Accepted();
+	//tell the other player someone new is there:
+	if (Connection *other = players[2 - player_num]) {
+		Protocol::Message join('J');
+		join.u8(uint8_t(level_num));
+		join.u8(uint8_t(player_num));
+		stats.bytes_out += join.send(other);
+	}
+	std::cout << "[Session " << id << "] player " << player_num << " joined level " << level_num << std::endl;
+	return true;
+}
+
+void Session::remove_player(Connection *connection) {
+	for (uint32_t p = 0; p < 2; ++p) {
+		if (players[p] == connection) {
+			players[p] = nullptr;
+			want_reset[p] = false;
+			std::cout << "[Session " << id << "] player " << (p + 1) << " left level " << level_num << std::endl;
+		}
+	}
+}
+
+void Session::recv(Connection *connection) {
+	uint32_t player = (connection == players[0] ? 0 : 1);
+	assert(players[player] == connection);
+	Connection *other = players[player ^ 1];
+
+	RingBuffer &data = connection->recv_buffer;
+	Protocol::Frame frame;
+	while (Protocol::peek_frame(data, &frame)) {
+		Protocol::Reader reader(frame.payload, frame.length);
+		bool relay = (frame.type != 'J'); //(joins are for the server only)
+		if (recv_msg(player, frame.type, reader, &relay)) {
+			stats.messages += 1;
+			stats.bytes_in += frame.size();
+			//relay verbatim to the other player:
+			if (other && relay) {
+				other->send_raw(frame.payload - Protocol::HeaderSize, frame.size());
+				stats.bytes_out += frame.size();
+			}
+		} else {
+			std::cout << "[Session " << id << "] skipping bad '" << frame.type << "' message from player " << (player + 1) << "." << std::endl;
+		}
+		data.pop(frame.size());
+	}
+}
+
+bool Session::recv_msg(uint32_t player, char msg_type, Protocol::Reader &reader, bool *relay) {
+	assert(relay);
+
+	if (msg_type == 'R') {
+		if (!reader.done()) return false;
+
+		want_reset[player] = true;
+		if (reset_countdown == 0.0f) reset_countdown = 0.01f;
+
+	} else if (msg_type == 'J') {
+		//(the player number was used for seating; a new level means the player picked one from the menu)
+		uint32_t join_level = reader.u8();
+		reader.u8();
+		if (!reader.done() || join_level < 1 || join_level > level_count) return false;
+		if (join_level == level_num) {
+			join_level_wanted = 0; //(already there, or on its way)
+		} else if (join_change_quiet > 0.0f) {
+			join_level_wanted = join_level; //(tick() gets to it)
+		} else {
+			join_level_wanted = 0;
+			join_change_quiet = JoinChangeQuiet;
+			level_change(join_level);
+		}
+
+	} else if (msg_type == 'S') {
+		SnapshotChanges changes;
+		if (!replicators[player].receive(reader, &changes)) return false;
+		//(nothing to apply it to until the level is in; it then takes everything from the next snapshots)
+		if (loading) return true;
+		for (auto const &change : changes.movables) {
+			if (change.index >= level->movable_data.size()) return false;
+		}
+
+		Scene::Transform *body = (player == 0 ? level->body_P1_transform : level->body_P2_transform);
+		Accepted &acc = accepted[player];
+		if (changes.fresh && changes.has_position) {
+			//(full snapshots are checked too -- a client that never acks would otherwise pick its own position;
+			// only a join or a level (re)load, which clear 'accepted', let a body start anywhere)
+			if (plausible(player, changes.tick, changes.position)) {
+				acc.have = true;
+				acc.tick = changes.tick;
+				acc.position = changes.position;
+			} else {
+				//too far, too fast -- keep the body where it was, and tell the player so:
+				*relay = false;
+				if (acc.quiet <= 0.0f && players[player]) {
+					Protocol::Message correction('M');
+					correction.u32(changes.tick);
+					correction.position(acc.position);
+					stats.bytes_out += correction.send(players[player]);
+					stats.corrections += 1;
+					acc.quiet = CorrectionQuiet;
+					std::cout << "[Session " << id << "] corrected player " << (player + 1) << " at step " << changes.tick << "." << std::endl;
+				}
+				//(the snapshot is decoded, so its baseline chain holds; just don't apply it)
+				changes = SnapshotChanges();
+				replicators[player].reset_applied();
+				body->position = acc.position;
+			}
+		}
+		if (changes.has_position) body->position = changes.position;
+		if (changes.has_rotation) body->rotation = changes.rotation;
+		for (auto const &change : changes.movables) {
+			GameLevel::Movable &m = level->movable_data[change.index];
+			if (change.has_position) m.update(change.position - m.transform->position);
+			if (change.has_color) m.color = change.color;
+		}
+
+	} else if (msg_type == 'K') {
+		//(between the players; relayed as-is)
+		reader.u32();
+		if (!reader.done()) return false;
+
+	} else if (msg_type == 'M') {
+		//(server to player only)
+		return false;
+
+	} else if (msg_type == 'T') {
+		//latency probe -- straight back to the sender, with how the room's ticks are doing:
+		uint32_t ping_id = reader.u32();
+		uint32_t ping_time = reader.u32();
+		if (!reader.done()) return false;
+		*relay = false;
+		double mean = (stats.ticks ? stats.tick_seconds / stats.ticks : 0.0);
+		Protocol::Message pong('T');
+		pong.u32(ping_id);
+		pong.u32(ping_time);
+		pong.u32(uint32_t(std::min(mean * 1e9, 4e9)));
+		pong.u32(uint32_t(std::min(stats.tick_seconds_max * 1e9, 4e9)));
+		stats.bytes_out += pong.send(players[player]);
+		stats.pings += 1;
+
+	} else {
+		std::cout << "[Session " << id << "] ERROR: invalid message type from player " << (player + 1) << "!" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool Session::plausible(uint32_t player, uint32_t tick, glm::vec3 const &position) const {
+	Accepted const &acc = accepted[player];
+	if (!acc.have) return true;
+	//(ticks never go backwards for a given player, but a stale one just gets no allowance)
+	float seconds = (tick > acc.tick ? float(tick - acc.tick) * Physics::tick : 0.0f);
+	float reach = Physics::player_plausible_speed * seconds + MoveSlack;
+	glm::vec3 move = position - acc.position;
+	if (glm::length(glm::vec2(move)) > reach) return false;
+	if (move.z > reach) return false; //(falls aren't limited)
+	return true;
+}
+
+void Session::tick(float elapsed) {
+	auto before = std::chrono::steady_clock::now();
+	stats.ticks += 1;
+
+	for (auto &acc : accepted) {
+		acc.quiet = std::max(0.0f, acc.quiet - elapsed);
+	}
+
+	//a level change 'J' asked for while changes were held back:
+	join_change_quiet = std::max(0.0f, join_change_quiet - elapsed);
+	if (join_level_wanted != 0 && join_change_quiet == 0.0f) {
+		if (join_level_wanted != level_num) {
+			join_change_quiet = JoinChangeQuiet;
+			level_change(join_level_wanted);
+		}
+		join_level_wanted = 0;
+	}
+
+	//(nothing else happens while a level loads)
+	if (finish_level_change()) {
+		//reset logic (same rules as PlayerMode::update_reset_timer):
+		if (want_reset[0] && want_reset[1]) {
+			std::cout << "[Session " << id << "] reset level " << level_num << std::endl;
+			level_reset();
+			stats.resets += 1;
+		} else if (want_reset[0] || want_reset[1]) {
+			reset_countdown += elapsed;
+			if (reset_countdown > 15.0f) {
+				want_reset[0] = want_reset[1] = false;
+				reset_countdown = 0.0f;
+			}
+		}
+
+		//win logic (same rules as MenuMode, which advances the clients' levels):
+		if (!won && level->detect_win()) {
+			won = true;
+			to_next_level = 0.0f;
+		}
+		if (won) {
+			to_next_level += elapsed;
+			if (to_next_level >= 5.0f) {
+				stats.levels += 1;
+				won = false;
+				level_change(level_num == level_count ? 1 : level_num + 1);
+			}
+		}
+	}
+
+	double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+	stats.tick_seconds += seconds;
+	stats.tick_seconds_max = std::max(stats.tick_seconds_max, seconds);
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "GameLevel.hpp"
+#include "Connection.hpp"
+#include "Protocol.hpp"
+#include "Replication.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * A Session is one two-player game ("room") hosted by the headless server:
+ *  - it keeps a headless GameLevel (scene + collision, no GL) in step with
+ *    what the players send,
+ *  - relays each player's messages to the other player, and
+ *  - runs the reset and level-advance logic once per Physics::tick.
+ *
+ * Clients say hello and announce themselves with a 'J' message (level, player
+ * number) when they connect, and send 'J' again whenever they change level;
+ * see ClientMode. When a player takes a seat, the other player gets a 'J' too,
+ * so it starts its snapshots over (see Replication.hpp).
+ *
+ * Levels are loaded by the server's LevelLoader, so a room changing level never
+ * holds up the other rooms on its worker; 'J' can change the level at most once
+ * per JoinChangeQuiet seconds (later picks wait, and only the latest counts).
+ * If a level fails to load, the Session is marked 'failed' and its worker closes it.
+ *
+ * The server does not step movement: players send snapshots, not inputs, so
+ * walking, jumping, gravity, collision, perspective shifts, and the movables they
+ * push are all simulated by the clients (PlayerMode::update_step), exactly as when
+ * one of them hosts with ServerMode. Snapshots are applied to the room's level as
+ * they arrive; the server's own tick runs only level loading, resets, and win
+ * detection (which advances the level) on that state.
+ * The one check on the clients is plausibility: a snapshot that moves a body faster
+ * than Physics::player_plausible_speed is neither applied nor relayed, and the player
+ * gets an 'M' correction back, with the last accepted position, to replay its inputs
+ * from (see PlayerMode::reconcile). Movables are taken as sent.
+ */
+
+//A fixed number of threads that load levels for the server's Sessions, from a bounded queue:
+struct LevelLoader {
+	LevelLoader(uint32_t thread_count, size_t max_queued);
+	~LevelLoader(); //(drops whatever is still queued, and joins the threads)
+	LevelLoader(LevelLoader const &) = delete;
+	LevelLoader &operator=(LevelLoader const &) = delete;
+
+	struct Load {
+		uint32_t level_num = 0;
+		std::chrono::steady_clock::time_point asked;
+		std::atomic< bool > cancelled{false}; //(set by the Session if it doesn't want it any more)
+		std::atomic< bool > done{false}; //(set by the loader once 'level' or 'error' is filled in)
+		std::unique_ptr< GameLevel > level;
+		std::string error; //(why 'level' is null, if it is)
+	};
+	//queue a load of level 'level_num'; returns nullptr if the queue is full (ask again later):
+	std::shared_ptr< Load > request(uint32_t level_num);
+
+	size_t const max_queued;
+
+private:
+	void run();
+	std::mutex mutex; //protects queue and stopping
+	std::condition_variable wake;
+	std::deque< std::shared_ptr< Load > > queue;
+	bool stopping = false;
+	std::vector< std::thread > threads;
+};
+
+struct Session {
+	Session(uint64_t id, uint32_t level_num, LevelLoader &loader);
+	~Session();
+
+	//start loading level 'level_num' (on 'loader'; see finish_level_change()):
+	void level_change(uint32_t level_num);
+	void level_reset();
+
+	uint64_t id = 0; //unique per server, for matchmaking and stats
+
+	//players[0] controls player 1's body, players[1] player 2's:
+	Connection *players[2] = {nullptr, nullptr};
+	//seat a player (player_num 0 takes whichever seat is free); returns false if that seat is taken:
+	bool add_player(Connection *connection, uint32_t player_num);
+	void remove_player(Connection *connection);
+	bool full() const { return players[0] && players[1]; }
+	bool empty() const { return !players[0] && !players[1]; }
+	//player number of the free seat (0 if full; 1 if empty):
+	uint32_t open_player() const { return (!players[0] ? 1 : (!players[1] ? 2 : 0)); }
+
+	//handle (and relay) the messages waiting in a player's recv_buffer:
+	void recv(Connection *connection);
+
+	//advance load/reset/win logic by one fixed step (bodies and movables only move when snapshots say so):
+	void tick(float elapsed);
+
+	//decodes each player's snapshots (the players ack each other; the server only listens in):
+	Replicator replicators[2];
+
+	//each player's last accepted body position, and the step it was sent at:
+	struct Accepted {
+		bool have = false; //(else the next position is taken as-is)
+		uint32_t tick = 0;
+		glm::vec3 position = glm::vec3(0.0f);
+		float quiet = 0.0f; //seconds before another correction may be sent (one is likely in flight)
+	} accepted[2];
+	//units a body may move beyond the plausible speed (quantization, collision push-out):
+	static constexpr float MoveSlack = 2.0f;
+	static constexpr float CorrectionQuiet = 0.5f;
+
+	GameLevel *level = nullptr; //(nullptr until the first level is in)
+	uint32_t level_num = 1; //the level being played -- or, while one loads, the level being loaded
+	static constexpr uint32_t level_count = 5;
+
+	//until the level asked for is in, the players' snapshots are decoded and relayed but not
+	// applied, and tick() only checks on the load:
+	LevelLoader &loader;
+	bool loading = false; //(level_num isn't in yet)
+	std::shared_ptr< LevelLoader::Load > load; //(nullptr while the loader's queue was full; tick() asks again)
+	bool failed = false; //level_num didn't load -- the room can't go on, so its worker closes it
+	//swap in the loaded level if it is done; returns false while still loading (or if it failed):
+	bool finish_level_change();
+
+	//level changes asked for with 'J' (players picking from the menu), at most one per JoinChangeQuiet:
+	static constexpr float JoinChangeQuiet = 2.0f;
+	float join_change_quiet = 0.0f; //seconds before a 'J' may change level again
+	uint32_t join_level_wanted = 0; //level a 'J' asked for during that time (0 = none)
+
+	bool want_reset[2] = {false, false};
+	float reset_countdown = 0.0f;
+	bool won = false;
+	float to_next_level = 0.0f;
+
+	struct Stats {
+		uint64_t ticks = 0;
+		uint64_t messages = 0; //messages received from players
+		uint64_t bytes_in = 0; //bytes of those messages
+		uint64_t bytes_out = 0; //bytes relayed to players
+		uint32_t resets = 0;
+		uint32_t corrections = 0; //'M' messages sent
+		uint64_t pings = 0; //'T' messages answered
+		uint32_t levels = 0; //levels completed
+		uint64_t dropped_ticks = 0; //ticks skipped because the worker fell too far behind
+		double tick_seconds = 0.0; //time spent in tick()
+		double tick_seconds_max = 0.0; //longest single tick()
+	} stats;
+
+	//apply one message (see Protocol.hpp); returns false if it was malformed
+	// (clears *relay if the message shouldn't reach the other player):
+	bool recv_msg(uint32_t player, char msg_type, Protocol::Reader &reader, bool *relay);
+	//is a move from the accepted position to 'position' at step 'tick' possible?
+	bool plausible(uint32_t player, uint32_t tick, glm::vec3 const &position) const;
+};
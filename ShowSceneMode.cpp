@@ -7,9 +7,7 @@ ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
 
 	//Set up camera-only scene:
 	{ //create a single camera:
-		camera_scene.transforms.emplace_back();
-		camera_scene.cameras.emplace_back(&camera_scene.transforms.back());
-		scene_camera = &camera_scene.cameras.back();
+		scene_camera = camera_scene.add_camera(camera_scene.add_transform());
 		scene_camera->fovy = 60.0f / 180.0f * 3.1415926f;
 		scene_camera->near = 0.01f;
 		//scene_camera->transform and scene_camera->aspect will be set in draw()
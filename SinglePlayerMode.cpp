@@ -93,69 +93,14 @@ void SinglePlayerMode::update_other_move(float elapsed) {
       glm::vec3 sphere_from = pl_pos;
       glm::vec3 sphere_to = pl_pos + pl_vel * remain;
 
-      bool collided = false;
-      float collision_t = 1.0f;
-      glm::vec3 collision_at = glm::vec3(0.0f);
-      glm::vec3 collision_out = glm::vec3(0.0f);
-      bool is_surface_collision = false;
-
-      glm::vec3 sphere_min = glm::min(sphere_from, sphere_to) - glm::vec3(sphere_radius);
-      glm::vec3 sphere_max = glm::max(sphere_from, sphere_to) + glm::vec3(sphere_radius);
-      for (auto const &collider : level->mesh_colliders) {
-        glm::mat4x3 collider_to_world = collider.transform->make_local_to_world();
-
-        { // Early discard:
-          // check if AABB of collider overlaps AABB of swept sphere:
-
-          // (1) compute bounding box of collider in world space:
-          glm::vec3 local_center = 0.5f * (collider.mesh->max + collider.mesh->min);
-          glm::vec3 local_radius = 0.5f * (collider.mesh->max - collider.mesh->min);
-
-          glm::vec3 world_min = collider_to_world * glm::vec4(local_center, 1.0f)
-            - glm::abs(local_radius.x * collider_to_world[0])
-            - glm::abs(local_radius.y * collider_to_world[1])
-            - glm::abs(local_radius.z * collider_to_world[2]);
-          glm::vec3 world_max = collider_to_world * glm::vec4(local_center, 1.0f)
-            + glm::abs(local_radius.x * collider_to_world[0])
-            + glm::abs(local_radius.y * collider_to_world[1])
-            + glm::abs(local_radius.z * collider_to_world[2]);
-
-          // (2) check if bounding boxes overlap:
-          bool can_skip = !collide_AABB_vs_AABB(sphere_min, sphere_max, world_min, world_max);
-
-          if (can_skip) {
-            // AABBs do not overlap; skip detailed check:
-            continue;
-          }
-        }
-
-        // Full (all triangles) test:
-
-        assert(collider.mesh->type == GL_TRIANGLES); //only have code for TRIANGLES not other primitive types
-
-        for (GLuint v = 0; v + 2 < collider.mesh->count; v += 3) {
-          // get vertex positions from associated positions buffer:
-          // (and transform to world space)
-          glm::vec3 a = collider_to_world * glm::vec4(collider.buffer->positions[collider.mesh->start+v+0], 1.0f);
-          glm::vec3 b = collider_to_world * glm::vec4(collider.buffer->positions[collider.mesh->start+v+1], 1.0f);
-          glm::vec3 c = collider_to_world * glm::vec4(collider.buffer->positions[collider.mesh->start+v+2], 1.0f);
-          // check triangle:
-          bool did_collide = collide_swept_sphere_vs_triangle(
-            sphere_from, sphere_to, sphere_radius,
-            a, b, c,
-            &collision_t, &collision_at, &collision_out, &is_surface_collision
-          );
-
-          if (did_collide) {
-            collided = true;
-            if (collider.movable_index >= 0) {
-              other_pov.on_movable = &level->movable_data[collider.movable_index];
-              other_pov.on_movable->add_player(other_pov.body, player_num ^ 3);
-              //std::cout << "Got player!" << std::endl;
-            }
-          }
-        }
+      SweptSphereHit hit;
+      bool collided = level->sweep_sphere(sphere_from, sphere_to, sphere_radius, &hit);
+      if (collided && hit.movable_index >= 0) {
+        other_pov.on_movable = &level->movable_data[hit.movable_index];
+        other_pov.on_movable->add_player(other_pov.body, player_num ^ 3);
       }
+      float collision_t = hit.t;
+      glm::vec3 collision_out = hit.out;
 
       if (!collided) {
         pl_pos = sphere_to;
@@ -198,6 +143,7 @@ void SinglePlayerMode::update_other_move(float elapsed) {
 }
 
 void SinglePlayerMode::update(float elapsed) {
+  if (!finish_level_change(false)) return;
   if (pause) return;
   we_reached_goal = level->detect_goal(player_num);
   if (!won && level->detect_win()) {
@@ -209,12 +155,19 @@ void SinglePlayerMode::update(float elapsed) {
   }
 
   update_shift(elapsed);
+  update_simulation(elapsed);
   if (shift.progress == 0.0f) {
-    update_me_move(elapsed);
+    update_look();
   }
-  update_other_move(elapsed);
-  update_movables_move(elapsed);
 
 }
 
+void SinglePlayerMode::update_step(float tick) {
+  if (shift.progress == 0.0f) {
+    update_me_move(tick);
+  }
+  update_other_move(tick);
+  update_movables_move(tick);
+}
+
 void SinglePlayerMode::update_network() {}
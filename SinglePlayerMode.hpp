@@ -13,6 +13,7 @@ struct SinglePlayerMode : PlayerMode {
   bool handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) override;
 
   void update_other_move(float elapsed);
+  void update_step(float tick) override;
   void update_network() override;
 
   void update(float elapsed) override;
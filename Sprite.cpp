@@ -1,11 +1,10 @@
 #include "Sprite.hpp"
 
 #include "GL.hpp"
+#include "MappedFile.hpp"
 #include "read_write_chunk.hpp"
 #include "load_save_png.hpp"
 
-#include <fstream>
-
 SpriteAtlas::SpriteAtlas(std::string const &filebase) {
 	std::string png_path = filebase + ".png";
 	atlas_path = filebase + ".atlas";
@@ -43,14 +42,13 @@ SpriteAtlas::SpriteAtlas(std::string const &filebase) {
 
 	// ----- load the sprite location data -----
 
-	//read from atlas_path in binary mode:
-	std::ifstream in(atlas_path, std::ios::binary);
+	//read from atlas_path, in place:
+	MappedFile in(atlas_path);
+	ChunkReader reader(in.data, in.size);
 
 	//sprite atlas is stored as two chunks:
 	// (1) a 'str0' chunk with string data:
-	std::vector< char > strings;
-
-	read_chunk(in, "str0", &strings);
+	ChunkSpan< char > strings = reader.read< char >("str0");
 
 	// (2) a 'spr0' chunk with sprite data:
 	struct SpriteData {
@@ -59,9 +57,7 @@ SpriteAtlas::SpriteAtlas(std::string const &filebase) {
 		glm::vec2 max_px;
 		glm::vec2 anchor_px;
 	};
-	std::vector< SpriteData > datas;
-
-	read_chunk(in, "spr0", &datas);
+	ChunkSpan< SpriteData > datas = reader.read< SpriteData >("spr0");
 
 	//actually create Sprite objects from the data and insert into the lookup table:
 
@@ -75,7 +71,7 @@ SpriteAtlas::SpriteAtlas(std::string const &filebase) {
 		if (data.name_begin > data.name_end || data.name_end > strings.size()) {
 			throw std::runtime_error("Invalid name in sprite atlas '" + atlas_path + "'.");
 		}
-		std::string name(strings.begin() + data.name_begin, strings.begin() + data.name_end);
+		std::string name(strings.bytes + data.name_begin, strings.bytes + data.name_end);
 
 		//then populate a new Sprite struct using the data:
 		Sprite sprite;
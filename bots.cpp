@@ -0,0 +1,359 @@
+//Load generator for the dedicated server (server.cpp):
+// runs any number of headless bot players in one process, each on its own connection, speaking
+// the same protocol as ClientMode (hello, 'J' join, 'S' snapshots and 'K' acks, the odd 'R' reset).
+// Bots don't simulate anything -- they follow scripted paths (walking, jumping, sprinting, or
+// standing about), at speeds the server finds plausible -- so one machine can field hundreds.
+// They also send 'T' pings, which the server answers with its room's tick times.
+//
+// Once a second (and at the end) the driver reports connected bots, traffic, ping (round trip)
+// percentiles and the server's tick times; with --churn, a bot hangs up and reconnects every
+// so often, and the time from connecting to the first ping answer ("join time") is reported too.
+//
+// usage: bots <host> <port> [--bots N] [--seconds S] [--level L] [--rate Hz] [--churn S]
+
+#include "Connection.hpp"
+#include "Protocol.hpp"
+#include "Replication.hpp"
+#include "Physics.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+//seconds between checks for incoming messages (between frames, too):
+static constexpr double PollInterval = 0.001;
+
+//Latency samples (seconds), for percentiles:
+struct Samples {
+	std::vector< double > values;
+	void add(double value) { values.emplace_back(value); }
+	//p in [0,1]; 0 if there are no samples:
+	double percentile(double p) {
+		if (values.empty()) return 0.0;
+		std::sort(values.begin(), values.end());
+		size_t i = std::min(values.size() - 1, size_t(p * double(values.size() - 1) + 0.5));
+		return values[i];
+	}
+	//"p50 / p90 / p99 / max" in milliseconds:
+	std::string summary() {
+		if (values.empty()) return "-";
+		return std::to_string(percentile(0.5) * 1e3) + " / " + std::to_string(percentile(0.9) * 1e3) + " / "
+		     + std::to_string(percentile(0.99) * 1e3) + " / " + std::to_string(percentile(1.0) * 1e3) + " ms";
+	}
+};
+
+//Numbers the driver adds up across bots (and resets for each interval report):
+struct Totals {
+	uint64_t messages_out = 0;
+	uint64_t bytes_out = 0;
+	uint64_t messages_in = 0;
+	uint64_t bytes_in = 0;
+	uint64_t corrections = 0; //'M' from the server (bots stay within plausible speeds, so this should stay 0)
+	uint64_t resets = 0; //'R' relayed from room-mates
+	uint64_t bad = 0; //malformed or unexpected messages
+	Samples ping; //round trips
+	Samples join; //connect to first ping answer
+	double tick_mean = 0.0; //server tick times (seconds) -- of the busiest room any bot heard from
+	double tick_max = 0.0;
+
+	//fold in another interval's numbers:
+	void add(Totals const &o) {
+		messages_out += o.messages_out;
+		bytes_out += o.bytes_out;
+		messages_in += o.messages_in;
+		bytes_in += o.bytes_in;
+		corrections += o.corrections;
+		resets += o.resets;
+		bad += o.bad;
+		ping.values.insert(ping.values.end(), o.ping.values.begin(), o.ping.values.end());
+		join.values.insert(join.values.end(), o.join.values.begin(), o.join.values.end());
+		tick_mean = std::max(tick_mean, o.tick_mean);
+		tick_max = std::max(tick_max, o.tick_max);
+	}
+};
+
+struct Bot {
+	enum Path : uint32_t { Walk, Jump, Sprint, Idle, PathCount };
+
+	Bot(uint32_t index_, std::string const &host_, std::string const &port_, uint32_t level_)
+		: index(index_), path(Path(index_ % PathCount)), host(host_), port(port_), level(level_) { }
+
+	uint32_t index;
+	Path path;
+	std::string host, port;
+	uint32_t level;
+
+	std::unique_ptr< Client > client;
+	bool hello = false; //got the server's hello
+	Replicator replicator;
+	Clock::time_point connected_at;
+	bool joined = false; //(a ping came back, so the server has seated us)
+	double next_ping = 0.0;
+	double next_reset = 0.0;
+	uint32_t ping_id = 0;
+
+	//(re)connect, say hello and join:
+	void connect(double now) {
+		client.reset(new Client(host, port));
+		connected_at = Clock::now();
+		hello = false;
+		joined = false;
+		replicator = Replicator();
+		Protocol::send_hello(&client->connection);
+		Protocol::Message join('J');
+		join.u8(uint8_t(level));
+		join.u8(0); //(any seat)
+		join.send(&client->connection);
+		next_ping = now;
+		next_reset = now + 15.0 + double(index % 8); //(staggered)
+	}
+
+	bool connected() const { return client && client->connection; }
+
+	//where the script puts the body at 'time' seconds:
+	void pose(double time, glm::vec3 *position, glm::quat *rotation) const {
+		//each bot has its own patch of ground (the server only checks speeds, not collisions):
+		glm::vec3 origin = glm::vec3(float(index % 16) * 4.0f, float(index / 16) * 4.0f, 2.0f);
+		float speed = (path == Sprint ? Physics::player_move_max_speed * Physics::player_sprint_multiplier : Physics::player_move_max_speed);
+		float radius = 6.0f;
+		float angle = (path == Idle ? float(std::floor(time / 2.0)) : float(time) * speed / radius);
+		if (path == Idle) {
+			*position = origin;
+		} else {
+			*position = origin + radius * glm::vec3(std::cos(angle), std::sin(angle), 0.0f);
+		}
+		if (path == Jump) {
+			//jump once a second, as hard as a player can:
+			float t = float(std::fmod(time, 1.0));
+			float up = -Physics::player_jump_sec * Physics::gravity.z;
+			position->z += std::max(0.0f, up * t + 0.5f * Physics::gravity.z * t * t);
+		}
+		*rotation = glm::angleAxis(angle + 1.5707963f, glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+
+	//send this frame's snapshot (and a ping or reset, when due):
+	void update(double now, Totals &totals) {
+		if (!connected()) return;
+		Connection *c = &client->connection;
+
+		glm::vec3 position;
+		glm::quat rotation;
+		pose(now, &position, &rotation);
+		Snapshot snapshot;
+		snapshot.tick = uint32_t(now * Physics::tick_rate);
+		snapshot.position = Protocol::pack_position(position);
+		snapshot.rotation = Protocol::pack_rotation(rotation);
+		size_t sent = replicator.send(c, snapshot);
+		if (sent) {
+			totals.messages_out += 1;
+			totals.bytes_out += sent;
+		}
+
+		if (now >= next_ping) {
+			next_ping = now + 0.25;
+			Protocol::Message ping('T');
+			ping.u32(++ping_id);
+			ping.u32(uint32_t(now * 1e6));
+			totals.messages_out += 1;
+			totals.bytes_out += ping.send(c);
+		}
+
+		if (now >= next_reset) {
+			next_reset = now + 30.0;
+			totals.messages_out += 1;
+			totals.bytes_out += Protocol::Message('R').send(c);
+		}
+	}
+
+	//handle what arrived:
+	void recv(double now, Totals &totals) {
+		Connection *c = &client->connection;
+		RingBuffer &data = c->recv_buffer;
+		Protocol::Frame frame;
+		while (Protocol::peek_frame(data, &frame)) {
+			totals.messages_in += 1;
+			totals.bytes_in += frame.size();
+			Protocol::Reader reader(frame.payload, frame.length);
+			if (!hello) {
+				if (!Protocol::check_hello(frame)) {
+					std::cerr << "[bot " << index << "] server doesn't speak protocol version " << Protocol::Version << "." << std::endl;
+					c->close();
+					return;
+				}
+				hello = true;
+			} else if (frame.type == 'S') {
+				SnapshotChanges changes;
+				if (!replicator.receive(reader, &changes)) totals.bad += 1;
+			} else if (frame.type == 'K') {
+				if (!replicator.ack(reader)) totals.bad += 1;
+			} else if (frame.type == 'J') {
+				//a new room-mate; start over with them:
+				replicator.reset_sent();
+				replicator.reset_received();
+			} else if (frame.type == 'R') {
+				totals.resets += 1;
+			} else if (frame.type == 'M') {
+				totals.corrections += 1;
+			} else if (frame.type == 'T') {
+				reader.u32(); //(id)
+				uint32_t sent = reader.u32();
+				uint32_t tick_mean = reader.u32();
+				uint32_t tick_max = reader.u32();
+				if (!reader.done()) {
+					totals.bad += 1;
+				} else {
+					//(microsecond clock, wrapping)
+					uint32_t round_trip = uint32_t(now * 1e6) - sent;
+					totals.ping.add(round_trip * 1e-6);
+					totals.tick_mean = std::max(totals.tick_mean, tick_mean * 1e-9);
+					totals.tick_max = std::max(totals.tick_max, tick_max * 1e-9);
+					if (!joined) {
+						joined = true;
+						totals.join.add(std::chrono::duration< double >(Clock::now() - connected_at).count());
+					}
+				}
+			} else {
+				totals.bad += 1;
+			}
+			data.pop(frame.size());
+		}
+		replicator.send_ack(c);
+	}
+};
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	if (argc < 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <host> <port> [--bots N=16] [--seconds S=30] [--level L=1] [--rate Hz=60] [--churn S=0]" << std::endl;
+		return 1;
+	}
+	std::string host = argv[1];
+	std::string port = argv[2];
+	uint32_t bot_count = 16;
+	double seconds = 30.0;
+	uint32_t level = 1;
+	double rate = 60.0;
+	double churn = 0.0; //seconds between reconnects (0 for none)
+	for (int i = 3; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		double value = std::atof(argv[i + 1]);
+		if (arg == "--bots") bot_count = uint32_t(value);
+		else if (arg == "--seconds") seconds = value;
+		else if (arg == "--level") level = uint32_t(value);
+		else if (arg == "--rate") rate = std::max(1.0, value);
+		else if (arg == "--churn") churn = value;
+		else std::cerr << "Ignoring unknown argument '" << arg << "'." << std::endl;
+	}
+
+	Clock::time_point start = Clock::now();
+	auto clock = [&start]() { return std::chrono::duration< double >(Clock::now() - start).count(); };
+
+	std::vector< Bot > bots;
+	bots.reserve(bot_count);
+	for (uint32_t i = 0; i < bot_count; ++i) {
+		bots.emplace_back(i, host, port, level);
+		bots.back().connect(clock());
+	}
+	std::cout << "[bots] " << bot_count << " bot(s) connected to " << host << ":" << port << "; running for " << seconds << " s." << std::endl;
+
+	Totals interval, total;
+	uint64_t reconnects = 0, dropped = 0;
+	std::mt19937 mt(0x626f7473);
+	double next_churn = (churn > 0.0 ? churn : seconds + 1.0);
+	double next_report = 1.0;
+	double frame = 1.0 / rate;
+	double next_frame = 0.0;
+
+	while (true) {
+		double now = clock();
+		if (now >= seconds) break;
+
+		//send at the frame rate, but check for answers more often (pings are only as exact as this):
+		bool frame_due = (now >= next_frame);
+		if (frame_due) {
+			next_frame += frame;
+			if (next_frame < now) next_frame = now; //(running behind; don't try to catch up)
+		}
+
+		for (auto &bot : bots) {
+			if (!bot.connected()) continue;
+			if (frame_due) bot.update(now, interval);
+			bool closed = false;
+			bot.client->poll([&](Connection *, Connection::Event evt) {
+				if (evt == Connection::OnRecv) bot.recv(now, interval);
+				else if (evt == Connection::OnClose) closed = true;
+			}, 0.0);
+			if (closed || !bot.connected()) {
+				std::cerr << "[bot " << bot.index << "] disconnected." << std::endl;
+				bot.client.reset();
+				dropped += 1;
+			}
+		}
+
+		if (now >= next_churn && !bots.empty()) {
+			next_churn += churn;
+			Bot &bot = bots[mt() % bots.size()];
+			try {
+				bot.connect(now); //(the old connection closes as the old Client goes)
+				reconnects += 1;
+			} catch (std::exception const &e) {
+				std::cerr << "[bot " << bot.index << "] reconnect failed: " << e.what() << std::endl;
+				bot.client.reset();
+			}
+		}
+
+		if (now >= next_report) {
+			next_report += 1.0;
+			uint32_t connected = 0;
+			for (auto const &bot : bots) connected += (bot.connected() ? 1 : 0);
+			std::cout << "[bots] " << connected << " connected; "
+			          << interval.messages_out << " messages/s (" << interval.bytes_out << " bytes/s) out, "
+			          << interval.messages_in << " messages/s (" << interval.bytes_in << " bytes/s) in; "
+			          << "ping p50/p90/p99/max " << interval.ping.summary() << "; "
+			          << "server tick mean " << interval.tick_mean * 1e6 << " us, max " << interval.tick_max * 1e6 << " us (busiest room)" << std::endl;
+			total.add(interval);
+			interval = Totals();
+		}
+
+		double wait = std::min(next_frame - clock(), PollInterval);
+		if (wait > 0.0) std::this_thread::sleep_for(std::chrono::duration< double >(wait));
+	}
+
+	total.add(interval);
+	double elapsed = clock();
+	std::cout << "[bots] done after " << elapsed << " s:\n"
+	          << "  sent " << total.messages_out << " messages (" << total.bytes_out / elapsed << " bytes/s), received "
+	          << total.messages_in << " (" << total.bytes_in / elapsed << " bytes/s)\n"
+	          << "  ping p50/p90/p99/max: " << total.ping.summary() << " (" << total.ping.values.size() << " samples)\n"
+	          << "  server tick (busiest room): mean " << total.tick_mean * 1e6 << " us, max " << total.tick_max * 1e6 << " us\n"
+	          << "  join time p50/p90/p99/max: " << total.join.summary() << " (" << total.join.values.size() << " joins)\n"
+	          << "  churn: " << reconnects << " reconnects, " << dropped << " unexpected disconnects\n"
+	          << "  " << total.corrections << " corrections, " << total.resets << " resets relayed, " << total.bad << " bad messages" << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
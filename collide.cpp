@@ -2,8 +2,18 @@
 
 #include <initializer_list>
 #include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <iostream>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLLIDE_SSE2
+#include <emmintrin.h>
+#endif
+
 
 //Check if two AABBs overlap:
 // (useful for early-out code)
@@ -145,12 +155,98 @@ bool collide_ray_vs_cylinder(
 	return false;
 }
 
+CollisionTriangle::CollisionTriangle(glm::vec3 const &a_, glm::vec3 const &b_, glm::vec3 const &c_)
+	: a(a_), b(b_), c(c_), ab(b_ - a_), bc(c_ - b_), ca(a_ - c_) {
+	glm::vec3 perp = glm::cross(b - a, c - a);
+	if (perp != glm::vec3(0.0f)) normal = glm::normalize(perp);
+	min = glm::min(a, glm::min(b, c));
+	max = glm::max(a, glm::max(b, c));
+}
+
 bool collide_swept_sphere_vs_triangle(
 	glm::vec3 const &sphere_from, glm::vec3 const &sphere_to, float sphere_radius,
 	glm::vec3 const &triangle_a, glm::vec3 const &triangle_b, glm::vec3 const &triangle_c,
 	float *collision_t, glm::vec3 *collision_at, glm::vec3 *collision_out, bool *is_surface_collision
 ) {
+	return collide_swept_sphere_vs_triangle(
+		sphere_from, sphere_to, sphere_radius,
+		CollisionTriangle(triangle_a, triangle_b, triangle_c),
+		collision_t, collision_at, collision_out, is_surface_collision
+	);
+}
 
+//The plane part of the swept sphere vs triangle test (when the sphere overlaps the triangle's
+// plane, and whether it first touches it inside the triangle), written out per component so that
+// plane_stage_4() below can do the same arithmetic, in the same order, four triangles at a time:
+namespace {
+struct PlaneStage {
+	bool degenerate = false; //zero normal: no plane test, just edges and vertices
+	//time range when sphere overlaps plane containing triangle (empty if not approaching it):
+	float t0 = 2.0f;
+	float t1 =-1.0f;
+	//first touch, at_t = max(0,t0): sphere center 'at', projected to the plane at 'close':
+	float at_t = 0.0f;
+	glm::vec3 at = glm::vec3(0.0f), close = glm::vec3(0.0f);
+	bool inside = false; //'close' is inside the triangle
+};
+}
+
+static PlaneStage plane_stage(
+	glm::vec3 const &sphere_from, glm::vec3 const &sphere_to, float sphere_radius,
+	CollisionTriangle const &triangle
+) {
+	PlaneStage stage;
+	glm::vec3 const &a = triangle.a;
+	glm::vec3 const &n = triangle.normal;
+	if (n.x == 0.0f && n.y == 0.0f && n.z == 0.0f) {
+		stage.degenerate = true;
+		return stage;
+	}
+
+	float dot_from = n.x * (sphere_from.x - a.x) + n.y * (sphere_from.y - a.y) + n.z * (sphere_from.z - a.z);
+	float dot_to = n.x * (sphere_to.x - a.x) + n.y * (sphere_to.y - a.y) + n.z * (sphere_to.z - a.z);
+	if (dot_from < 0.0f && dot_to > dot_from) {
+		//approaching triangle from below
+		stage.t0 = (-sphere_radius - dot_from) / (dot_to - dot_from);
+		stage.t1 = ( sphere_radius - dot_from) / (dot_to - dot_from);
+	} else if (dot_from > 0.0f && dot_to < dot_from) {
+		//approaching triangle from above
+		stage.t0 = ( sphere_radius - dot_from) / (dot_to - dot_from);
+		stage.t1 = (-sphere_radius - dot_from) / (dot_to - dot_from);
+	}
+
+	stage.at_t = std::max(stage.t0, 0.0f);
+	glm::vec3 &at = stage.at;
+	at.x = sphere_from.x + stage.at_t * (sphere_to.x - sphere_from.x);
+	at.y = sphere_from.y + stage.at_t * (sphere_to.y - sphere_from.y);
+	at.z = sphere_from.z + stage.at_t * (sphere_to.z - sphere_from.z);
+
+	//close is 'at' projected to the plane of the triangle:
+	float along = (a.x - at.x) * n.x + (a.y - at.y) * n.y + (a.z - at.z) * n.z;
+	glm::vec3 &close = stage.close;
+	close.x = at.x + along * n.x;
+	close.y = at.y + along * n.y;
+	close.z = at.z + along * n.z;
+
+	//check if 'close' is inside triangle:
+	//  METHOD: this is checking whether the triangles (b,c,x), (c,a,x), and (a,b,x) have the same orientation as (a,b,c)
+	auto side = [&](glm::vec3 const &edge, glm::vec3 const &p) {
+		glm::vec3 d(close.x - p.x, close.y - p.y, close.z - p.z);
+		return (edge.y * d.z - edge.z * d.y) * n.x + (edge.z * d.x - edge.x * d.z) * n.y + (edge.x * d.y - edge.y * d.x) * n.z;
+	};
+	stage.inside = side(triangle.ab, triangle.a) >= 0.0f
+	            && side(triangle.bc, triangle.b) >= 0.0f
+	            && side(triangle.ca, triangle.c) >= 0.0f;
+	return stage;
+}
+
+//The rest of the test, given the plane stage:
+static bool finish_swept_sphere_vs_triangle(
+	glm::vec3 const &sphere_from, glm::vec3 const &sphere_to, float sphere_radius,
+	glm::vec3 const &triangle_a, glm::vec3 const &triangle_b, glm::vec3 const &triangle_c,
+	PlaneStage const &stage,
+	float *collision_t, glm::vec3 *collision_at, glm::vec3 *collision_out, bool *is_surface_collision
+) {
 	float t = 2.0f;
 
 	if (collision_t) {
@@ -158,54 +254,19 @@ bool collide_swept_sphere_vs_triangle(
 		if (t <= 0.0f) return false;
 	}
 
-	{ //check interior of triangle:
-		//vector perpendicular to plane:
-		glm::vec3 perp = glm::cross(triangle_b - triangle_a, triangle_c - triangle_a);
-		if (perp == glm::vec3(0.0f)) {
-			//degenerate triangle, skip plane test
-		} else {
-			glm::vec3 normal = glm::normalize(perp);
-			float dot_from = glm::dot(normal, sphere_from - triangle_a);
-			float dot_to = glm::dot(normal, sphere_to - triangle_a);
-
-			//determine time range when sphere overlaps plane containing triangle:
-
-			//start with empty range:
-			float t0 = 2.0f;
-			float t1 =-1.0f;
-			if (dot_from < 0.0f && dot_to > dot_from) {
-				//approaching triangle from below
-				t0 = (-sphere_radius - dot_from) / (dot_to - dot_from);
-				t1 = ( sphere_radius - dot_from) / (dot_to - dot_from);
-			} else if (dot_from > 0.0f && dot_to < dot_from) {
-				//approaching triangle from above
-				t0 = ( sphere_radius - dot_from) / (dot_to - dot_from);
-				t1 = (-sphere_radius - dot_from) / (dot_to - dot_from);
-			}
-			//if range doesn't overlap [0,t], no collision (with plane, vertices, or edges) is possible:
-			if (t1 < 0.0f || t0 >= t) {
-				return false;
-			}
+	if (!stage.degenerate) {
+		//if range doesn't overlap [0,t], no collision (with plane, vertices, or edges) is possible:
+		if (stage.t1 < 0.0f || stage.t0 >= t) {
+			return false;
+		}
 
-			//check if collision with happens inside triangle:
-			float at_t = glm::max(0.0f, t0);
-			glm::vec3 at = glm::mix(sphere_from, sphere_to, at_t);
-
-			//close is 'at' projected to the plane of the triangle:
-			glm::vec3 close = at + glm::dot(triangle_a - at, normal) * normal;
-
-			//check if 'close' is inside triangle:
-			//  METHOD: this is checking whether the triangles (b,c,x), (c,a,x), and (a,b,x) have the same orientation as (a,b,c)
-			if ( glm::dot(glm::cross(triangle_b - triangle_a, close - triangle_a), normal) >= 0
-			  && glm::dot(glm::cross(triangle_c - triangle_b, close - triangle_b), normal) >= 0
-			  && glm::dot(glm::cross(triangle_a - triangle_c, close - triangle_c), normal) >= 0 ) {
-				//sphere does intersect with triangle inside the triangle:
-				if (collision_t) *collision_t = at_t;
-				if (collision_out) *collision_out = careful_normalize(at - close);
-				if (collision_at) *collision_at = close;
-        if(is_surface_collision) *is_surface_collision = true;
-				return true;
-			}
+		if (stage.inside) {
+			//sphere does intersect with triangle inside the triangle:
+			if (collision_t) *collision_t = stage.at_t;
+			if (collision_out) *collision_out = careful_normalize(stage.at - stage.close);
+			if (collision_at) *collision_at = stage.close;
+			if (is_surface_collision) *is_surface_collision = true;
+			return true;
 		}
 	}
 
@@ -263,3 +324,309 @@ bool collide_swept_sphere_vs_triangle(
 
 	return collided;
 }
+
+bool collide_swept_sphere_vs_triangle(
+	glm::vec3 const &sphere_from, glm::vec3 const &sphere_to, float sphere_radius,
+	CollisionTriangle const &triangle,
+	float *collision_t, glm::vec3 *collision_at, glm::vec3 *collision_out, bool *is_surface_collision
+) {
+	return finish_swept_sphere_vs_triangle(
+		sphere_from, sphere_to, sphere_radius,
+		triangle.a, triangle.b, triangle.c,
+		plane_stage(sphere_from, sphere_to, sphere_radius, triangle),
+		collision_t, collision_at, collision_out, is_surface_collision
+	);
+}
+
+CollisionTriangle CollisionTriangles::operator[](size_t i) const {
+	//(the same values the CollisionTriangle constructor computed when the triangle was set)
+	CollisionTriangle triangle;
+	triangle.a = glm::vec3(ax[i], ay[i], az[i]);
+	triangle.b = glm::vec3(bx[i], by[i], bz[i]);
+	triangle.c = glm::vec3(cx[i], cy[i], cz[i]);
+	triangle.ab = triangle.b - triangle.a;
+	triangle.bc = triangle.c - triangle.b;
+	triangle.ca = triangle.a - triangle.c;
+	triangle.normal = glm::vec3(nx[i], ny[i], nz[i]);
+	triangle.min = min(i);
+	triangle.max = max(i);
+	return triangle;
+}
+
+void CollisionTriangles::clear() {
+	resize(0);
+}
+
+void CollisionTriangles::resize(size_t size) {
+	for (std::vector< float > *v : {&ax, &ay, &az, &bx, &by, &bz, &cx, &cy, &cz, &nx, &ny, &nz, &min_x, &min_y, &min_z, &max_x, &max_y, &max_z}) {
+		v->resize(size);
+	}
+}
+
+void CollisionTriangles::set(size_t i, CollisionTriangle const &triangle) {
+	ax[i] = triangle.a.x; ay[i] = triangle.a.y; az[i] = triangle.a.z;
+	bx[i] = triangle.b.x; by[i] = triangle.b.y; bz[i] = triangle.b.z;
+	cx[i] = triangle.c.x; cy[i] = triangle.c.y; cz[i] = triangle.c.z;
+	nx[i] = triangle.normal.x; ny[i] = triangle.normal.y; nz[i] = triangle.normal.z;
+	min_x[i] = triangle.min.x; min_y[i] = triangle.min.y; min_z[i] = triangle.min.z;
+	max_x[i] = triangle.max.x; max_y[i] = triangle.max.y; max_z[i] = triangle.max.z;
+}
+
+void CollisionTriangles::push_back(CollisionTriangle const &triangle) {
+	resize(size() + 1);
+	set(size() - 1, triangle);
+}
+
+#if defined(COLLIDE_SSE2)
+//plane_stage() for triangles[index[0 .. count)] (count <= 4), one per lane:
+static void plane_stage_4(
+	glm::vec3 const &sphere_from, glm::vec3 const &sphere_to, float sphere_radius,
+	CollisionTriangles const &triangles, uint32_t const *index, uint32_t count,
+	PlaneStage *stages
+) {
+	assert(count >= 1 && count <= 4);
+	//(unused lanes repeat the first triangle)
+	uint32_t i0 = index[0];
+	uint32_t i1 = (count > 1 ? index[1] : i0);
+	uint32_t i2 = (count > 2 ? index[2] : i0);
+	uint32_t i3 = (count > 3 ? index[3] : i0);
+	auto gather = [&](std::vector< float > const &v) {
+		return _mm_setr_ps(v[i0], v[i1], v[i2], v[i3]);
+	};
+	auto select = [](__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	};
+
+	__m128 ax = gather(triangles.ax), ay = gather(triangles.ay), az = gather(triangles.az);
+	__m128 bx = gather(triangles.bx), by = gather(triangles.by), bz = gather(triangles.bz);
+	__m128 cx = gather(triangles.cx), cy = gather(triangles.cy), cz = gather(triangles.cz);
+	__m128 nx = gather(triangles.nx), ny = gather(triangles.ny), nz = gather(triangles.nz);
+	__m128 zero = _mm_setzero_ps();
+	__m128 degenerate = _mm_and_ps(_mm_and_ps(_mm_cmpeq_ps(nx, zero), _mm_cmpeq_ps(ny, zero)), _mm_cmpeq_ps(nz, zero));
+
+	__m128 fx = _mm_set1_ps(sphere_from.x), fy = _mm_set1_ps(sphere_from.y), fz = _mm_set1_ps(sphere_from.z);
+	__m128 tx = _mm_set1_ps(sphere_to.x), ty = _mm_set1_ps(sphere_to.y), tz = _mm_set1_ps(sphere_to.z);
+	__m128 dot_from = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_sub_ps(fx, ax)), _mm_mul_ps(ny, _mm_sub_ps(fy, ay))), _mm_mul_ps(nz, _mm_sub_ps(fz, az)));
+	__m128 dot_to = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_sub_ps(tx, ax)), _mm_mul_ps(ny, _mm_sub_ps(ty, ay))), _mm_mul_ps(nz, _mm_sub_ps(tz, az)));
+	__m128 denominator = _mm_sub_ps(dot_to, dot_from);
+	__m128 lo = _mm_div_ps(_mm_sub_ps(_mm_set1_ps(-sphere_radius), dot_from), denominator);
+	__m128 hi = _mm_div_ps(_mm_sub_ps(_mm_set1_ps( sphere_radius), dot_from), denominator);
+	__m128 below = _mm_and_ps(_mm_cmplt_ps(dot_from, zero), _mm_cmpgt_ps(dot_to, dot_from));
+	__m128 above = _mm_and_ps(_mm_cmpgt_ps(dot_from, zero), _mm_cmplt_ps(dot_to, dot_from));
+	__m128 t0 = select(below, lo, select(above, hi, _mm_set1_ps(2.0f)));
+	__m128 t1 = select(below, hi, select(above, lo, _mm_set1_ps(-1.0f)));
+
+	__m128 at_t = _mm_max_ps(t0, zero);
+	__m128 atx = _mm_add_ps(fx, _mm_mul_ps(at_t, _mm_sub_ps(tx, fx)));
+	__m128 aty = _mm_add_ps(fy, _mm_mul_ps(at_t, _mm_sub_ps(ty, fy)));
+	__m128 atz = _mm_add_ps(fz, _mm_mul_ps(at_t, _mm_sub_ps(tz, fz)));
+
+	__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(ax, atx), nx), _mm_mul_ps(_mm_sub_ps(ay, aty), ny)), _mm_mul_ps(_mm_sub_ps(az, atz), nz));
+	__m128 clx = _mm_add_ps(atx, _mm_mul_ps(along, nx));
+	__m128 cly = _mm_add_ps(aty, _mm_mul_ps(along, ny));
+	__m128 clz = _mm_add_ps(atz, _mm_mul_ps(along, nz));
+
+	auto side = [&](__m128 ex, __m128 ey, __m128 ez, __m128 px, __m128 py, __m128 pz) {
+		__m128 dx = _mm_sub_ps(clx, px), dy = _mm_sub_ps(cly, py), dz = _mm_sub_ps(clz, pz);
+		__m128 sx = _mm_sub_ps(_mm_mul_ps(ey, dz), _mm_mul_ps(ez, dy));
+		__m128 sy = _mm_sub_ps(_mm_mul_ps(ez, dx), _mm_mul_ps(ex, dz));
+		__m128 sz = _mm_sub_ps(_mm_mul_ps(ex, dy), _mm_mul_ps(ey, dx));
+		return _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, nx), _mm_mul_ps(sy, ny)), _mm_mul_ps(sz, nz)), zero);
+	};
+	__m128 inside = _mm_and_ps(_mm_and_ps(
+		side(_mm_sub_ps(bx, ax), _mm_sub_ps(by, ay), _mm_sub_ps(bz, az), ax, ay, az),
+		side(_mm_sub_ps(cx, bx), _mm_sub_ps(cy, by), _mm_sub_ps(cz, bz), bx, by, bz)),
+		side(_mm_sub_ps(ax, cx), _mm_sub_ps(ay, cy), _mm_sub_ps(az, cz), cx, cy, cz));
+
+	alignas(16) float out_t0[4], out_t1[4], out_at_t[4], out_at[3][4], out_close[3][4];
+	_mm_store_ps(out_t0, t0);
+	_mm_store_ps(out_t1, t1);
+	_mm_store_ps(out_at_t, at_t);
+	_mm_store_ps(out_at[0], atx); _mm_store_ps(out_at[1], aty); _mm_store_ps(out_at[2], atz);
+	_mm_store_ps(out_close[0], clx); _mm_store_ps(out_close[1], cly); _mm_store_ps(out_close[2], clz);
+	int degenerate_mask = _mm_movemask_ps(degenerate);
+	int inside_mask = _mm_movemask_ps(inside);
+	for (uint32_t lane = 0; lane < count; ++lane) {
+		PlaneStage &stage = stages[lane];
+		stage.degenerate = (degenerate_mask >> lane) & 1;
+		if (stage.degenerate) continue; //(as plane_stage(): the rest is never looked at)
+		stage.t0 = out_t0[lane];
+		stage.t1 = out_t1[lane];
+		stage.at_t = out_at_t[lane];
+		stage.at = glm::vec3(out_at[0][lane], out_at[1][lane], out_at[2][lane]);
+		stage.close = glm::vec3(out_close[0][lane], out_close[1][lane], out_close[2][lane]);
+		stage.inside = (inside_mask >> lane) & 1;
+	}
+}
+#endif
+
+//The quick reject is conservative: a triangle is only skipped if
+//  (a) its bounds miss the (slightly padded) bounds of the swept sphere, or
+//  (b) the sphere stays more than (radius + slack) on one side of the triangle's plane
+//       for the whole sweep -- in which case the scalar test also returns false,
+//       since its plane time range starts at or after t = 1.
+// 'slack' covers the rounding differences between the wide and scalar dot products
+// (which are bounded by a few ulps of the terms being summed).
+
+bool collide_swept_sphere_vs_triangles(
+	glm::vec3 const &sphere_from, glm::vec3 const &sphere_to, float sphere_radius,
+	CollisionTriangles const &triangles, uint32_t begin, uint32_t end,
+	float *collision_t, glm::vec3 *collision_at, glm::vec3 *collision_out, bool *is_surface_collision,
+	uint32_t *collision_index, uint32_t *tested
+) {
+	assert(collision_t && *collision_t <= 1.0f);
+	assert(end <= triangles.size());
+
+	//padded bounds of the swept sphere:
+	float pad = 1e-5f * (
+		std::max(std::max(std::abs(sphere_from.x), std::abs(sphere_from.y)), std::abs(sphere_from.z))
+		+ std::max(std::max(std::abs(sphere_to.x), std::abs(sphere_to.y)), std::abs(sphere_to.z))
+		+ sphere_radius);
+	glm::vec3 sphere_min = glm::min(sphere_from, sphere_to) - glm::vec3(sphere_radius + pad);
+	glm::vec3 sphere_max = glm::max(sphere_from, sphere_to) + glm::vec3(sphere_radius + pad);
+	glm::vec3 sweep = sphere_to - sphere_from;
+	float sweep_length = std::abs(sweep.x) + std::abs(sweep.y) + std::abs(sweep.z);
+
+	bool collided = false;
+	uint32_t count = 0;
+	auto finish = [&](uint32_t i, PlaneStage const &stage) {
+		if (finish_swept_sphere_vs_triangle(
+			sphere_from, sphere_to, sphere_radius,
+			glm::vec3(triangles.ax[i], triangles.ay[i], triangles.az[i]),
+			glm::vec3(triangles.bx[i], triangles.by[i], triangles.bz[i]),
+			glm::vec3(triangles.cx[i], triangles.cy[i], triangles.cz[i]),
+			stage, collision_t, collision_at, collision_out, is_surface_collision)) {
+			collided = true;
+			if (collision_index) *collision_index = i;
+		}
+	};
+#if defined(COLLIDE_SSE2)
+	//triangles that pass the quick reject queue up (in order) for plane_stage_4():
+	uint32_t queued[4];
+	uint32_t queued_count = 0;
+	auto flush = [&]() {
+		if (queued_count == 0) return;
+		PlaneStage stages[4];
+		plane_stage_4(sphere_from, sphere_to, sphere_radius, triangles, queued, queued_count, stages);
+		for (uint32_t q = 0; q < queued_count; ++q) {
+			finish(queued[q], stages[q]);
+		}
+		queued_count = 0;
+	};
+	auto check = [&](uint32_t i) {
+		++count;
+		queued[queued_count++] = i;
+		if (queued_count == 4) flush();
+	};
+#else
+	auto check = [&](uint32_t i) {
+		++count;
+		finish(i, plane_stage(sphere_from, sphere_to, sphere_radius, triangles[i]));
+	};
+#endif
+
+	uint32_t i = begin;
+
+#if defined(__AVX__)
+	{
+		__m256 fx = _mm256_set1_ps(sphere_from.x), fy = _mm256_set1_ps(sphere_from.y), fz = _mm256_set1_ps(sphere_from.z);
+		__m256 sx = _mm256_set1_ps(sweep.x), sy = _mm256_set1_ps(sweep.y), sz = _mm256_set1_ps(sweep.z);
+		__m256 lo_x = _mm256_set1_ps(sphere_min.x), lo_y = _mm256_set1_ps(sphere_min.y), lo_z = _mm256_set1_ps(sphere_min.z);
+		__m256 hi_x = _mm256_set1_ps(sphere_max.x), hi_y = _mm256_set1_ps(sphere_max.y), hi_z = _mm256_set1_ps(sphere_max.z);
+		__m256 radius = _mm256_set1_ps(sphere_radius * (1.0f + 1e-5f));
+		__m256 slack_scale = _mm256_set1_ps(1e-5f);
+		__m256 length = _mm256_set1_ps(sweep_length);
+		__m256 sign = _mm256_set1_ps(-0.0f);
+		for (; i + 8 <= end; i += 8) {
+			//bounds overlap:
+			__m256 keep = _mm256_and_ps(
+				_mm256_and_ps(
+					_mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&triangles.min_x[i]), hi_x, _CMP_LE_OQ), _mm256_cmp_ps(_mm256_loadu_ps(&triangles.max_x[i]), lo_x, _CMP_GE_OQ)),
+					_mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&triangles.min_y[i]), hi_y, _CMP_LE_OQ), _mm256_cmp_ps(_mm256_loadu_ps(&triangles.max_y[i]), lo_y, _CMP_GE_OQ))),
+				_mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&triangles.min_z[i]), hi_z, _CMP_LE_OQ), _mm256_cmp_ps(_mm256_loadu_ps(&triangles.max_z[i]), lo_z, _CMP_GE_OQ)));
+			if (_mm256_movemask_ps(keep) == 0) continue;
+
+			//plane distances at start and end of sweep:
+			__m256 nx = _mm256_loadu_ps(&triangles.nx[i]), ny = _mm256_loadu_ps(&triangles.ny[i]), nz = _mm256_loadu_ps(&triangles.nz[i]);
+			__m256 dx = _mm256_sub_ps(fx, _mm256_loadu_ps(&triangles.ax[i]));
+			__m256 dy = _mm256_sub_ps(fy, _mm256_loadu_ps(&triangles.ay[i]));
+			__m256 dz = _mm256_sub_ps(fz, _mm256_loadu_ps(&triangles.az[i]));
+			__m256 d_from = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, dx), _mm256_mul_ps(ny, dy)), _mm256_mul_ps(nz, dz));
+			__m256 d_along = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, sx), _mm256_mul_ps(ny, sy)), _mm256_mul_ps(nz, sz));
+			__m256 d_to = _mm256_add_ps(d_from, d_along);
+			__m256 span = _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(sign, dx), _mm256_andnot_ps(sign, dy)), _mm256_add_ps(_mm256_andnot_ps(sign, dz), length));
+			__m256 reach = _mm256_add_ps(radius, _mm256_mul_ps(slack_scale, span));
+			__m256 above = _mm256_and_ps(_mm256_cmp_ps(d_from, reach, _CMP_GT_OQ), _mm256_cmp_ps(d_to, reach, _CMP_GT_OQ));
+			__m256 neg_reach = _mm256_xor_ps(reach, sign);
+			__m256 below = _mm256_and_ps(_mm256_cmp_ps(d_from, neg_reach, _CMP_LT_OQ), _mm256_cmp_ps(d_to, neg_reach, _CMP_LT_OQ));
+			keep = _mm256_andnot_ps(_mm256_or_ps(above, below), keep);
+
+			int mask = _mm256_movemask_ps(keep);
+			for (uint32_t lane = 0; mask != 0; ++lane, mask >>= 1) {
+				if (mask & 1) check(i + lane);
+			}
+		}
+	}
+#endif
+
+#if defined(COLLIDE_SSE2)
+	{
+		__m128 fx = _mm_set1_ps(sphere_from.x), fy = _mm_set1_ps(sphere_from.y), fz = _mm_set1_ps(sphere_from.z);
+		__m128 sx = _mm_set1_ps(sweep.x), sy = _mm_set1_ps(sweep.y), sz = _mm_set1_ps(sweep.z);
+		__m128 lo_x = _mm_set1_ps(sphere_min.x), lo_y = _mm_set1_ps(sphere_min.y), lo_z = _mm_set1_ps(sphere_min.z);
+		__m128 hi_x = _mm_set1_ps(sphere_max.x), hi_y = _mm_set1_ps(sphere_max.y), hi_z = _mm_set1_ps(sphere_max.z);
+		__m128 radius = _mm_set1_ps(sphere_radius * (1.0f + 1e-5f));
+		__m128 slack_scale = _mm_set1_ps(1e-5f);
+		__m128 length = _mm_set1_ps(sweep_length);
+		__m128 sign = _mm_set1_ps(-0.0f);
+		for (; i + 4 <= end; i += 4) {
+			//bounds overlap:
+			__m128 keep = _mm_and_ps(
+				_mm_and_ps(
+					_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&triangles.min_x[i]), hi_x), _mm_cmpge_ps(_mm_loadu_ps(&triangles.max_x[i]), lo_x)),
+					_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&triangles.min_y[i]), hi_y), _mm_cmpge_ps(_mm_loadu_ps(&triangles.max_y[i]), lo_y))),
+				_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&triangles.min_z[i]), hi_z), _mm_cmpge_ps(_mm_loadu_ps(&triangles.max_z[i]), lo_z)));
+			if (_mm_movemask_ps(keep) == 0) continue;
+
+			//plane distances at start and end of sweep:
+			__m128 nx = _mm_loadu_ps(&triangles.nx[i]), ny = _mm_loadu_ps(&triangles.ny[i]), nz = _mm_loadu_ps(&triangles.nz[i]);
+			__m128 dx = _mm_sub_ps(fx, _mm_loadu_ps(&triangles.ax[i]));
+			__m128 dy = _mm_sub_ps(fy, _mm_loadu_ps(&triangles.ay[i]));
+			__m128 dz = _mm_sub_ps(fz, _mm_loadu_ps(&triangles.az[i]));
+			__m128 d_from = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, dx), _mm_mul_ps(ny, dy)), _mm_mul_ps(nz, dz));
+			__m128 d_along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sx), _mm_mul_ps(ny, sy)), _mm_mul_ps(nz, sz));
+			__m128 d_to = _mm_add_ps(d_from, d_along);
+			__m128 span = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign, dx), _mm_andnot_ps(sign, dy)), _mm_add_ps(_mm_andnot_ps(sign, dz), length));
+			__m128 reach = _mm_add_ps(radius, _mm_mul_ps(slack_scale, span));
+			__m128 above = _mm_and_ps(_mm_cmpgt_ps(d_from, reach), _mm_cmpgt_ps(d_to, reach));
+			__m128 neg_reach = _mm_xor_ps(reach, sign);
+			__m128 below = _mm_and_ps(_mm_cmplt_ps(d_from, neg_reach), _mm_cmplt_ps(d_to, neg_reach));
+			keep = _mm_andnot_ps(_mm_or_ps(above, below), keep);
+
+			int mask = _mm_movemask_ps(keep);
+			for (uint32_t lane = 0; mask != 0; ++lane, mask >>= 1) {
+				if (mask & 1) check(i + lane);
+			}
+		}
+	}
+#endif
+
+	//scalar fallback (and leftovers from the loops above):
+	for (; i < end; ++i) {
+		if (triangles.min_x[i] > sphere_max.x || triangles.max_x[i] < sphere_min.x
+		 || triangles.min_y[i] > sphere_max.y || triangles.max_y[i] < sphere_min.y
+		 || triangles.min_z[i] > sphere_max.z || triangles.max_z[i] < sphere_min.z) continue;
+		glm::vec3 d = sphere_from - glm::vec3(triangles.ax[i], triangles.ay[i], triangles.az[i]);
+		float d_from = triangles.nx[i] * d.x + triangles.ny[i] * d.y + triangles.nz[i] * d.z;
+		float d_to = d_from + (triangles.nx[i] * sweep.x + triangles.ny[i] * sweep.y + triangles.nz[i] * sweep.z);
+		float reach = sphere_radius * (1.0f + 1e-5f) + 1e-5f * ((std::abs(d.x) + std::abs(d.y)) + (std::abs(d.z) + sweep_length));
+		if ((d_from > reach && d_to > reach) || (d_from < -reach && d_to < -reach)) continue;
+		check(i);
+	}
+#if defined(COLLIDE_SSE2)
+	flush();
+#endif
+
+	if (tested) *tested += count;
+	return collided;
+}
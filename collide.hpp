@@ -2,6 +2,9 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
+#include <vector>
+
 //Collision functions:
 
 //Check if two AABBs overlap:
@@ -28,3 +31,76 @@ bool collide_swept_sphere_vs_triangle(
 	glm::vec3 *collision_out = nullptr, //[optional,out] direction to move sphere to get away from triangle as quickly as possible (basically, the outward normal)
   bool *is_surface_collision = nullptr
 );
+
+//Triangle with everything the swept sphere test needs precomputed:
+// (useful for geometry that is tested many times, e.g., cached world-space level colliders)
+struct CollisionTriangle {
+	CollisionTriangle() = default;
+	CollisionTriangle(glm::vec3 const &a_, glm::vec3 const &b_, glm::vec3 const &c_);
+	glm::vec3 a = glm::vec3(0.0f), b = glm::vec3(0.0f), c = glm::vec3(0.0f);
+	//edges (b-a, c-b, a-c):
+	glm::vec3 ab = glm::vec3(0.0f), bc = glm::vec3(0.0f), ca = glm::vec3(0.0f);
+	//unit normal (zero for degenerate triangles):
+	glm::vec3 normal = glm::vec3(0.0f);
+	//bounding box:
+	glm::vec3 min = glm::vec3(0.0f), max = glm::vec3(0.0f);
+};
+
+//Check a swept sphere vs a precomputed triangle:
+// (same results as the version above)
+bool collide_swept_sphere_vs_triangle(
+	glm::vec3 const &sphere_from,
+	glm::vec3 const &sphere_to,
+	float sphere_radius,
+	CollisionTriangle const &triangle,
+	float *collision_t = nullptr,
+	glm::vec3 *collision_at = nullptr,
+	glm::vec3 *collision_out = nullptr,
+	bool *is_surface_collision = nullptr
+);
+
+//Triangles in structure-of-arrays layout, for the batched test below:
+// (one array per float; operator[] puts a CollisionTriangle back together, e.g. for the scalar test)
+struct CollisionTriangles {
+	//corners:
+	std::vector< float > ax, ay, az, bx, by, bz, cx, cy, cz;
+	//unit normal (zero for degenerate triangles):
+	std::vector< float > nx, ny, nz;
+	//bounds:
+	std::vector< float > min_x, min_y, min_z, max_x, max_y, max_z;
+
+	size_t size() const { return ax.size(); }
+	CollisionTriangle operator[](size_t i) const;
+	glm::vec3 min(size_t i) const { return glm::vec3(min_x[i], min_y[i], min_z[i]); }
+	glm::vec3 max(size_t i) const { return glm::vec3(max_x[i], max_y[i], max_z[i]); }
+	void clear();
+	void resize(size_t size);
+	void set(size_t i, CollisionTriangle const &triangle);
+	void push_back(CollisionTriangle const &triangle);
+};
+
+//Check a swept sphere vs triangles [begin,end) of a batch:
+// returns 'true' if any triangle collides earlier than *collision_t, and
+// sets the outputs (and *collision_index) for the earliest one.
+// Triangles are rejected 4 (SSE2) or 8 (AVX) at a time by plane distance and bounds; the
+// survivors get the plane part of the swept test (when the sphere meets the triangle's plane,
+// and whether it does so inside the triangle) 4 at a time (SSE2), and only those that meet the
+// plane outside the triangle go on to the scalar edge and vertex tests. That arithmetic is the
+// scalar test's, in the same order, so t, at, out, and the index are bit-for-bit the same as
+// calling it on each triangle of the range in turn (as long as the compiler doesn't fuse
+// multiply-adds differently in the two -- e.g. build with -ffp-contract=off if FMA is enabled).
+// (is_surface_collision may differ: the scalar test also clears it on some misses)
+// note: *collision_t (required) must start at or below 1.0
+bool collide_swept_sphere_vs_triangles(
+	glm::vec3 const &sphere_from,
+	glm::vec3 const &sphere_to,
+	float sphere_radius,
+	CollisionTriangles const &triangles,
+	uint32_t begin, uint32_t end,
+	float *collision_t,
+	glm::vec3 *collision_at = nullptr,
+	glm::vec3 *collision_out = nullptr,
+	bool *is_surface_collision = nullptr,
+	uint32_t *collision_index = nullptr,
+	uint32_t *tested = nullptr //[optional,in+out] count of triangles that got past the quick reject
+);
@@ -4,9 +4,18 @@
 //Starting mode:
 #include "demo_menu.hpp"
 
+//Network transport options:
+#include "PlayerMode.hpp"
+
+//Session recording playback:
+#include "PlaybackMode.hpp"
+
 //Deal with calling resource loading functions:
 #include "Load.hpp"
 
+//Asset file reading (for load statistics):
+#include "MappedFile.hpp"
+
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
@@ -25,17 +34,53 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <cstdlib>
 
 int main(int argc, char **argv) {
 
-  if (argc == 2) {
-    connect_ip = argv[1];
+  //usage: demo [server address] [--udp [--loss fraction] [--latency ms] [--jitter ms]] [--interp ms] [--record file]
+  //       demo --play file [--parse-only]   (headless playback of a recording; see Recording.hpp)
+  //       --no-mmap reads asset files into memory instead of mapping them (see MappedFile.hpp)
+  std::string play_path;
+  bool parse_only = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--udp") {
+      PlayerMode::transport.datagrams = true;
+    } else if ((arg == "--loss" || arg == "--latency" || arg == "--jitter" || arg == "--interp") && i + 1 < argc) {
+      double value = std::atof(argv[++i]);
+      if (arg == "--loss") PlayerMode::transport.conditions.loss = float(value);
+      else if (arg == "--latency") PlayerMode::transport.conditions.latency = value / 1000.0;
+      else if (arg == "--jitter") PlayerMode::transport.conditions.jitter = value / 1000.0;
+      else PlayerMode::transport.interpolation_delay = value / 1000.0;
+    } else if (arg == "--record" && i + 1 < argc) {
+      PlayerMode::transport.record_path = argv[++i];
+    } else if (arg == "--play" && i + 1 < argc) {
+      play_path = argv[++i];
+    } else if (arg == "--parse-only") {
+      parse_only = true;
+    } else if (arg == "--no-mmap") {
+      MappedFile::use_mmap = false;
+    } else if (arg.size() && arg[0] != '-') {
+      connect_ip = arg;
+    } else {
+      std::cerr << "Ignoring unknown argument '" << arg << "'." << std::endl;
+    }
   }
 #ifdef _WIN32
 	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
 	try {
 #endif
 
+	//------------  playback (no window, no sound) ------------
+	if (!play_path.empty()) {
+		Recording recording(play_path);
+		PlayerMode::headless = true;
+		PlaybackMode playback(recording, parse_only);
+		playback.run();
+		return 0;
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -100,7 +145,14 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ load resources --------------
-	call_load_functions();
+	{
+		auto before = std::chrono::high_resolution_clock::now();
+		call_load_functions();
+		auto after = std::chrono::high_resolution_clock::now();
+		std::cout << "Loaded resources in " << std::chrono::duration< double, std::milli >(after - before).count() << " ms ("
+		          << MappedFile::stats.files << " files, " << MappedFile::stats.mapped_bytes << " bytes mapped, "
+		          << MappedFile::stats.copied_bytes << " bytes read; peak RSS " << (peak_rss_bytes() / 1024) << " KiB)." << std::endl;
+	}
 
 	//------------ create game mode + make current --------------
 	Mode::set_current(demo_menu);
@@ -4,6 +4,8 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <type_traits>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -41,6 +43,100 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 }
 
 
+//The same chunks, read in place from bytes already in memory (e.g., a MappedFile):
+// a ChunkSpan< T > is a view of a chunk's elements; they are copied out one at a time
+// on access, since chunks in a file need not start aligned for T.
+template< typename T >
+struct ChunkSpan {
+	static_assert(std::is_trivially_copyable< T >::value, "chunk elements are plain bytes");
+
+	char const *bytes = nullptr; //(points into the reader's data)
+	size_t count = 0;
+	size_t stride = sizeof(T); //(bytes between elements -- see ChunkSpan::field())
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	size_t size_bytes() const { return count * stride; }
+
+	T operator[](size_t i) const {
+		assert(i < count);
+		T ret;
+		std::memcpy(&ret, bytes + i * stride, sizeof(T));
+		return ret;
+	}
+
+	struct iterator {
+		ChunkSpan const *span;
+		size_t i;
+		T operator*() const { return (*span)[i]; }
+		iterator &operator++() { ++i; return *this; }
+		bool operator!=(iterator const &o) const { return i != o.i; }
+	};
+	iterator begin() const { return iterator{this, 0}; }
+	iterator end() const { return iterator{this, count}; }
+
+	//a view of one member of each element, e.g. span.field< glm::vec3 >(offsetof(Vertex, Position)):
+	template< typename F >
+	ChunkSpan< F > field(size_t offset) const {
+		assert(offset + sizeof(F) <= sizeof(T));
+		ChunkSpan< F > ret;
+		ret.bytes = bytes + offset;
+		ret.count = count;
+		ret.stride = stride;
+		return ret;
+	}
+};
+
+struct ChunkReader {
+	ChunkReader(char const *data_, size_t size_) : data(data_), size(size_) { }
+
+	//read the next chunk, which must have the given magic (throws otherwise, like read_chunk):
+	template< typename T >
+	ChunkSpan< T > read(std::string const &magic) {
+		struct ChunkHeader {
+			char magic[4] = {'\0', '\0', '\0', '\0'};
+			uint32_t size = 0;
+		};
+		static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+		ChunkHeader header;
+		if (size - at < sizeof(header)) {
+			throw std::runtime_error("Failed to read chunk header");
+		}
+		std::memcpy(&header, data + at, sizeof(header));
+		at += sizeof(header);
+		if (std::string(header.magic,4) != magic) {
+			throw std::runtime_error("Unexpected magic number in chunk");
+		}
+
+		if (header.size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		if (size - at < header.size) {
+			throw std::runtime_error("Failed to read chunk data.");
+		}
+
+		ChunkSpan< T > ret;
+		ret.bytes = data + at;
+		ret.count = header.size / sizeof(T);
+		at += header.size;
+		return ret;
+	}
+
+	bool done() const { return at == size; }
+
+	//magic of the next chunk ("" at the end):
+	std::string peek() const {
+		if (size - at < 8) return "";
+		return std::string(data + at, 4);
+	}
+
+	char const *data;
+	size_t size;
+	size_t at = 0; //(start of the next chunk)
+};
+
+
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
 void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
@@ -0,0 +1,410 @@
+//Headless dedicated server:
+// hosts any number of two-player Sessions ("rooms") without a window, OpenGL context, or GPU.
+// Players connect with the regular client (ClientMode), which says hello (see Protocol.hpp)
+// and announces its level and player number with a 'J' message; players are seated in an
+// open room on the same level (or a new room is opened for them).
+// (For load tests, bots.cpp connects any number of scripted players.)
+// Rooms are sharded across worker threads; each worker owns its rooms' connections and
+// runs their network I/O and fixed-rate ticks independently of the other workers.
+// Movement stays client-side (see Session.hpp): rooms relay and sanity-check snapshots, and
+// tick only their level loading, resets, and win detection.
+
+#include "Session.hpp"
+#include "Physics.hpp"
+#include "Connection.hpp"
+#include "Protocol.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//Open seats in rooms, by level.
+// Shared by the main thread (which seats arriving players) and the workers (which own the rooms):
+struct Matchmaker {
+	struct Seat {
+		uint32_t worker = 0;
+		uint64_t room = 0;
+		uint32_t player = 0; //player number of the open seat
+	};
+
+	//record the state of 'room' (on 'worker'): on 'level' with a free seat for 'player' (0 if full or closed):
+	void update(uint32_t worker, uint64_t room, uint32_t level, uint32_t player) {
+		std::lock_guard< std::mutex > lock(mutex);
+		for (auto s = open.begin(); s != open.end(); ++s) {
+			if (s->second.room == room) {
+				open.erase(s);
+				break;
+			}
+		}
+		if (player != 0) {
+			Seat seat;
+			seat.worker = worker;
+			seat.room = room;
+			seat.player = player;
+			open.emplace(level, seat);
+		}
+	}
+
+	//claim an open seat on 'level' for player 'player_num' (0 for any seat):
+	bool take(uint32_t level, uint32_t player_num, Seat *seat) {
+		std::lock_guard< std::mutex > lock(mutex);
+		auto range = open.equal_range(level);
+		for (auto s = range.first; s != range.second; ++s) {
+			if (player_num == 0 || s->second.player == player_num) {
+				*seat = s->second;
+				open.erase(s);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::mutex mutex;
+	std::multimap< uint32_t, Seat > open; //level -> seat
+};
+
+//Per-room numbers a worker publishes for the main thread's reports:
+struct RoomReport {
+	uint64_t room = 0;
+	uint32_t level = 0;
+	uint32_t players = 0;
+	Session::Stats stats;
+};
+
+struct Worker {
+	Worker(uint32_t index_, Matchmaker &matchmaker_, LevelLoader &loader_, std::atomic< uint64_t > &next_room_)
+		: index(index_), matchmaker(matchmaker_), loader(loader_), next_room(next_room_) { }
+
+	uint32_t index;
+	Matchmaker &matchmaker;
+	LevelLoader &loader;
+	std::atomic< uint64_t > &next_room;
+
+	//after a stall, at most this many overdue ticks run back-to-back; the rest are skipped
+	// (and counted in each room's Stats::dropped_ticks), so the catch-up can't starve the rooms' I/O:
+	static constexpr uint32_t MaxCatchUpTicks = 5;
+
+	//players handed off by the main thread:
+	struct Arrival {
+		Connection connection;
+		uint32_t level = 1;
+		uint32_t player = 0;
+		uint64_t room = 0; //room claimed from the matchmaker (0 for a new room)
+	};
+	void hand_off(Arrival &&arrival) {
+		std::lock_guard< std::mutex > lock(mutex);
+		arrivals.emplace_back(std::move(arrival));
+	}
+
+	//latest room reports (refreshed about once per second):
+	std::vector< RoomReport > get_reports() {
+		std::lock_guard< std::mutex > lock(mutex);
+		return reports;
+	}
+
+	std::atomic< uint32_t > room_count{0}; //for balancing new rooms between workers
+
+	void run();
+
+private:
+	std::mutex mutex; //protects arrivals and reports
+	std::vector< Arrival > arrivals;
+	std::vector< RoomReport > reports;
+
+	//owned by the worker thread:
+	ConnectionSet connection_set;
+	std::list< Session > sessions;
+	std::unordered_map< Connection *, Session * > session_of;
+
+	void seat(Arrival &arrival);
+	void offer(Session const &session) {
+		matchmaker.update(index, session.id, session.level_num, (session.failed ? 0 : session.open_player()));
+	}
+	//disconnect a room's players and drop the room:
+	void close_room(Session *session);
+};
+
+void Worker::close_room(Session *session) {
+	std::cout << "[server] worker " << index << " closing room " << session->id << "." << std::endl;
+	for (Connection *&player : session->players) {
+		if (!player) continue;
+		session_of.erase(player);
+		player->close(); //(poll() drops it -- without an OnClose, since it was closed here)
+		player = nullptr;
+	}
+	matchmaker.update(index, session->id, 0, 0);
+	sessions.remove_if([session](Session const &s) { return &s == session; });
+	room_count = uint32_t(sessions.size());
+}
+
+void Worker::seat(Arrival &arrival) {
+	Connection *connection = connection_set.add(std::move(arrival.connection));
+
+	//join the claimed room if it is still there (it may have closed, changed level, or been filled since):
+	Session *session = nullptr;
+	if (arrival.room != 0) {
+		for (auto &s : sessions) {
+			if (s.id == arrival.room) {
+				if (s.level_num == arrival.level && s.add_player(connection, arrival.player)) session = &s;
+				break;
+			}
+		}
+	}
+	if (!session) {
+		sessions.emplace_back(next_room++, arrival.level, loader);
+		session = &sessions.back();
+		session->add_player(connection, arrival.player);
+		room_count = uint32_t(sessions.size());
+	}
+	session_of[connection] = session;
+
+	//anything the player sent after joining:
+	if (!connection->recv_buffer.empty()) session->recv(connection);
+	offer(*session);
+}
+
+void Worker::run() {
+	typedef std::chrono::steady_clock Clock;
+	Clock::duration const tick = std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(Physics::tick));
+	Clock::time_point next_tick = Clock::now();
+	Clock::time_point next_report = next_tick;
+
+	while (true) {
+		{ //seat new arrivals:
+			std::vector< Arrival > arrived;
+			{
+				std::lock_guard< std::mutex > lock(mutex);
+				arrived.swap(arrivals);
+			}
+			for (auto &arrival : arrived) {
+				seat(arrival);
+			}
+		}
+
+		//wait for network traffic until the next tick is due:
+		double timeout = std::chrono::duration< double >(next_tick - Clock::now()).count();
+		connection_set.poll([this](Connection *connection, Connection::Event evt) {
+			auto f = session_of.find(connection);
+			if (f == session_of.end()) return;
+			Session *session = f->second;
+			if (evt == Connection::OnRecv) {
+				uint32_t level_num = session->level_num;
+				session->recv(connection);
+				if (session->level_num != level_num) offer(*session);
+			} else if (evt == Connection::OnClose) {
+				session_of.erase(f);
+				session->remove_player(connection);
+				if (session->empty()) {
+					matchmaker.update(index, session->id, 0, 0);
+					sessions.remove_if([session](Session const &s) { return &s == session; });
+					room_count = uint32_t(sessions.size());
+				} else {
+					offer(*session);
+				}
+			}
+		}, std::max(0.0, timeout));
+
+		//run however many ticks are due (up to MaxCatchUpTicks):
+		Clock::time_point now = Clock::now();
+		if (next_tick <= now) {
+			uint64_t due = uint64_t((now - next_tick) / tick) + 1;
+			if (due > MaxCatchUpTicks) {
+				uint64_t dropped = due - MaxCatchUpTicks;
+				next_tick += tick * Clock::duration::rep(dropped);
+				for (auto &session : sessions) {
+					session.stats.dropped_ticks += dropped;
+				}
+			}
+		}
+		while (next_tick <= now) {
+			for (auto &session : sessions) {
+				uint32_t level_num = session.level_num;
+				session.tick(Physics::tick);
+				if (session.level_num != level_num) offer(session);
+			}
+			next_tick += tick;
+		}
+
+		//rooms whose level failed to load can't go on:
+		for (auto s = sessions.begin(); s != sessions.end(); ) {
+			Session *session = &*s;
+			++s;
+			if (session->failed) close_room(session);
+		}
+
+		if (now >= next_report) {
+			next_report += std::chrono::seconds(1);
+			std::vector< RoomReport > fresh;
+			fresh.reserve(sessions.size());
+			for (auto const &session : sessions) {
+				fresh.emplace_back();
+				fresh.back().room = session.id;
+				fresh.back().level = session.level_num;
+				fresh.back().players = (session.players[0] ? 1 : 0) + (session.players[1] ? 1 : 0);
+				fresh.back().stats = session.stats;
+			}
+			std::lock_guard< std::mutex > lock(mutex);
+			reports.swap(fresh);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	if (argc < 2 || argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <port> [workers=hardware threads]" << std::endl;
+		return 1;
+	}
+	std::string port = argv[1];
+	uint32_t worker_count = std::max(1U, std::thread::hardware_concurrency());
+	if (argc > 2) worker_count = uint32_t(std::stoul(argv[2]));
+	if (worker_count < 1) {
+		std::cerr << "Need at least one worker." << std::endl;
+		return 1;
+	}
+
+	Server server(port);
+
+	Matchmaker matchmaker;
+	//(a couple of threads load levels for every room; while the queue is full, rooms ask again each tick)
+	LevelLoader loader(2, 64);
+	std::atomic< uint64_t > next_room(1);
+	std::vector< std::unique_ptr< Worker > > workers;
+	std::vector< std::thread > threads;
+	for (uint32_t i = 0; i < worker_count; ++i) {
+		workers.emplace_back(new Worker(i, matchmaker, loader, next_room));
+		threads.emplace_back(&Worker::run, workers.back().get());
+	}
+	std::cout << "[server] " << worker_count << " worker thread(s)." << std::endl;
+
+	//The main thread only accepts connections and waits for each player's hello and 'J' message;
+	// after that the player belongs to a worker:
+	std::unordered_set< Connection * > greeted; //connections that sent a good hello
+	auto on_join = [&](Connection *connection) {
+		RingBuffer &data = connection->recv_buffer;
+		Protocol::Frame frame;
+		if (!greeted.count(connection)) {
+			if (!Protocol::peek_frame(data, &frame)) return; //wait for the rest
+			if (!Protocol::check_hello(frame)) {
+				std::cout << "[server] client doesn't speak protocol version " << Protocol::Version << ", disconnecting." << std::endl;
+				connection->close();
+				return;
+			}
+			data.pop(frame.size());
+			greeted.insert(connection);
+		}
+
+		if (!Protocol::peek_frame(data, &frame)) return; //wait for the rest
+		Protocol::Reader reader(frame.payload, frame.length);
+		uint32_t level = reader.u8();
+		uint32_t player = reader.u8();
+		if (frame.type != 'J' || !reader.done() || level < 1 || level > Session::level_count || player > 2) {
+			std::cout << "[server] bad join (level " << level << ", player " << player << "), disconnecting." << std::endl;
+			greeted.erase(connection);
+			connection->close();
+			return;
+		}
+		data.pop(frame.size());
+		greeted.erase(connection);
+
+		Worker::Arrival arrival;
+		arrival.level = level;
+		arrival.player = player;
+		Matchmaker::Seat seat;
+		uint32_t w = 0;
+		if (matchmaker.take(level, player, &seat)) {
+			w = seat.worker;
+			arrival.room = seat.room;
+			arrival.player = seat.player;
+		} else {
+			for (uint32_t i = 1; i < workers.size(); ++i) {
+				if (workers[i]->room_count < workers[w]->room_count) w = i;
+			}
+			workers[w]->room_count += 1; //(the worker corrects this once the room exists)
+		}
+		arrival.connection = server.release(connection);
+		workers[w]->hand_off(std::move(arrival));
+	};
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point next_report = Clock::now() + std::chrono::seconds(10);
+	std::unordered_map< uint64_t, Session::Stats > reported; //room stats as of the previous report
+
+	while (true) {
+		server.poll([&](Connection *connection, Connection::Event evt) {
+			if (evt == Connection::OnOpen) {
+				Protocol::send_hello(connection);
+			} else if (evt == Connection::OnRecv) {
+				on_join(connection);
+			} else if (evt == Connection::OnClose) {
+				greeted.erase(connection);
+			}
+		}, 1.0);
+
+		Clock::time_point now = Clock::now();
+		if (now >= next_report) {
+			next_report += std::chrono::seconds(10);
+			std::unordered_map< uint64_t, Session::Stats > current;
+			for (auto const &worker : workers) {
+				std::vector< RoomReport > reports = worker->get_reports();
+				uint32_t players = 0;
+				uint64_t bytes = 0;
+				for (auto const &report : reports) {
+					Session::Stats before;
+					auto f = reported.find(report.room);
+					if (f != reported.end()) before = f->second;
+					players += report.players;
+					bytes += (report.stats.bytes_in - before.bytes_in) + (report.stats.bytes_out - before.bytes_out);
+					current[report.room] = report.stats;
+				}
+				std::cout << "[server] worker " << worker->index << ": " << reports.size() << " room(s), "
+				          << players << " player(s), " << bytes / 10 << " bytes/s" << std::endl;
+				for (auto const &report : reports) {
+					Session::Stats before;
+					auto f = reported.find(report.room);
+					if (f != reported.end()) before = f->second;
+					uint64_t ticks = report.stats.ticks - before.ticks;
+					double tick_seconds = report.stats.tick_seconds - before.tick_seconds;
+					std::cout << "  room " << report.room << " (level " << report.level << ", " << report.players << " player(s)): "
+					          << ticks / 10 << " ticks/s, "
+					          << (ticks ? tick_seconds / ticks * 1e6 : 0.0) << " us/tick (max " << report.stats.tick_seconds_max * 1e6 << " us), "
+					          << (report.stats.messages - before.messages) / 10 << " messages/s, "
+					          << (report.stats.bytes_in - before.bytes_in) / 10 << " bytes/s in, "
+					          << (report.stats.bytes_out - before.bytes_out) / 10 << " bytes/s out, "
+					          << (report.stats.dropped_ticks - before.dropped_ticks) << " ticks dropped" << std::endl;
+				}
+			}
+			reported.swap(current);
+		}
+	}
+
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
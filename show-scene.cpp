@@ -111,8 +111,7 @@ int main(int argc, char **argv) {
 				if (!buffer_vao) return;
 				Mesh const &mesh = buffer->lookup(mesh_name);
 
-				scene.drawables.emplace_back(transform);
-				Scene::Drawable &drawable = scene.drawables.back();
+				Scene::Drawable &drawable = *scene.add_drawable(transform);
 
 				drawable.pipeline = show_scene_program_pipeline;
 
@@ -120,6 +119,7 @@ int main(int argc, char **argv) {
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
 
 			});
 		} catch (std::exception &e) {